@@ -1,5 +1,7 @@
 #include "compiler.h"
 #include "helpers/vector.h"
+#include "helpers/arena.h"
+#include "helpers/hashmap.h"
 #include <stdarg.h>
 #include <stdio.h>
 #include <assert.h>
@@ -28,6 +30,9 @@ enum
 #define RESPONSE_SET(x) (&(struct response){x})
 #define RESPONSE_EMPTY RESPONSE_SET()
 
+// eax and ecx are the only registers arithmetic keeps values in
+#define CODEGEN_ARITHMETIC_REGISTERS 2
+
 struct response_data
 {
     union
@@ -44,8 +49,7 @@ struct response
 
 void codegen_response_expect()
 {
-    struct response *res = calloc(1, sizeof(struct response));
-    vector_push(current_process->generator->responses, &res);
+    vector_push(current_process->generator->responses, RESPONSE_EMPTY);
 }
 
 struct response_data *codegen_response_data(struct response *response)
@@ -53,9 +57,12 @@ struct response_data *codegen_response_data(struct response *response)
     return &response->data;
 }
 
+/**
+ * The returned response stays valid until the next call to codegen_response_expect
+ */
 struct response *codegen_response_pull()
 {
-    struct response *res = vector_back_ptr_or_null(current_process->generator->responses);
+    struct response *res = vector_back_or_null(current_process->generator->responses);
     if (res)
     {
         vector_pop(current_process->generator->responses);
@@ -65,7 +72,7 @@ struct response *codegen_response_pull()
 
 void codegen_response_acknowledge(struct response *response_in)
 {
-    struct response *res = vector_back_ptr_or_null(current_process->generator->responses);
+    struct response *res = vector_back_or_null(current_process->generator->responses);
     if (res)
     {
         res->flags |= response_in->flags;
@@ -87,43 +94,22 @@ bool codegen_response_has_entity(struct response *res)
     return codegen_response_acknowledged(res) && res->flags & RESPONSE_FLAG_RESOLVED_ENTITY && res->data.resolved_entity;
 }
 
-struct history_exp
-{
-    const char *logical_start_op;
-    char logical_end_label[20];
-    char logical_end_label_positive[20];
-};
-
 struct history
 {
+    // Stays the first member, history_init sets it
     int flags;
-    union
-    {
-        struct history_exp exp;
-    };
 };
 
-static struct history *history_begin(int flags)
-{
-    struct history *history = calloc(1, sizeof(struct history));
-    history->flags = flags;
-    return history;
-}
-
-static struct history *history_down(struct history *history, int flags)
-{
-    struct history *new_history = calloc(1, sizeof(struct history));
-    memcpy(new_history, history, sizeof(struct history));
-    new_history->flags = flags;
-    return new_history;
-}
-
 void codegen_generate_exp_node(struct node *node, struct history *history);
+bool codegen_leaf_operand(struct node *node, int flags, struct mir_operand *out, struct datatype *dtype_out, struct resolver_entity **entity_out);
+void codegen_acknowledge_leaf(struct resolver_entity *entity);
+void codegen_generate_branch(struct node *node, bool jump_if, const char *label);
 const char *codegen_sub_register(const char *original_register, size_t size);
 void codegen_generate_entity_access_for_function_call(struct resolver_result *result, struct resolver_entity *entity);
 void codegen_generate_structure_push(struct resolver_entity *entity, struct history *history, int start_pos);
-void codegen_plus_or_minus_string_for_value(char *out, int val, size_t len);
+const char *codegen_address_string(struct asm_address *address, char *out, size_t len);
 bool codegen_resolve_node_for_value(struct node *node, struct history *history);
+void codegen_gen_multiply_by_constant(const char *reg, int value, const char *scratch);
 bool asm_datatype_back(struct datatype *dtype_out);
 void codegen_generate_entity_access_for_unary_get_address(struct resolver_result *result, struct resolver_entity *entity);
 void codegen_generate_expressionable(struct node *node, struct history *history);
@@ -152,77 +138,98 @@ struct resolver_default_entity_data *codegen_entity_private(struct resolver_enti
     return resolver_default_entity_private(entity);
 }
 
-void asm_push_args(const char *ins, va_list args)
+/**
+ * Instructions of a function are held back until it is finished so the peephole optimizer can see them,
+ * everything else is printed straight away.
+ */
+void asm_emit(struct mir_instruction *instruction)
 {
-    va_list args2;
-    va_copy(args2, args);
-    vfprintf(stdout, ins, args);
-    fprintf(stdout, "\n");
+    struct vector *function_instructions = current_process->generator->function_instructions;
+    if (function_instructions)
+    {
+        vector_push(function_instructions, instruction);
+        return;
+    }
+
+    mir_print(stdout, instruction);
     if (current_process->ofile)
     {
-        vfprintf(current_process->ofile, ins, args2);
-        fprintf(current_process->ofile, "\n");
+        mir_print(current_process->ofile, instruction);
     }
+    mir_instruction_free(instruction);
 }
 
-void asm_push(const char *ins, ...)
+void asm_ins2(int opcode, struct mir_operand first, struct mir_operand second)
 {
-    va_list args;
-    va_start(args, ins);
-    asm_push_args(ins, args);
-    va_end(args);
+    asm_emit(&(struct mir_instruction){.opcode = opcode, .operands = {first, second}});
+}
+
+void asm_ins1(int opcode, struct mir_operand operand)
+{
+    asm_ins2(opcode, operand, mir_none());
+}
+
+void asm_ins0(int opcode)
+{
+    asm_ins2(opcode, mir_none(), mir_none());
+}
+
+// setcc and jcc, i.e asm_ins_cc(MIR_OPCODE_SETCC, "l", mir_register("al")) for setl al
+void asm_ins_cc(int opcode, const char *cc, struct mir_operand operand)
+{
+    asm_emit(&(struct mir_instruction){.opcode = opcode, .cc = cc, .operands = {operand, mir_none()}});
 }
 
-void asm_push_no_nl(const char *ins, ...)
+void asm_label(const char *fmt, ...)
 {
     va_list args;
-    va_start(args, ins);
-    vfprintf(stdout, ins, args);
+    va_start(args, fmt);
+    va_list args2;
+    va_copy(args2, args);
+    int len = vsnprintf(NULL, 0, fmt, args);
+    char *text = malloc(len + 1);
+    vsnprintf(text, len + 1, fmt, args2);
+    va_end(args2);
     va_end(args);
+    asm_emit(&(struct mir_instruction){.opcode = MIR_OPCODE_LABEL, .text = text});
+}
 
-    if (current_process->ofile)
-    {
-        va_list args;
-        va_start(args, ins);
-        vfprintf(current_process->ofile, ins, args);
-        va_end(args);
-    }
+void asm_push_args(const char *ins, va_list args)
+{
+    va_list args_for_length;
+    va_copy(args_for_length, args);
+    int len = vsnprintf(NULL, 0, ins, args_for_length);
+    va_end(args_for_length);
+    char *text = malloc(len + 1);
+    vsnprintf(text, len + 1, ins, args);
+    asm_emit(&(struct mir_instruction){.opcode = MIR_OPCODE_RAW, .text = text});
 }
 
-void asm_push_ins_push(const char *fmt, int stack_entity_type, const char *stack_entity_name, ...)
+void asm_push(const char *ins, ...)
 {
-    char tmp_buf[200];
-    sprintf(tmp_buf, "push %s", fmt);
     va_list args;
-    va_start(args, stack_entity_name);
-    asm_push_args(tmp_buf, args);
+    va_start(args, ins);
+    asm_push_args(ins, args);
     va_end(args);
+}
 
+void asm_push_ins_push(struct mir_operand operand, int stack_entity_type, const char *stack_entity_name)
+{
+    asm_ins1(MIR_OPCODE_PUSH, operand);
     assert(current_function);
     stackframe_push(current_function, &(struct stack_frame_element){.type = stack_entity_type, .name = stack_entity_name});
 }
 
-void asm_push_ins_push_with_flags(const char *fmt, int stack_entity_type, const char *stack_entity_name, int flags, ...)
+void asm_push_ins_push_with_flags(struct mir_operand operand, int stack_entity_type, const char *stack_entity_name, int flags)
 {
-    char tmp_buf[200];
-    sprintf(tmp_buf, "push %s", fmt);
-    va_list args;
-    va_start(args, flags);
-    asm_push_args(tmp_buf, args);
-    va_end(args);
+    asm_ins1(MIR_OPCODE_PUSH, operand);
     assert(current_function);
     stackframe_push(current_function, &(struct stack_frame_element){.flags = flags, .type = stack_entity_type, .name = stack_entity_name});
 }
 
-int asm_push_ins_pop(const char *fmt, int expecting_stack_entity_type, const char *expecting_stack_entity_name, ...)
+int asm_push_ins_pop(const char *reg, int expecting_stack_entity_type, const char *expecting_stack_entity_name)
 {
-    char tmp_buf[200];
-    sprintf(tmp_buf, "pop %s", fmt);
-    va_list args;
-    va_start(args, expecting_stack_entity_name);
-    asm_push_args(tmp_buf, args);
-    va_end(args);
-
+    asm_ins1(MIR_OPCODE_POP, mir_register(reg));
     assert(current_function);
     struct stack_frame_element *element = stackframe_back(current_function);
     int flags = element->flags;
@@ -230,22 +237,16 @@ int asm_push_ins_pop(const char *fmt, int expecting_stack_entity_type, const cha
     return flags;
 }
 
-void asm_push_ins_push_with_data(const char *fmt, int stack_entity_type, const char *stack_entity_name, int flags, struct stack_frame_data *data, ...)
+void asm_push_ins_push_with_data(struct mir_operand operand, int stack_entity_type, const char *stack_entity_name, int flags, struct stack_frame_data *data)
 {
-    char tmp_buf[200];
-    sprintf(tmp_buf, "push %s", fmt);
-    va_list args;
-    va_start(args, data);
-    asm_push_args(tmp_buf, args);
-    va_end(args);
-
+    asm_ins1(MIR_OPCODE_PUSH, operand);
     flags |= STACK_FRAME_ELEMENT_FLAG_HAS_DATATYPE;
     assert(current_function);
     stackframe_push(current_function, &(struct stack_frame_element){.type = stack_entity_type, .name = stack_entity_name, .flags = flags, .data = *data});
 }
 void asm_push_ebp()
 {
-    asm_push_ins_push("ebp", STACK_FRAME_ELEMENT_TYPE_SAVED_BP, "function_entry_saved_ebp");
+    asm_push_ins_push(mir_register("ebp"), STACK_FRAME_ELEMENT_TYPE_SAVED_BP, "function_entry_saved_ebp");
 }
 
 void asm_pop_ebp()
@@ -253,20 +254,14 @@ void asm_pop_ebp()
     asm_push_ins_pop("ebp", STACK_FRAME_ELEMENT_TYPE_SAVED_BP, "function_entry_saved_ebp");
 }
 
-int asm_push_ins_pop_or_ignore(const char *fmt, int expecting_stack_entity_type, const char *expecting_stack_entity_name, ...)
+int asm_push_ins_pop_or_ignore(const char *reg, int expecting_stack_entity_type, const char *expecting_stack_entity_name)
 {
     if (!stackframe_back_expect(current_function, expecting_stack_entity_type, expecting_stack_entity_name))
     {
         return STACK_FRAME_ELEMENT_FLAG_ELEMENT_NOT_FOUND;
     }
 
-    char tmp_buf[200];
-    sprintf(tmp_buf, "pop %s", fmt);
-    va_list args;
-    va_start(args, expecting_stack_entity_name);
-    asm_push_args(tmp_buf, args);
-    va_end(args);
-
+    asm_ins1(MIR_OPCODE_POP, mir_register(reg));
     struct stack_frame_element *element = stackframe_back(current_function);
     int flags = element->flags;
     stackframe_pop_expecting(current_function, expecting_stack_entity_type, expecting_stack_entity_name);
@@ -282,17 +277,31 @@ void codegen_data_section_add(const char *data, ...)
     vector_push(current_process->generator->custom_data_section, &new_data);
 }
 
+void codegen_rodata_section_add(const char *data, ...)
+{
+    va_list args;
+    va_start(args, data);
+    int len = vsnprintf(NULL, 0, data, args);
+    va_end(args);
+
+    char *new_data = malloc(len + 1);
+    va_start(args, data);
+    vsnprintf(new_data, len + 1, data, args);
+    va_end(args);
+    vector_push(current_process->generator->custom_rodata_section, &new_data);
+}
+
 
 void codegen_stack_add_no_compile_time_stack_frame_restore(size_t stack_size)
 {
     if (stack_size != 0)
     {
-        asm_push("add esp, %lld", stack_size);
+        asm_ins2(MIR_OPCODE_ADD, mir_register("esp"), mir_immediate(stack_size));
     }
 }
 void asm_pop_ebp_no_stack_frame_restore()
 {
-    asm_push("pop ebp");
+    asm_ins1(MIR_OPCODE_POP, mir_register("ebp"));
 }
 
 void codegen_stack_sub_with_name(size_t stack_size, const char *name)
@@ -300,7 +309,7 @@ void codegen_stack_sub_with_name(size_t stack_size, const char *name)
     if (stack_size != 0)
     {
         stackframe_sub(current_function, STACK_FRAME_ELEMENT_TYPE_UNKNOWN, name, stack_size);
-        asm_push("sub esp, %lld", stack_size);
+        asm_ins2(MIR_OPCODE_SUB, mir_register("esp"), mir_immediate(stack_size));
     }
 }
 void codegen_stack_sub(size_t stack_size)
@@ -313,7 +322,7 @@ void codegen_stack_add_with_name(size_t stack_size, const char *name)
     if (stack_size != 0)
     {
         stackframe_add(current_function, STACK_FRAME_ELEMENT_TYPE_UNKNOWN, name, stack_size);
-        asm_push("add esp, %lld", stack_size);
+        asm_ins2(MIR_OPCODE_ADD, mir_register("esp"), mir_immediate(stack_size));
     }
 }
 
@@ -329,22 +338,13 @@ struct resolver_entity *codegen_new_scope_entity(struct node *var_node, int offs
 
 const char *codegen_get_label_for_string(const char *str)
 {
-    const char *result = NULL;
-    struct code_generator *generator = current_process->generator;
-    vector_set_peek_pointer(generator->string_table, 0);
-    struct string_table_element *current = vector_peek_ptr(generator->string_table);
-    while (current)
+    struct string_table_element *element = hashmap_get(current_process->generator->string_labels, str);
+    if (!element)
     {
-        if (S_EQ(current->str, str))
-        {
-            result = current->label;
-            break;
-        }
-
-        current = vector_peek_ptr(generator->string_table);
+        return NULL;
     }
 
-    return result;
+    return element->label;
 }
 
 const char *codegen_register_string(const char *str)
@@ -361,6 +361,7 @@ const char *codegen_register_string(const char *str)
     sprintf((char *)str_elem->label, "str_%i", label_id);
     str_elem->str = str;
     vector_push(current_process->generator->string_table, &str_elem);
+    hashmap_set(current_process->generator->string_labels, str_elem->str, str_elem);
     return str_elem->label;
 }
 
@@ -368,14 +369,27 @@ struct code_generator *codegenerator_new(struct compile_process *process)
 {
     struct code_generator *generator = calloc(1, sizeof(struct code_generator));
     generator->string_table = vector_create(sizeof(struct string_table_element *));
+    generator->string_labels = hashmap_create();
     generator->entry_points = vector_create(sizeof(struct codegen_entry_point *));
     generator->exit_points = vector_create(sizeof(struct codegen_exit_point *));
-    generator->responses = vector_create(sizeof(struct response *));
+    generator->responses = vector_create(sizeof(struct response));
     generator->_switch.swtiches = vector_create(sizeof(struct generator_switch_stmt_entity));
     generator->custom_data_section = vector_create(sizeof(const char*));
+    generator->custom_rodata_section = vector_create(sizeof(const char *));
+    generator->function_arena = arena_create();
     return generator;
 }
 
+/**
+ * A symbol name such as function_call_5 for the instructions of the current function, it lives until the function is written out
+ */
+const char *codegen_function_symbol(const char *prefix, int id)
+{
+    char *symbol = arena_alloc(current_process->generator->function_arena, strlen(prefix) + 16);
+    sprintf(symbol, "%s_%i", prefix, id);
+    return symbol;
+}
+
 void codegen_register_exit_point(int exit_point_id)
 {
     struct code_generator *gen = current_process->generator;
@@ -407,7 +421,7 @@ void codegen_end_exit_point()
     struct code_generator *gen = current_process->generator;
     struct codegen_exit_point *exit_point = codegen_current_exit_point();
     assert(exit_point);
-    asm_push(".exit_point_%i:", exit_point->id);
+    asm_label(".exit_point_%i", exit_point->id);
     free(exit_point);
     vector_pop(gen->exit_points);
 }
@@ -416,14 +430,14 @@ void codegen_goto_exit_point(struct node *node)
 {
     struct code_generator *gen = current_process->generator;
     struct codegen_exit_point *exit_point = codegen_current_exit_point();
-    asm_push("jmp .exit_point_%i", exit_point->id);
+    asm_ins1(MIR_OPCODE_JMP, mir_label(".exit_point_%i", exit_point->id));
 }
 
 void codegen_goto_exit_point_maintain_stack(struct node *node)
 {
     struct code_generator *gen = current_process->generator;
     struct codegen_exit_point *exit_point = codegen_current_exit_point();
-    asm_push("jmp .exit_point_%i", exit_point->id);
+    asm_ins1(MIR_OPCODE_JMP, mir_label(".exit_point_%i", exit_point->id));
 }
 
 void codegen_register_entry_point(int entry_point_id)
@@ -444,7 +458,7 @@ void codegen_begin_entry_point()
 {
     int entry_point_id = codegen_label_count();
     codegen_register_entry_point(entry_point_id);
-    asm_push(".entry_point_%i:", entry_point_id);
+    asm_label(".entry_point_%i", entry_point_id);
 }
 
 void codegen_end_entry_point()
@@ -460,7 +474,7 @@ void codegen_goto_entry_point(struct node *current_node)
 {
     struct code_generator *gen = current_process->generator;
     struct codegen_entry_point *entry_point = codegen_current_entry_point();
-    asm_push("jmp .entry_point_%i", entry_point->id);
+    asm_ins1(MIR_OPCODE_JMP, mir_label(".entry_point_%i", entry_point->id));
 }
 
 void codegen_begin_entry_exit_point()
@@ -482,7 +496,7 @@ void codegen_begin_switch_statement()
     vector_push(switch_stmt_data->swtiches, &switch_stmt_data->current);
     memset(&switch_stmt_data->current, 0, sizeof(struct generator_switch_stmt_entity));
     int switch_stmt_id = codegen_label_count();
-    asm_push(".switch_stmt_%i:", switch_stmt_id);
+    asm_label(".switch_stmt_%i", switch_stmt_id);
     switch_stmt_data->current.id = switch_stmt_id;
 }
 
@@ -490,7 +504,7 @@ void codegen_end_switch_statement()
 {
     struct code_generator *generator = current_process->generator;
     struct generator_switch_stmt *switch_stmt_data = &generator->_switch;
-    asm_push(".switch_stmt_%i_end:", switch_stmt_data->current.id);
+    asm_label(".switch_stmt_%i_end", switch_stmt_data->current.id);
     // Lets restore the older switch statement
     memcpy(&switch_stmt_data->current, vector_back(switch_stmt_data->swtiches), sizeof(struct generator_switch_stmt_entity));
     vector_pop(switch_stmt_data->swtiches);
@@ -507,13 +521,25 @@ void codegen_begin_case_statement(int index)
 {
     struct code_generator *generator = current_process->generator;
     struct generator_switch_stmt *switch_stmt_data = &generator->_switch;
-    asm_push(".switch_stmt_%i_case_%i:", switch_stmt_data->current.id, index);
+    asm_label(".switch_stmt_%i_case_%i", switch_stmt_data->current.id, index);
 }
 
 void codegen_end_case_statement()
 {
     // Do nothing.
 }
+void codegen_section(const char *section)
+{
+    struct code_generator *generator = current_process->generator;
+    if (generator->section && S_EQ(generator->section, section))
+    {
+        return;
+    }
+
+    asm_push("section %s", section);
+    generator->section = section;
+}
+
 static const char *asm_keyword_for_size(size_t size, char *tmp_buf)
 {
     const char *keyword = NULL;
@@ -542,11 +568,23 @@ static const char *asm_keyword_for_size(size_t size, char *tmp_buf)
     return tmp_buf;
 }
 
+/**
+ * Globals without a value only reserve space in .bss, they take up no room in the binary
+ */
+void codegen_generate_global_variable_zeroed(struct node *node)
+{
+    codegen_section(".bss");
+    asm_push("%s: resb %lu", node->var.name, (unsigned long)variable_size(node));
+}
+
 void codegen_generate_global_variable_for_primitive(struct node *node)
 {
     char tmp_buf[256];
     if (node->var.val != NULL)
     {
+        // Constants are never written so they belong with the read only data, const char* is still a writable pointer
+        struct datatype *dtype = node->var.type;
+        codegen_section((dtype->flags & DATATYPE_FLAG_IS_CONST) && !(dtype->flags & DATATYPE_FLAG_IS_POINTER) ? ".rodata" : ".data");
         // Handle the value.
         if (node->var.val->type == NODE_TYPE_STRING)
         {
@@ -560,7 +598,7 @@ void codegen_generate_global_variable_for_primitive(struct node *node)
     }
     else
     {
-        asm_push("%s: %s 0", node->var.name, asm_keyword_for_size(variable_size(node), tmp_buf));
+        codegen_generate_global_variable_zeroed(node);
     }
 }
 
@@ -572,8 +610,7 @@ void codegen_generate_global_variable_for_struct(struct node *node)
         return;
     }
 
-    char tmp_buf[256];
-    asm_push("%s: %s 0", node->var.name, asm_keyword_for_size(variable_size(node), tmp_buf));
+    codegen_generate_global_variable_zeroed(node);
 }
 
 void codegen_generate_global_variable_for_union(struct node *node)
@@ -584,8 +621,7 @@ void codegen_generate_global_variable_for_union(struct node *node)
         return;
     }
 
-    char tmp_buf[256];
-    asm_push("%s: %s 0", node->var.name, asm_keyword_for_size(variable_size(node), tmp_buf));
+    codegen_generate_global_variable_zeroed(node);
 }
 
 void codegen_generate_variable_for_array(struct node *node)
@@ -596,19 +632,18 @@ void codegen_generate_variable_for_array(struct node *node)
         return;
     }
 
-    char tmp_buf[256];
-    asm_push("%s: %s 0", node->var.name, asm_keyword_for_size(variable_size(node), tmp_buf));
+    codegen_generate_global_variable_zeroed(node);
 }
 void codegen_generate_global_variable(struct node *node)
 {
-    asm_push("; %s %s", node->var.type.type_str, node->var.name);
-    if (node->var.type.flags & DATATYPE_FLAG_IS_ARRAY)
+    asm_push("; %s %s", node->var.type->type_str, node->var.name);
+    if (node->var.type->flags & DATATYPE_FLAG_IS_ARRAY)
     {
         codegen_generate_variable_for_array(node);
         codegen_new_scope_entity(node, 0, 0);
         return;
     }
-    switch (node->var.type.type)
+    switch (node->var.type->type)
     {
     case DATA_TYPE_VOID:
     case DATA_TYPE_CHAR:
@@ -687,7 +722,6 @@ void codegen_generate_data_section_part(struct node *node)
 }
 void codegen_generate_data_section()
 {
-    asm_push("section .data");
     struct node *node = codegen_node_next();
     while (node)
     {
@@ -703,7 +737,7 @@ struct resolver_entity *codegen_register_function(struct node *func_node, int fl
 void codegen_generate_function_prototype(struct node *node)
 {
     codegen_register_function(node, 0);
-    asm_push("extern %s", node->func.name);
+    asm_push("extern %s", node->func->name);
 }
 
 void codegen_generate_function_arguments(struct vector *argument_vector)
@@ -719,7 +753,7 @@ void codegen_generate_function_arguments(struct vector *argument_vector)
 
 void codegen_generate_number_node(struct node *node, struct history *history)
 {
-    asm_push_ins_push_with_data("dword %i", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", STACK_FRAME_ELEMENT_FLAG_IS_NUMERICAL, &(struct stack_frame_data){.dtype = datatype_for_numeric()}, node->llnum);
+    asm_push_ins_push_with_data(mir_sized("dword", mir_immediate(node->llnum)), STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", STACK_FRAME_ELEMENT_FLAG_IS_NUMERICAL, &(struct stack_frame_data){.dtype = datatype_for_numeric()});
 }
 
 bool codegen_is_exp_root_for_flags(int flags)
@@ -736,19 +770,21 @@ void codegen_reduce_register(const char *reg, size_t size, bool is_signed)
 {
     if (size != DATA_SIZE_DWORD && size > 0)
     {
-        const char *ins = "movsx";
+        int opcode = MIR_OPCODE_MOVSX;
         if (!is_signed)
         {
-            ins = "movzx";
+            opcode = MIR_OPCODE_MOVZX;
         }
-        asm_push("%s eax, %s", ins, codegen_sub_register("eax", size));
+        asm_ins2(opcode, mir_register("eax"), mir_register(codegen_sub_register("eax", size)));
     }
 }
 
 void codegen_gen_mem_access_get_address(struct node *node, int flags, struct resolver_entity *entity)
 {
-    asm_push("lea ebx, [%s]", codegen_entity_private(entity)->address);
-    asm_push_ins_push_with_flags("ebx", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", STACK_FRAME_ELEMENT_FLAG_IS_PUSHED_ADDRESS);
+    // Only locals that never have their address taken are given registers
+    assert(!(codegen_entity_private(entity)->address.flags & ASM_ADDRESS_FLAG_IS_REGISTER));
+    asm_ins2(MIR_OPCODE_LEA, mir_register("ebx"), mir_memory(codegen_entity_private(entity)->address));
+    asm_push_ins_push_with_flags(mir_register("ebx"), STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", STACK_FRAME_ELEMENT_FLAG_IS_PUSHED_ADDRESS);
 }
 
 void codegen_generate_structure_push_or_return(struct resolver_entity *entity, struct history *history, int start_pos)
@@ -768,18 +804,18 @@ void codegen_gen_mem_access(struct node *node, int flags, struct resolver_entity
     {
         codegen_gen_mem_access_get_address(node, 0, entity);
         asm_push_ins_pop("ebx", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
-        codegen_generate_structure_push_or_return(entity, history_begin(0), 0);
+        codegen_generate_structure_push_or_return(entity, HISTORY_BEGIN(0), 0);
     }
     else if (datatype_element_size(&entity->dtype) != DATA_SIZE_DWORD)
     {
-        asm_push("mov eax, [%s]", codegen_entity_private(entity)->address);
+        asm_ins2(MIR_OPCODE_MOV, mir_register("eax"), mir_memory(codegen_entity_private(entity)->address));
         codegen_reduce_register("eax", datatype_element_size(&entity->dtype), entity->dtype.flags & DATATYPE_FLAG_IS_SIGNED);
-        asm_push_ins_push_with_data("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype = entity->dtype});
+        asm_push_ins_push_with_data(mir_register("eax"), STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype = entity->dtype});
     }
     else
     {
         // We can push this straight to the stack
-        asm_push_ins_push_with_data("dword [%s]", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype = entity->dtype}, codegen_entity_private(entity)->address);
+        asm_push_ins_push_with_data(mir_sized("dword", mir_memory(codegen_entity_private(entity)->address)), STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype = entity->dtype});
     }
 }
 void codegen_generate_variable_access_for_entity(struct node *node, struct resolver_entity *entity, struct history *history)
@@ -788,7 +824,7 @@ void codegen_generate_variable_access_for_entity(struct node *node, struct resol
 }
 void codegen_generate_variable_access(struct node *node, struct resolver_entity *entity, struct history *history)
 {
-    codegen_generate_variable_access_for_entity(node, entity, history_down(history, history->flags));
+    codegen_generate_variable_access_for_entity(node, entity, HISTORY_DOWN(history, history->flags));
 }
 void codegen_generate_identifier(struct node *node, struct history *history)
 {
@@ -803,7 +839,7 @@ void codegen_generate_identifier(struct node *node, struct history *history)
 void codegen_generate_unary_address(struct node *node, struct history *history)
 {
     int flags = history->flags;
-    codegen_generate_expressionable(node->unary.operand, history_down(history, flags | EXPRESSION_GET_ADDRESS));
+    codegen_generate_expressionable(node->unary.operand, HISTORY_DOWN(history, flags | EXPRESSION_GET_ADDRESS));
     codegen_response_acknowledge(&(struct response){.flags = RESPONSE_FLAG_UNARY_GET_ADDRESS});
 }
 
@@ -812,7 +848,7 @@ void codegen_generate_unary_indirection(struct node *node, struct history *histo
     const char *reg_to_use = "ebx";
     int flags = history->flags;
     codegen_response_expect();
-    codegen_generate_expressionable(node->unary.operand, history_down(history, flags | EXPRESSION_GET_ADDRESS | EXPRESSION_INDIRECTION));
+    codegen_generate_expressionable(node->unary.operand, HISTORY_DOWN(history, flags | EXPRESSION_GET_ADDRESS | EXPRESSION_INDIRECTION));
     struct response *res = codegen_response_pull();
     assert(codegen_response_has_entity(res));
     struct datatype operand_datatype;
@@ -828,19 +864,53 @@ void codegen_generate_unary_indirection(struct node *node, struct history *histo
 
     for (int i = 0; i < depth; i++)
     {
-        asm_push("mov %s, [%s]", reg_to_use, reg_to_use);
+        asm_ins2(MIR_OPCODE_MOV, mir_register(reg_to_use), mir_memory((struct asm_address){.base = reg_to_use}));
     }
 
     if (real_depth == res->data.resolved_entity->dtype.pointer_depth)
     {
         codegen_reduce_register(reg_to_use, datatype_size_no_ptr(&operand_datatype), operand_datatype.flags & DATATYPE_FLAG_IS_SIGNED);
     }
-    asm_push_ins_push_with_data(reg_to_use, STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype = operand_datatype});
+    asm_push_ins_push_with_data(mir_register(reg_to_use), STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype = operand_datatype});
     codegen_response_acknowledge(&(struct response){.flags = RESPONSE_FLAG_RESOLVED_ENTITY, .data.resolved_entity = res->data.resolved_entity});
 }
 
+/**
+ * ++ and -- on a local kept in a register change the register in place, only the value of the expression goes through eax
+ */
+bool codegen_generate_increment_in_register(struct node *node)
+{
+    struct mir_operand operand;
+    struct datatype dtype;
+    struct resolver_entity *entity = NULL;
+    if (!codegen_leaf_operand(node->unary.operand, 0, &operand, &dtype, &entity) || operand.type != MIR_OPERAND_REGISTER)
+    {
+        return false;
+    }
+
+    codegen_acknowledge_leaf(entity);
+    int opcode = S_EQ(node->unary.op, "++") ? MIR_OPCODE_INC : MIR_OPCODE_DEC;
+    bool is_postfix = node->unary.flags & UNARY_FLAG_IS_LEFT_OPERANDED_UNARY;
+    if (is_postfix)
+    {
+        asm_ins2(MIR_OPCODE_MOV, mir_register("eax"), operand);
+    }
+    asm_ins1(opcode, operand);
+    if (!is_postfix)
+    {
+        asm_ins2(MIR_OPCODE_MOV, mir_register("eax"), operand);
+    }
+    asm_push_ins_push_with_data(mir_register("eax"), STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype = dtype});
+    return true;
+}
+
 void codegen_generate_normal_unary(struct node *node, struct history *history)
 {
+    if ((S_EQ(node->unary.op, "++") || S_EQ(node->unary.op, "--")) && codegen_generate_increment_in_register(node))
+    {
+        return;
+    }
+
     codegen_generate_expressionable(node->unary.operand, history);
 
     struct datatype last_dtype;
@@ -849,13 +919,13 @@ void codegen_generate_normal_unary(struct node *node, struct history *history)
     asm_push_ins_pop("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
     if (S_EQ(node->unary.op, "-"))
     {
-        asm_push("neg eax");
-        asm_push_ins_push_with_data("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype = last_dtype});
+        asm_ins1(MIR_OPCODE_NEG, mir_register("eax"));
+        asm_push_ins_push_with_data(mir_register("eax"), STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype = last_dtype});
     }
     else if (S_EQ(node->unary.op, "~"))
     {
-        asm_push("not eax");
-        asm_push_ins_push_with_data("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype = last_dtype});
+        asm_ins1(MIR_OPCODE_NOT, mir_register("eax"));
+        asm_push_ins_push_with_data(mir_register("eax"), STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype = last_dtype});
     }
     else if (S_EQ(node->unary.op, "*"))
     {
@@ -866,18 +936,18 @@ void codegen_generate_normal_unary(struct node *node, struct history *history)
         if (node->unary.flags & UNARY_FLAG_IS_LEFT_OPERANDED_UNARY)
         {
             // a++
-            asm_push_ins_push_with_data("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype = last_dtype});
-            asm_push("inc eax");
-            asm_push_ins_push_with_data("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype = last_dtype});
+            asm_push_ins_push_with_data(mir_register("eax"), STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype = last_dtype});
+            asm_ins1(MIR_OPCODE_INC, mir_register("eax"));
+            asm_push_ins_push_with_data(mir_register("eax"), STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype = last_dtype});
             codegen_generate_assignment_part(node->unary.operand, "=", history);
         }
         else
         {
             // ++a
-            asm_push("inc eax");
-            asm_push_ins_push_with_data("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype = last_dtype});
+            asm_ins1(MIR_OPCODE_INC, mir_register("eax"));
+            asm_push_ins_push_with_data(mir_register("eax"), STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype = last_dtype});
             codegen_generate_assignment_part(node->unary.operand, "=", history);
-            asm_push_ins_push_with_data("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype = last_dtype});
+            asm_push_ins_push_with_data(mir_register("eax"), STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype = last_dtype});
         }
     }
     else if (S_EQ(node->unary.op, "--"))
@@ -885,18 +955,18 @@ void codegen_generate_normal_unary(struct node *node, struct history *history)
         if (node->unary.flags & UNARY_FLAG_IS_LEFT_OPERANDED_UNARY)
         {
             // a--
-            asm_push_ins_push_with_data("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype = last_dtype});
-            asm_push("dec eax");
-            asm_push_ins_push_with_data("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype = last_dtype});
+            asm_push_ins_push_with_data(mir_register("eax"), STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype = last_dtype});
+            asm_ins1(MIR_OPCODE_DEC, mir_register("eax"));
+            asm_push_ins_push_with_data(mir_register("eax"), STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype = last_dtype});
             codegen_generate_assignment_part(node->unary.operand, "=", history);
         }
         else
         {
             // --a
-            asm_push("dec eax");
-            asm_push_ins_push_with_data("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype = last_dtype});
+            asm_ins1(MIR_OPCODE_DEC, mir_register("eax"));
+            asm_push_ins_push_with_data(mir_register("eax"), STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype = last_dtype});
             codegen_generate_assignment_part(node->unary.operand, "=", history);
-            asm_push_ins_push_with_data("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype = last_dtype});
+            asm_push_ins_push_with_data(mir_register("eax"), STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype = last_dtype});
         }
     }
 
@@ -925,42 +995,47 @@ void codegen_generate_unary(struct node *node, struct history *history)
 
 void codegen_gen_mov_for_value(const char *reg, const char *value, const char *datatype, int flags)
 {
-    asm_push("mov %s, %s", reg, value);
+    asm_ins2(MIR_OPCODE_MOV, mir_register(reg), mir_label("%s", value));
 }
 
 void codegen_generate_string(struct node *node, struct history *history)
 {
     const char *label = codegen_register_string(node->sval);
     codegen_gen_mov_for_value("eax", label, "dword", history->flags);
-    asm_push_ins_push_with_data("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype = datatype_for_string()});
+    asm_push_ins_push_with_data(mir_register("eax"), STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype = datatype_for_string()});
 }
 
 void codegen_generate_exp_parenthesis_node(struct node *node, struct history *history)
 {
-    codegen_generate_expressionable(node->parenthesis.exp, history_down(history, codegen_remove_uninheritable_flags(history->flags)));
+    codegen_generate_expressionable(node->parenthesis.exp, HISTORY_DOWN(history, codegen_remove_uninheritable_flags(history->flags)));
 }
 
+/**
+ * cond ? a : b, the node is the "?" expression with the condition on the left and the tenary node on the right
+ */
 void codegen_generate_tenary(struct node *node, struct history *history)
 {
+    struct node *tenary_node = node->exp.right;
     int true_label_id = codegen_label_count();
     int false_label_id = codegen_label_count();
     int tenary_end_label_id = codegen_label_count();
 
-    struct datatype last_dtype;
-    assert(asm_datatype_back(&last_dtype));
-    asm_push_ins_pop("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
-    asm_push("cmp eax, 0");
-    asm_push("je .tenary_false_%i", false_label_id);
-    asm_push(".tenary_true_%i:", true_label_id);
+    char false_label[32];
+    sprintf(false_label, ".tenary_false_%i", false_label_id);
+    codegen_generate_branch(node->exp.left, false, false_label);
+    asm_label(".tenary_true_%i", true_label_id);
 
-    codegen_generate_expressionable(node->tenary.true_node, history_down(history, 0));
+    codegen_generate_expressionable(tenary_node->tenary.true_node, HISTORY_DOWN(history, 0));
+    struct datatype last_dtype = datatype_for_numeric();
+    asm_datatype_back(&last_dtype);
     asm_push_ins_pop_or_ignore("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
-    asm_push("jmp .tenary_end_%i", tenary_end_label_id);
+    asm_ins1(MIR_OPCODE_JMP, mir_label(".tenary_end_%i", tenary_end_label_id));
 
-    asm_push(".tenary_false_%i:", false_label_id);
-    codegen_generate_expressionable(node->tenary.false_node, history_down(history, 0));
+    asm_label(".tenary_false_%i", false_label_id);
+    codegen_generate_expressionable(tenary_node->tenary.false_node, HISTORY_DOWN(history, 0));
     asm_push_ins_pop_or_ignore("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
-    asm_push(".tenary_end_%i:", tenary_end_label_id);
+    asm_label(".tenary_end_%i", tenary_end_label_id);
+    asm_push_ins_push_with_data(mir_register("eax"), STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype = last_dtype});
 }
 
 void codegen_generate_cast(struct node *node, struct history *history)
@@ -971,8 +1046,8 @@ void codegen_generate_cast(struct node *node, struct history *history)
     }
 
     asm_push_ins_pop("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
-    codegen_reduce_register("eax", datatype_size(&node->cast.dtype), node->cast.dtype.flags & DATATYPE_FLAG_IS_SIGNED);
-    asm_push_ins_push_with_data("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype = node->cast.dtype});
+    codegen_reduce_register("eax", datatype_size(node->cast.dtype), node->cast.dtype->flags & DATATYPE_FLAG_IS_SIGNED);
+    asm_push_ins_push_with_data(mir_register("eax"), STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype = *node->cast.dtype});
 }
 
 void codegen_generate_expressionable(struct node *node, struct history *history)
@@ -1007,10 +1082,6 @@ void codegen_generate_expressionable(struct node *node, struct history *history)
         codegen_generate_unary(node, history);
         break;
 
-    case NODE_TYPE_TENARY:
-        codegen_generate_tenary(node, history);
-        break;
-
     case NODE_TYPE_CAST:
         codegen_generate_cast(node, history);
         break;
@@ -1111,80 +1182,92 @@ const char *codegen_byte_word_or_dword_or_ddword(size_t size, const char **reg_t
     return type;
 }
 
-void codegen_generate_assignment_instruction_for_operator(const char *mov_type_keyword, const char *address, const char *reg_to_use, const char *op, bool is_signed)
+void codegen_generate_assignment_instruction_for_operator(const char *mov_type_keyword, struct mir_operand operand, const char *reg_to_use, const char *op, bool is_signed)
 {
     assert(reg_to_use != "ecx");
 
+    // Registers already imply their size, memory needs the size keyword
+    struct mir_operand destination = mir_sized(mov_type_keyword, operand);
+
     if (S_EQ(op, "="))
     {
-        asm_push("mov %s [%s], %s", mov_type_keyword, address, reg_to_use);
+        asm_ins2(MIR_OPCODE_MOV, destination, mir_register(reg_to_use));
     }
     else if (S_EQ(op, "+="))
     {
-        asm_push("add %s [%s], %s", mov_type_keyword, address, reg_to_use);
+        asm_ins2(MIR_OPCODE_ADD, destination, mir_register(reg_to_use));
     }
     else if (S_EQ(op, "-="))
     {
-        asm_push("sub %s [%s], %s", mov_type_keyword, address, reg_to_use);
+        asm_ins2(MIR_OPCODE_SUB, destination, mir_register(reg_to_use));
     }
     else if (S_EQ(op, "*="))
     {
-        asm_push("mov ecx, %s", reg_to_use);
-        asm_push("mov eax, [%s]", address);
+        asm_ins2(MIR_OPCODE_MOV, mir_register("ecx"), mir_register(reg_to_use));
+        asm_ins2(MIR_OPCODE_MOV, mir_register("eax"), operand);
         if (is_signed)
         {
-            asm_push("imul %s", reg_to_use);
+            asm_ins1(MIR_OPCODE_IMUL, mir_register(reg_to_use));
         }
         else
         {
-            asm_push("mul %s", reg_to_use);
+            asm_ins1(MIR_OPCODE_MUL, mir_register(reg_to_use));
         }
-        asm_push("mov %s [%s], eax", mov_type_keyword, address);
+        asm_ins2(MIR_OPCODE_MOV, destination, mir_register("eax"));
     }
     else if (S_EQ(op, "/="))
     {
-        asm_push("mov ecx, eax");
-        asm_push("mov eax, [%s]", address);
-        asm_push("cdq");
+        asm_ins2(MIR_OPCODE_MOV, mir_register("ecx"), mir_register("eax"));
+        asm_ins2(MIR_OPCODE_MOV, mir_register("eax"), operand);
+        asm_ins0(MIR_OPCODE_CDQ);
         if (is_signed)
         {
-            asm_push("idiv ecx");
+            asm_ins1(MIR_OPCODE_IDIV, mir_register("ecx"));
         }
         else
         {
-            asm_push("div ecx");
+            asm_ins1(MIR_OPCODE_DIV, mir_register("ecx"));
         }
-        asm_push("mov %s [%s], %s", mov_type_keyword, address, reg_to_use);
+        asm_ins2(MIR_OPCODE_MOV, destination, mir_register(reg_to_use));
     }
     else if (S_EQ(op, "<<="))
     {
-        asm_push("mov ecx, %s", reg_to_use);
-        asm_push("sal %s [%s], cl", mov_type_keyword, address);
+        asm_ins2(MIR_OPCODE_MOV, mir_register("ecx"), mir_register(reg_to_use));
+        asm_ins2(MIR_OPCODE_SAL, destination, mir_register("cl"));
     }
     else if (S_EQ(op, ">>="))
     {
-        asm_push("mov ecx, %s", reg_to_use);
+        asm_ins2(MIR_OPCODE_MOV, mir_register("ecx"), mir_register(reg_to_use));
         if (is_signed)
         {
-            asm_push("sar %s [%s], cl", mov_type_keyword, address);
+            asm_ins2(MIR_OPCODE_SAR, destination, mir_register("cl"));
         }
         else
         {
-            asm_push("shr %s [%s], cl", mov_type_keyword, address);
+            asm_ins2(MIR_OPCODE_SHR, destination, mir_register("cl"));
         }
     }
 }
 void codegen_generate_scope_variable(struct node *node)
 {
     struct resolver_entity *entity = codegen_new_scope_entity(node, node->var.aoffset, RESOLVER_DEFAULT_ENTITY_FLAG_IS_LOCAL_STACK);
-    if (node->var.val)
+    struct mir_operand value;
+    struct datatype value_dtype;
+    struct resolver_entity *value_entity = NULL;
+    if (node->var.val && node->var.reg && codegen_leaf_operand(node->var.val, 0, &value, &value_dtype, &value_entity))
+    {
+        // Registers are initialized straight from a constant or another variable
+        codegen_acknowledge_leaf(value_entity);
+        asm_ins2(MIR_OPCODE_MOV, mir_register(node->var.reg), value);
+    }
+    else if (node->var.val)
     {
-        codegen_generate_expressionable(node->var.val, history_begin(EXPRESSION_IS_ASSIGNMENT | IS_RIGHT_OPERAND_OF_ASSIGNMENT));
+        codegen_generate_expressionable(node->var.val, HISTORY_BEGIN(EXPRESSION_IS_ASSIGNMENT | IS_RIGHT_OPERAND_OF_ASSIGNMENT));
         // pop eax
         asm_push_ins_pop("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
         const char *reg_to_use = "eax";
         const char *mov_type = codegen_byte_word_or_dword_or_ddword(datatype_element_size(&entity->dtype), &reg_to_use);
-        codegen_generate_assignment_instruction_for_operator(mov_type, codegen_entity_private(entity)->address, reg_to_use, "=", entity->dtype.flags & DATATYPE_FLAG_IS_SIGNED);
+        codegen_generate_assignment_instruction_for_operator(mov_type, mir_memory(codegen_entity_private(entity)->address), reg_to_use, "=", entity->dtype.flags & DATATYPE_FLAG_IS_SIGNED);
     }
 }
 
@@ -1197,19 +1280,20 @@ void codegen_generate_entity_access_start(struct resolver_result *result, struct
     }
     else if (result->flags & RESOLVER_RESULT_FLAG_FIRST_ENTITY_PUSH_VALUE)
     {
-        asm_push_ins_push_with_data("dword [%s]", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype = root_assignment_entity->dtype}, result->base.address);
+        asm_push_ins_push_with_data(mir_sized("dword", mir_memory(result->base.address)), STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype = root_assignment_entity->dtype});
     }
     else if (result->flags & RESOLVER_RESULT_FLAG_FIRST_ENTITY_LOAD_TO_EBX)
     {
         if (root_assignment_entity->next && root_assignment_entity->next->flags & RESOLVER_ENTITY_FLAG_IS_POINTER_ARRAY_ENTITY)
         {
-            asm_push("mov ebx, [%s]", result->base.address);
+            asm_ins2(MIR_OPCODE_MOV, mir_register("ebx"), mir_memory(result->base.address));
         }
         else
         {
-            asm_push("lea ebx, [%s]", result->base.address);
+            assert(!(result->base.address.flags & ASM_ADDRESS_FLAG_IS_REGISTER));
+            asm_ins2(MIR_OPCODE_LEA, mir_register("ebx"), mir_memory(result->base.address));
         }
-        asm_push_ins_push_with_data("ebx", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype = root_assignment_entity->dtype});
+        asm_push_ins_push_with_data(mir_register("ebx"), STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype = root_assignment_entity->dtype});
     }
 }
 
@@ -1219,10 +1303,10 @@ void codegen_generate_entity_access_for_variable_or_general(struct resolver_resu
     asm_push_ins_pop("ebx", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
     if (entity->flags & RESOLVER_ENTITY_FLAG_DO_INDIRECTION)
     {
-        asm_push("mov ebx, [ebx]");
+        asm_ins2(MIR_OPCODE_MOV, mir_register("ebx"), mir_memory((struct asm_address){.base = "ebx"}));
     }
-    asm_push("add ebx, %i", entity->offset);
-    asm_push_ins_push_with_data("ebx", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype = entity->dtype});
+    asm_ins2(MIR_OPCODE_ADD, mir_register("ebx"), mir_immediate(entity->offset));
+    asm_push_ins_push_with_data(mir_register("ebx"), STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype = entity->dtype});
 }
 
 int codegen_entity_rules(struct resolver_entity *last_entity, struct history *history)
@@ -1261,7 +1345,7 @@ void codegen_apply_unary_access(int depth)
 {
     for (int i = 0; i < depth; i++)
     {
-        asm_push("mov ebx, [ebx]");
+        asm_ins2(MIR_OPCODE_MOV, mir_register("ebx"), mir_memory((struct asm_address){.base = "ebx"}));
     }
 }
 void codegen_generate_entity_access_for_unary_indirection_for_assignment_left_operand(struct resolver_result *result, struct resolver_entity *entity, struct history *history)
@@ -1271,12 +1355,12 @@ void codegen_generate_entity_access_for_unary_indirection_for_assignment_left_op
     int gen_entity_rules = codegen_entity_rules(result->last_entity, history);
     int depth = entity->indirection.depth - 1;
     codegen_apply_unary_access(depth);
-    asm_push_ins_push_with_flags("ebx", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", STACK_FRAME_ELEMENT_FLAG_IS_PUSHED_ADDRESS);
+    asm_push_ins_push_with_flags(mir_register("ebx"), STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", STACK_FRAME_ELEMENT_FLAG_IS_PUSHED_ADDRESS);
 }
 
 void codegen_generate_entity_access_for_unsupported(struct resolver_result *result, struct resolver_entity *entity)
 {
-    codegen_generate_expressionable(entity->node, history_begin(0));
+    codegen_generate_expressionable(entity->node, HISTORY_BEGIN(0));
 }
 
 void codegen_generate_entity_access_for_cast(struct resolver_result *result, struct resolver_entity *entity)
@@ -1287,14 +1371,14 @@ void codegen_generate_entity_access_for_cast(struct resolver_result *result, str
 void codegen_generate_entity_access_array_bracket_pointer(struct resolver_result *result, struct resolver_entity *entity)
 {
     asm_push_ins_pop("ebx", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
-    codegen_generate_expressionable(entity->array.array_index_node, history_begin(0));
+    codegen_generate_expressionable(entity->array.array_index_node, HISTORY_BEGIN(0));
     asm_push_ins_pop("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
     if (datatype_element_size(&entity->dtype) > DATA_SIZE_BYTE)
     {
-        asm_push("imul eax, %i", datatype_size_for_array_access(&entity->dtype));
+        codegen_gen_multiply_by_constant("eax", datatype_size_for_array_access(&entity->dtype), NULL);
     }
-    asm_push("add ebx, eax");
-    asm_push_ins_push_with_data("ebx", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype = entity->dtype});
+    asm_ins2(MIR_OPCODE_ADD, mir_register("ebx"), mir_register("eax"));
+    asm_push_ins_push_with_data(mir_register("ebx"), STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype = entity->dtype});
 }
 void codegen_generate_entity_access_array_bracket(struct resolver_result *result, struct resolver_entity *entity)
 {
@@ -1305,20 +1389,20 @@ void codegen_generate_entity_access_array_bracket(struct resolver_result *result
     }
 
     asm_push_ins_pop("ebx", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
-    codegen_generate_expressionable(entity->array.array_index_node, history_begin(0));
+    codegen_generate_expressionable(entity->array.array_index_node, HISTORY_BEGIN(0));
     asm_push_ins_pop("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
 
     if (entity->flags & RESOLVER_ENTITY_FLAG_JUST_USE_OFFSET)
     {
-        asm_push("add ebx, %i", entity->offset);
+        asm_ins2(MIR_OPCODE_ADD, mir_register("ebx"), mir_immediate(entity->offset));
     }
     else
     {
-        asm_push("imul eax, %i", entity->offset);
-        asm_push("add ebx, eax");
+        codegen_gen_multiply_by_constant("eax", entity->offset, NULL);
+        asm_ins2(MIR_OPCODE_ADD, mir_register("ebx"), mir_register("eax"));
     }
 
-    asm_push_ins_push_with_data("ebx", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype = entity->dtype});
+    asm_push_ins_push_with_data(mir_register("ebx"), STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype = entity->dtype});
 }
 void codegen_generate_entity_access_for_entity_for_assignment_left_operand(struct resolver_result *result, struct resolver_entity *entity, struct history *history)
 {
@@ -1368,17 +1452,16 @@ void codegen_generate_entity_access_for_assignment_left_operand(struct resolver_
     }
 }
 
-void codegen_generate_move_struct(struct datatype *dtype, const char *base_address, off_t offset)
+void codegen_generate_move_struct(struct datatype *dtype, struct asm_address *base_address, off_t offset)
 {
     size_t structure_size = align_value(datatype_size(dtype), DATA_SIZE_DWORD);
     int pops = structure_size / DATA_SIZE_DWORD;
     for (int i = 0; i < pops; i++)
     {
         asm_push_ins_pop("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
-        char fmt[10];
-        int chunk_offset = offset + (i * DATA_SIZE_DWORD);
-        codegen_plus_or_minus_string_for_value(fmt, chunk_offset, sizeof(fmt));
-        asm_push("mov [%s%s], eax", base_address, fmt);
+        struct asm_address chunk_address = *base_address;
+        chunk_address.displacement += offset + (i * DATA_SIZE_DWORD);
+        asm_ins2(MIR_OPCODE_MOV, mir_memory(chunk_address), mir_register("eax"));
     }
 }
 void codegen_generate_assignment_part(struct node *node, const char *op, struct history *history)
@@ -1394,12 +1477,12 @@ void codegen_generate_assignment_part(struct node *node, const char *op, struct
     {
         if (datatype_is_struct_or_union_non_pointer(&result->last_entity->dtype))
         {
-            codegen_generate_move_struct(&result->last_entity->dtype, result->base.address, 0);
+            codegen_generate_move_struct(&result->last_entity->dtype, &result->base.address, 0);
         }
         else
         {
             asm_push_ins_pop("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
-            codegen_generate_assignment_instruction_for_operator(mov_type, result->base.address, reg_to_use, op, result->last_entity->dtype.flags & DATATYPE_FLAG_IS_SIGNED);
+            codegen_generate_assignment_instruction_for_operator(mov_type, mir_memory(result->base.address), reg_to_use, op, result->last_entity->dtype.flags & DATATYPE_FLAG_IS_SIGNED);
         }
     }
     else
@@ -1407,12 +1490,52 @@ void codegen_generate_assignment_part(struct node *node, const char *op, struct
         codegen_generate_entity_access_for_assignment_left_operand(result, root_assignment_entity, node, history);
         asm_push_ins_pop("edx", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
         asm_push_ins_pop("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
-        codegen_generate_assignment_instruction_for_operator(mov_type, "edx", reg_to_use, op, result->last_entity->flags & DATATYPE_FLAG_IS_SIGNED);
+        codegen_generate_assignment_instruction_for_operator(mov_type, mir_memory((struct asm_address){.base = "edx"}), reg_to_use, op, result->last_entity->flags & DATATYPE_FLAG_IS_SIGNED);
+    }
+}
+/**
+ * x = y, x += y and x -= y for a local kept in a register are a single instruction when y is a leaf
+ */
+bool codegen_generate_assignment_to_register(struct node *node)
+{
+    int opcode = -1;
+    if (S_EQ(node->exp.op, "="))
+    {
+        opcode = MIR_OPCODE_MOV;
+    }
+    else if (S_EQ(node->exp.op, "+="))
+    {
+        opcode = MIR_OPCODE_ADD;
+    }
+    else if (S_EQ(node->exp.op, "-="))
+    {
+        opcode = MIR_OPCODE_SUB;
+    }
+
+    struct mir_operand destination;
+    struct mir_operand value;
+    struct datatype dtype;
+    struct resolver_entity *destination_entity = NULL;
+    struct resolver_entity *value_entity = NULL;
+    if (opcode == -1 || !codegen_leaf_operand(node->exp.left, 0, &destination, &dtype, &destination_entity) ||
+        destination.type != MIR_OPERAND_REGISTER || !codegen_leaf_operand(node->exp.right, 0, &value, &dtype, &value_entity))
+    {
+        return false;
     }
+
+    codegen_acknowledge_leaf(value_entity);
+    asm_ins2(opcode, destination, value);
+    return true;
 }
+
 void codegen_generate_assignment_expression(struct node *node, struct history *history)
 {
-    codegen_generate_expressionable(node->exp.right, history_down(history, EXPRESSION_IS_ASSIGNMENT | IS_RIGHT_OPERAND_OF_ASSIGNMENT));
+    if (codegen_generate_assignment_to_register(node))
+    {
+        return;
+    }
+
+    codegen_generate_expressionable(node->exp.right, HISTORY_DOWN(history, EXPRESSION_IS_ASSIGNMENT | IS_RIGHT_OPERAND_OF_ASSIGNMENT));
     codegen_generate_assignment_part(node->exp.left, node->exp.op, history);
 }
 
@@ -1422,24 +1545,25 @@ void codegen_generate_entity_access_for_function_call(struct resolver_result *re
     vector_set_peek_pointer_end(entity->func_call_data.arguments);
 
     struct node *node = vector_peek_ptr(entity->func_call_data.arguments);
-    int function_call_label_id= codegen_label_count();
-    codegen_data_section_add("function_call_%i: dd 0", function_call_label_id);
+    const char *function_call_label = codegen_function_symbol("function_call", codegen_label_count());
+    struct asm_address function_call_address = {.base = function_call_label, .flags = ASM_ADDRESS_FLAG_BASE_IS_SYMBOL};
+    codegen_data_section_add("%s: dd 0", function_call_label);
     asm_push_ins_pop("ebx", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
-    asm_push("mov dword [function_call_%i], ebx", function_call_label_id);
+    asm_ins2(MIR_OPCODE_MOV, mir_sized("dword", mir_memory(function_call_address)), mir_register("ebx"));
     
     if (datatype_is_struct_or_union_non_pointer(&entity->dtype))
     {
         asm_push("; SUBTRACT ROOM FOR RETURNED STRUCTURE/UNION DATATYPE");
         codegen_stack_sub_with_name(align_value(datatype_size(&entity->dtype), DATA_SIZE_DWORD), "result_value");
-        asm_push_ins_push("esp", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
+        asm_push_ins_push(mir_register("esp"), STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
     }
 
     while (node)
     {
-        codegen_generate_expressionable(node, history_begin(EXPRESSION_IN_FUNCTION_CALL_ARGUMENTS));
+        codegen_generate_expressionable(node, HISTORY_BEGIN(EXPRESSION_IN_FUNCTION_CALL_ARGUMENTS));
         node = vector_peek_ptr(entity->func_call_data.arguments);
     }
-    asm_push("call [function_call_%i]", function_call_label_id);
+    asm_ins1(MIR_OPCODE_CALL, mir_memory(function_call_address));
     size_t stack_size = entity->func_call_data.stack_size;
     if (datatype_is_struct_or_union_non_pointer(&entity->dtype))
     {
@@ -1448,20 +1572,20 @@ void codegen_generate_entity_access_for_function_call(struct resolver_result *re
     codegen_stack_add(stack_size);
     if (datatype_is_struct_or_union_non_pointer(&entity->dtype))
     {
-        asm_push("mov ebx, eax");
-        codegen_generate_structure_push(entity, history_begin(0), 0);
+        asm_ins2(MIR_OPCODE_MOV, mir_register("ebx"), mir_register("eax"));
+        codegen_generate_structure_push(entity, HISTORY_BEGIN(0), 0);
     }
     else
     {
-        asm_push_ins_push_with_data("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype = entity->dtype});
+        asm_push_ins_push_with_data(mir_register("eax"), STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype = entity->dtype});
     }
 
     struct resolver_entity *next_entity = resolver_result_entity_next(entity);
     if (next_entity && datatype_is_struct_or_union(&entity->dtype))
     {
         asm_push_ins_pop("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
-        asm_push("mov ebx, eax");
-        asm_push_ins_push("ebx", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
+        asm_ins2(MIR_OPCODE_MOV, mir_register("ebx"), mir_register("eax"));
+        asm_push_ins_push(mir_register("ebx"), STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
     }
 }
 
@@ -1475,14 +1599,14 @@ void codegen_generate_entity_access_for_unary_indirection(struct resolver_result
     int gen_entity_rules = codegen_entity_rules(result->last_entity, history);
     int depth = entity->indirection.depth;
     codegen_apply_unary_access(depth);
-    asm_push_ins_push_with_data("ebx", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", STACK_FRAME_ELEMENT_FLAG_IS_PUSHED_ADDRESS, &(struct stack_frame_data){.dtype = operand_datatype});
+    asm_push_ins_push_with_data(mir_register("ebx"), STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", STACK_FRAME_ELEMENT_FLAG_IS_PUSHED_ADDRESS, &(struct stack_frame_data){.dtype = operand_datatype});
 }
 
 void codegen_generate_entity_access_for_unary_get_address(struct resolver_result *result, struct resolver_entity *entity)
 {
     asm_push_ins_pop("ebx", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
     asm_push("; PUSH ADDRESS &");
-    asm_push_ins_push_with_data("ebx", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype = entity->dtype});
+    asm_push_ins_push_with_data(mir_register("ebx"), STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype = entity->dtype});
 }
 
 void codegen_generate_entity_access_for_entity(struct resolver_result *result, struct resolver_entity *entity, struct history *history)
@@ -1582,11 +1706,11 @@ bool codegen_resolve_node_for_value(struct node *node, struct history *history)
         asm_push_ins_pop("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
         if (result->flags & RESOLVER_RESULT_FLAG_FINAL_INDIRECTION_REQUIRED_FOR_VALUE)
         {
-            asm_push("mov eax, [eax]");
+            asm_ins2(MIR_OPCODE_MOV, mir_register("eax"), mir_memory((struct asm_address){.base = "eax"}));
         }
 
         codegen_reduce_register("eax", datatype_element_size(&dtype), dtype.flags & DATATYPE_FLAG_IS_SIGNED);
-        asm_push_ins_push_with_data("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype = dtype});
+        asm_push_ins_push_with_data(mir_register("eax"), STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype = dtype});
     }
     return true;
 }
@@ -1718,188 +1842,830 @@ bool codegen_can_gen_math(int flags)
     return flags & EXPRESSION_GEN_MATHABLE;
 }
 
-void codegen_gen_cmp(const char *value, const char *set_ins)
+void codegen_gen_cmp(const char *value, const char *cc)
 {
-    asm_push("cmp eax, %s", value);
-    asm_push("%s al", set_ins);
-    asm_push("movzx eax, al");
+    asm_ins2(MIR_OPCODE_CMP, mir_register("eax"), mir_register(value));
+    asm_ins_cc(MIR_OPCODE_SETCC, cc, mir_register("al"));
+    asm_ins2(MIR_OPCODE_MOVZX, mir_register("eax"), mir_register("al"));
 }
 
-void codegen_gen_math_for_value(const char *reg, const char *value, int flags, bool is_signed)
+// Gives k when value is 2^k, -1 otherwise
+int codegen_log2(unsigned int value)
 {
-    if (flags & EXPRESSION_IS_ADDITION)
+    if (value == 0 || (value & (value - 1)))
     {
-        asm_push("add %s, %s", reg, value);
+        return -1;
     }
-    else if (flags & EXPRESSION_IS_SUBTRACTION)
+
+    int k = 0;
+    while (value >>= 1)
     {
-        asm_push("sub %s, %s", reg, value);
+        k++;
     }
-    else if (flags & EXPRESSION_IS_MULTIPLICATION)
+    return k;
+}
+
+// reg = reg * factor for a factor of 3, 5 or 9
+void codegen_gen_lea_multiply(const char *reg, int factor)
+{
+    asm_ins2(MIR_OPCODE_LEA, mir_register(reg), mir_memory((struct asm_address){.base = reg, .index = reg, .scale = factor - 1}));
+}
+
+/**
+ * Multiplies the register by a positive constant with shifts and lea, returns false if that would take more than three instructions.
+ * The scratch register is only used for 2^k+1 and 2^k-1, pass NULL when nothing else may be clobbered.
+ */
+bool codegen_gen_multiply_by_magnitude(const char *reg, unsigned int magnitude, const char *scratch)
+{
+    static const int lea_factors[] = {9, 5, 3};
+    if (magnitude == 1)
     {
-        asm_push("mov ecx, %s", value);
-        if (is_signed)
-        {
-            asm_push("imul ecx");
-        }
-        else
-        {
-            asm_push("mul ecx");
-        }
+        return true;
     }
-    else if (flags & EXPRESSION_IS_DIVISION)
+
+    int k = codegen_log2(magnitude);
+    if (k != -1)
     {
-        asm_push("mov ecx, %s", value);
-        asm_push("cdq");
-        if (is_signed)
+        asm_ins2(MIR_OPCODE_SAL, mir_register(reg), mir_immediate(k));
+        return true;
+    }
+
+    // f * 2^k and f * g * 2^k where f and g are lea factors
+    for (int i = 0; i < 3; i++)
+    {
+        int f = lea_factors[i];
+        if (magnitude % f)
         {
-            asm_push("idiv ecx");
+            continue;
         }
-        else
+
+        unsigned int rest = magnitude / f;
+        int g = 1;
+        for (int j = 0; j < 3 && codegen_log2(rest) == -1; j++)
         {
-            asm_push("div ecx");
+            if (rest % lea_factors[j] == 0 && codegen_log2(rest / lea_factors[j]) != -1)
+            {
+                g = lea_factors[j];
+                rest /= g;
+            }
         }
-    }
-    else if (flags & EXPRESSION_IS_MODULAS)
-    {
-        asm_push("mov ecx, %s", value);
-        asm_push("cdq");
-        if (is_signed)
+
+        k = codegen_log2(rest);
+        if (k == -1)
         {
-            asm_push("idiv ecx");
+            continue;
         }
-        else
+
+        codegen_gen_lea_multiply(reg, f);
+        if (g != 1)
         {
-            asm_push("div ecx");
+            codegen_gen_lea_multiply(reg, g);
         }
-
-        asm_push("mov eax, edx");
-    }
-    else if (flags & EXPRESSION_IS_ABOVE)
-    {
-        codegen_gen_cmp(value, "setg");
+        if (k != 0)
+        {
+            asm_ins2(MIR_OPCODE_SAL, mir_register(reg), mir_immediate(k));
+        }
+        return true;
     }
-    else if (flags & EXPRESSION_IS_BELOW)
+
+    if (!scratch)
     {
-        codegen_gen_cmp(value, "setl");
+        return false;
     }
-    else if (flags & EXPRESSION_IS_EQUAL)
+
+    int opcode = MIR_OPCODE_ADD;
+    k = codegen_log2(magnitude - 1);
+    if (k == -1)
     {
-        codegen_gen_cmp(value, "sete");
+        opcode = MIR_OPCODE_SUB;
+        k = codegen_log2(magnitude + 1);
     }
-    else if (flags & EXPRESSION_IS_ABOVE_OR_EQUAL)
+    if (k == -1)
     {
-        codegen_gen_cmp(value, "setge");
+        return false;
     }
-    else if (flags & EXPRESSION_IS_BELOW_OR_EQUAL)
+
+    asm_ins2(MIR_OPCODE_MOV, mir_register(scratch), mir_register(reg));
+    asm_ins2(MIR_OPCODE_SAL, mir_register(reg), mir_immediate(k));
+    asm_ins2(opcode, mir_register(reg), mir_register(scratch));
+    return true;
+}
+
+/**
+ * reg = reg * value, preferring shifts and lea over imul. The low 32 bits are the same for signed and unsigned
+ * so this serves both, along with pointer and array index scaling.
+ */
+void codegen_gen_multiply_by_constant(const char *reg, int value, const char *scratch)
+{
+    unsigned int magnitude = value < 0 ? 0u - (unsigned int)value : (unsigned int)value;
+    if (value == 0)
     {
-        codegen_gen_cmp(value, "setle");
+        asm_ins2(MIR_OPCODE_MOV, mir_register(reg), mir_immediate(0));
+        return;
     }
-    else if (flags & EXPRESSION_IS_NOT_EQUAL)
+
+    if (!codegen_gen_multiply_by_magnitude(reg, magnitude, scratch))
     {
-        codegen_gen_cmp(value, "setne");
+        asm_ins2(MIR_OPCODE_IMUL, mir_register(reg), mir_immediate(value));
+        return;
     }
-    else if (flags & EXPRESSION_IS_BITSHIFT_LEFT)
+
+    if (value < 0)
     {
-        value = codegen_sub_register(value, DATA_SIZE_BYTE);
-        asm_push("sal %s, %s", reg, value);
+        asm_ins1(MIR_OPCODE_NEG, mir_register(reg));
     }
-    else if (flags & EXPRESSION_IS_BITSHIFT_RIGHT)
+}
+
+/**
+ * Magic number for signed division, see Hacker's Delight 10-1. x / divisor is the high half of multiplier * x
+ * shifted right by shift, corrected by x when the multiplier and divisor disagree in sign.
+ */
+void codegen_signed_division_magic(int divisor, int *multiplier, int *shift)
+{
+    const unsigned int two31 = 0x80000000u;
+    unsigned int ad = divisor < 0 ? 0u - (unsigned int)divisor : (unsigned int)divisor;
+    unsigned int t = two31 + ((unsigned int)divisor >> 31);
+    unsigned int anc = t - 1 - t % ad;
+    unsigned int q1 = two31 / anc;
+    unsigned int r1 = two31 - q1 * anc;
+    unsigned int q2 = two31 / ad;
+    unsigned int r2 = two31 - q2 * ad;
+    unsigned int delta = 0;
+    int p = 31;
+    do
     {
-        value = codegen_sub_register(value, DATA_SIZE_BYTE);
-        if (is_signed)
+        p++;
+        q1 *= 2;
+        r1 *= 2;
+        if (r1 >= anc)
         {
-            asm_push("sar %s, %s", reg, value);
+            q1++;
+            r1 -= anc;
         }
-        else
+        q2 *= 2;
+        r2 *= 2;
+        if (r2 >= ad)
         {
-            asm_push("shr %s, %s", reg, value);
+            q2++;
+            r2 -= ad;
         }
-    }
-    else if (flags & EXPRESSION_IS_BITWISE_AND)
-    {
-        asm_push("and %s, %s", reg, value);
-    }
-    else if (flags & EXPRESSION_IS_BITWISE_OR)
-    {
-        asm_push("or %s, %s", reg, value);
-    }
-    else if (flags & EXPRESSION_IS_BITWISE_XOR)
+        delta = ad - r2;
+    } while (q1 < delta || (q1 == delta && r1 == 0));
+
+    *multiplier = (int)(q2 + 1);
+    if (divisor < 0)
     {
-        asm_push("xor %s, %s", reg, value);
+        *multiplier = -*multiplier;
     }
+    *shift = p - 32;
 }
 
-void codegen_setup_new_logical_expression(struct history *history, struct node *node)
-{
-    int label_index = codegen_label_count();
-    sprintf(history->exp.logical_end_label, ".endc_%i", label_index);
-    sprintf(history->exp.logical_end_label_positive, ".endc_%i_positive", label_index);
-    history->exp.logical_start_op = node->exp.op;
-    history->flags |= EXPRESSION_IN_LOGICAL_EXPRESSION;
-}
-
-void codegen_generate_logical_cmp_and(const char *reg, const char *fail_label)
+/**
+ * Magic number for unsigned division, see Hacker's Delight 10-10. When the multiplier needs 33 bits add is set
+ * and the quotient is ((x - hi) / 2 + hi) >> (shift - 1) rather than hi >> shift.
+ */
+void codegen_unsigned_division_magic(unsigned int divisor, unsigned int *multiplier, int *shift, bool *add)
 {
-    asm_push("cmp %s, 0", reg);
-    asm_push("je %s", fail_label);
-}
+    unsigned int p32 = 0;
+    unsigned int q = 0x7fffffff / divisor;
+    unsigned int r = 0x7fffffff - q * divisor;
+    unsigned int delta = 0;
+    int p = 31;
+    *add = false;
+    do
+    {
+        p++;
+        p32 = p == 32 ? 1 : 2 * p32;
+        if (r + 1 >= divisor - r)
+        {
+            if (q >= 0x7fffffff)
+            {
+                *add = true;
+            }
+            q = 2 * q + 1;
+            r = 2 * r + 1 - divisor;
+        }
+        else
+        {
+            if (q >= 0x80000000)
+            {
+                *add = true;
+            }
+            q = 2 * q;
+            r = 2 * r + 1;
+        }
+        delta = divisor - 1 - r;
+    } while (p < 64 && p32 < delta);
 
-void codegen_generate_logical_cmp_or(const char *reg, const char *equal_label)
-{
-    asm_push("cmp %s, 0", reg);
-    asm_push("jg %s", equal_label);
+    *multiplier = q + 1;
+    *shift = p - 32;
 }
 
-void codegen_generate_logical_cmp(const char *op, const char *fail_label, const char *equal_label)
+/**
+ * Divides eax by a constant without div, leaving the quotient or for EXPRESSION_IS_MODULAS the remainder in eax.
+ * ecx and edx are clobbered. Returns false when the divisor needs a real division.
+ */
+bool codegen_gen_divide_by_constant(int divisor, int flags, bool is_signed)
 {
-    if (S_EQ(op, "&&"))
+    bool modulo = flags & EXPRESSION_IS_MODULAS;
+    if (divisor == 0 || (!is_signed && divisor < 0))
     {
-        codegen_generate_logical_cmp_and("eax", fail_label);
+        return false;
     }
-    else if (S_EQ(op, "||"))
+
+    unsigned int magnitude = divisor < 0 ? 0u - (unsigned int)divisor : (unsigned int)divisor;
+    int k = codegen_log2(magnitude);
+    if (magnitude == 1)
     {
-        codegen_generate_logical_cmp_or("eax", equal_label);
+        if (modulo)
+        {
+            asm_ins2(MIR_OPCODE_MOV, mir_register("eax"), mir_immediate(0));
+        }
+        else if (divisor < 0)
+        {
+            asm_ins1(MIR_OPCODE_NEG, mir_register("eax"));
+        }
+        return true;
     }
-}
-void codegen_generate_end_labels_for_logical_expression(const char *op, const char *end_label, const char *end_label_positive)
-{
-    if (S_EQ(op, "&&"))
+
+    if (k != -1 && !is_signed)
     {
-        asm_push("; && END CLAUSE");
-        asm_push("mov eax, 1");
-        asm_push("jmp %s", end_label_positive);
-        asm_push("%s:", end_label);
-        asm_push("xor eax, eax");
-        asm_push("%s:", end_label_positive);
+        if (modulo)
+        {
+            asm_ins2(MIR_OPCODE_AND, mir_register("eax"), mir_immediate(magnitude - 1));
+        }
+        else
+        {
+            asm_ins2(MIR_OPCODE_SHR, mir_register("eax"), mir_immediate(k));
+        }
+        return true;
     }
-    else if (S_EQ(op, "||"))
+
+    if (k != -1)
     {
-        asm_push("; || END CLAUSE");
-        asm_push("jmp %s", end_label);
-        asm_push("%s:", end_label_positive);
-        asm_push("mov eax, 1");
-        asm_push("%s:", end_label);
-    }
-}
-void codegen_generate_exp_node_for_logical_arithmetic(struct node *node, struct history *history)
+        // Negative dividends are biased by 2^k-1 so the shift rounds towards zero like idiv
+        asm_ins2(MIR_OPCODE_MOV, mir_register("ecx"), mir_register("eax"));
+        asm_ins2(MIR_OPCODE_SAR, mir_register("ecx"), mir_immediate(31));
+        asm_ins2(MIR_OPCODE_SHR, mir_register("ecx"), mir_immediate(32 - k));
+        asm_ins2(MIR_OPCODE_ADD, mir_register("eax"), mir_register("ecx"));
+        if (modulo)
+        {
+            asm_ins2(MIR_OPCODE_AND, mir_register("eax"), mir_immediate(magnitude - 1));
+            asm_ins2(MIR_OPCODE_SUB, mir_register("eax"), mir_register("ecx"));
+            return true;
+        }
+
+        asm_ins2(MIR_OPCODE_SAR, mir_register("eax"), mir_immediate(k));
+        if (divisor < 0)
+        {
+            asm_ins1(MIR_OPCODE_NEG, mir_register("eax"));
+        }
+        return true;
+    }
+
+    // The dividend stays in ecx for the corrections and the remainder
+    asm_ins2(MIR_OPCODE_MOV, mir_register("ecx"), mir_register("eax"));
+    if (is_signed)
+    {
+        int multiplier = 0;
+        int shift = 0;
+        codegen_signed_division_magic(divisor, &multiplier, &shift);
+        asm_ins2(MIR_OPCODE_MOV, mir_register("eax"), mir_immediate(multiplier));
+        asm_ins1(MIR_OPCODE_IMUL, mir_register("ecx"));
+        if (divisor > 0 && multiplier < 0)
+        {
+            asm_ins2(MIR_OPCODE_ADD, mir_register("edx"), mir_register("ecx"));
+        }
+        else if (divisor < 0 && multiplier > 0)
+        {
+            asm_ins2(MIR_OPCODE_SUB, mir_register("edx"), mir_register("ecx"));
+        }
+        if (shift != 0)
+        {
+            asm_ins2(MIR_OPCODE_SAR, mir_register("edx"), mir_immediate(shift));
+        }
+
+        // Add one for negative quotients so they round towards zero
+        asm_ins2(MIR_OPCODE_MOV, mir_register("eax"), mir_register("edx"));
+        asm_ins2(MIR_OPCODE_SHR, mir_register("eax"), mir_immediate(31));
+        asm_ins2(MIR_OPCODE_ADD, mir_register("eax"), mir_register("edx"));
+    }
+    else
+    {
+        unsigned int multiplier = 0;
+        int shift = 0;
+        bool add = false;
+        codegen_unsigned_division_magic(magnitude, &multiplier, &shift, &add);
+        asm_ins2(MIR_OPCODE_MOV, mir_register("eax"), mir_immediate((int)multiplier));
+        asm_ins1(MIR_OPCODE_MUL, mir_register("ecx"));
+        if (add)
+        {
+            asm_ins2(MIR_OPCODE_MOV, mir_register("eax"), mir_register("ecx"));
+            asm_ins2(MIR_OPCODE_SUB, mir_register("eax"), mir_register("edx"));
+            asm_ins2(MIR_OPCODE_SHR, mir_register("eax"), mir_immediate(1));
+            asm_ins2(MIR_OPCODE_ADD, mir_register("eax"), mir_register("edx"));
+            shift--;
+        }
+        else
+        {
+            asm_ins2(MIR_OPCODE_MOV, mir_register("eax"), mir_register("edx"));
+        }
+        if (shift != 0)
+        {
+            asm_ins2(MIR_OPCODE_SHR, mir_register("eax"), mir_immediate(shift));
+        }
+    }
+
+    if (modulo)
+    {
+        // x - x / divisor * divisor
+        codegen_gen_multiply_by_constant("eax", divisor, "edx");
+        asm_ins2(MIR_OPCODE_SUB, mir_register("ecx"), mir_register("eax"));
+        asm_ins2(MIR_OPCODE_MOV, mir_register("eax"), mir_register("ecx"));
+    }
+    return true;
+}
+
+/**
+ * Multiplication, division and modulo of eax by a constant. ecx and edx may be clobbered.
+ * Returns false if nothing cheaper than codegen_gen_math_for_value applies.
+ */
+bool codegen_gen_math_for_constant(int value, int flags, bool is_signed)
+{
+    if (flags & EXPRESSION_IS_MULTIPLICATION)
+    {
+        codegen_gen_multiply_by_constant("eax", value, "ecx");
+        return true;
+    }
+
+    if (flags & (EXPRESSION_IS_DIVISION | EXPRESSION_IS_MODULAS))
+    {
+        return codegen_gen_divide_by_constant(value, flags, is_signed);
+    }
+
+    return false;
+}
+
+void codegen_gen_math_for_value(const char *reg, const char *value, int flags, bool is_signed)
+{
+    if (flags & EXPRESSION_IS_ADDITION)
+    {
+        asm_ins2(MIR_OPCODE_ADD, mir_register(reg), mir_register(value));
+    }
+    else if (flags & EXPRESSION_IS_SUBTRACTION)
+    {
+        asm_ins2(MIR_OPCODE_SUB, mir_register(reg), mir_register(value));
+    }
+    else if (flags & EXPRESSION_IS_MULTIPLICATION)
+    {
+        asm_ins2(MIR_OPCODE_MOV, mir_register("ecx"), mir_register(value));
+        if (is_signed)
+        {
+            asm_ins1(MIR_OPCODE_IMUL, mir_register("ecx"));
+        }
+        else
+        {
+            asm_ins1(MIR_OPCODE_MUL, mir_register("ecx"));
+        }
+    }
+    else if (flags & EXPRESSION_IS_DIVISION)
+    {
+        asm_ins2(MIR_OPCODE_MOV, mir_register("ecx"), mir_register(value));
+        asm_ins0(MIR_OPCODE_CDQ);
+        if (is_signed)
+        {
+            asm_ins1(MIR_OPCODE_IDIV, mir_register("ecx"));
+        }
+        else
+        {
+            asm_ins1(MIR_OPCODE_DIV, mir_register("ecx"));
+        }
+    }
+    else if (flags & EXPRESSION_IS_MODULAS)
+    {
+        asm_ins2(MIR_OPCODE_MOV, mir_register("ecx"), mir_register(value));
+        asm_ins0(MIR_OPCODE_CDQ);
+        if (is_signed)
+        {
+            asm_ins1(MIR_OPCODE_IDIV, mir_register("ecx"));
+        }
+        else
+        {
+            asm_ins1(MIR_OPCODE_DIV, mir_register("ecx"));
+        }
+
+        asm_ins2(MIR_OPCODE_MOV, mir_register("eax"), mir_register("edx"));
+    }
+    else if (flags & EXPRESSION_IS_ABOVE)
+    {
+        codegen_gen_cmp(value, "g");
+    }
+    else if (flags & EXPRESSION_IS_BELOW)
+    {
+        codegen_gen_cmp(value, "l");
+    }
+    else if (flags & EXPRESSION_IS_EQUAL)
+    {
+        codegen_gen_cmp(value, "e");
+    }
+    else if (flags & EXPRESSION_IS_ABOVE_OR_EQUAL)
+    {
+        codegen_gen_cmp(value, "ge");
+    }
+    else if (flags & EXPRESSION_IS_BELOW_OR_EQUAL)
+    {
+        codegen_gen_cmp(value, "le");
+    }
+    else if (flags & EXPRESSION_IS_NOT_EQUAL)
+    {
+        codegen_gen_cmp(value, "ne");
+    }
+    else if (flags & EXPRESSION_IS_BITSHIFT_LEFT)
+    {
+        value = codegen_sub_register(value, DATA_SIZE_BYTE);
+        asm_ins2(MIR_OPCODE_SAL, mir_register(reg), mir_register(value));
+    }
+    else if (flags & EXPRESSION_IS_BITSHIFT_RIGHT)
+    {
+        value = codegen_sub_register(value, DATA_SIZE_BYTE);
+        if (is_signed)
+        {
+            asm_ins2(MIR_OPCODE_SAR, mir_register(reg), mir_register(value));
+        }
+        else
+        {
+            asm_ins2(MIR_OPCODE_SHR, mir_register(reg), mir_register(value));
+        }
+    }
+    else if (flags & EXPRESSION_IS_BITWISE_AND)
+    {
+        asm_ins2(MIR_OPCODE_AND, mir_register(reg), mir_register(value));
+    }
+    else if (flags & EXPRESSION_IS_BITWISE_OR)
+    {
+        asm_ins2(MIR_OPCODE_OR, mir_register(reg), mir_register(value));
+    }
+    else if (flags & EXPRESSION_IS_BITWISE_XOR)
+    {
+        asm_ins2(MIR_OPCODE_XOR, mir_register(reg), mir_register(value));
+    }
+}
+
+// Relational operators and the condition codes that jump when they hold and when they do not
+static const char *codegen_branch_conditions[][3] = {
+    {"==", "e", "ne"},
+    {"!=", "ne", "e"},
+    {"<", "l", "ge"},
+    {">=", "ge", "l"},
+    {">", "g", "le"},
+    {"<=", "le", "g"},
+    {NULL, NULL, NULL}};
+
+const char *codegen_branch_condition(const char *op, bool jump_if)
+{
+    for (int i = 0; codegen_branch_conditions[i][0]; i++)
+    {
+        if (S_EQ(codegen_branch_conditions[i][0], op))
+        {
+            return codegen_branch_conditions[i][jump_if ? 1 : 2];
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Compares the operands of a relational expression and jumps on the result, the right operand is used in place when it is a leaf
+ */
+void codegen_generate_branch_for_relational(struct node *node, bool jump_if, const char *label)
+{
+    struct mir_operand left_operand;
+    struct mir_operand right_operand;
+    struct datatype left_dtype;
+    struct datatype right_dtype;
+    struct resolver_entity *left_entity = NULL;
+    struct resolver_entity *right_entity = NULL;
+    if (codegen_leaf_operand(node->exp.left, 0, &left_operand, &left_dtype, &left_entity) && left_operand.type == MIR_OPERAND_REGISTER &&
+        codegen_leaf_operand(node->exp.right, 0, &right_operand, &right_dtype, &right_entity))
+    {
+        // A local kept in a register is compared in place
+        codegen_acknowledge_leaf(left_entity);
+        codegen_acknowledge_leaf(right_entity);
+        asm_ins2(MIR_OPCODE_CMP, left_operand, right_operand);
+        asm_ins_cc(MIR_OPCODE_JCC, codegen_branch_condition(node->exp.op, jump_if), mir_label("%s", label));
+        return;
+    }
+
+    codegen_generate_expressionable(node->exp.left, HISTORY_BEGIN(0));
+    if (codegen_leaf_operand(node->exp.right, 0, &right_operand, &right_dtype, &right_entity))
+    {
+        asm_push_ins_pop("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
+        codegen_acknowledge_leaf(right_entity);
+    }
+    else
+    {
+        codegen_generate_expressionable(node->exp.right, HISTORY_BEGIN(0));
+        asm_push_ins_pop("ecx", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
+        asm_push_ins_pop("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
+        right_operand = mir_register("ecx");
+    }
+
+    asm_ins2(MIR_OPCODE_CMP, mir_register("eax"), right_operand);
+    asm_ins_cc(MIR_OPCODE_JCC, codegen_branch_condition(node->exp.op, jump_if), mir_label("%s", label));
+}
+
+/**
+ * Generates the condition in a branch context, jumping to the label when its truth equals jump_if and falling through otherwise.
+ * Relational operators become a cmp and jcc without materializing a boolean, && and || short circuit with direct jumps.
+ */
+void codegen_generate_branch(struct node *node, bool jump_if, const char *label)
 {
-    bool start_of_logical_exp = !(history->flags & EXPRESSION_IN_LOGICAL_EXPRESSION);
-    if (start_of_logical_exp)
+    if (node->type == NODE_TYPE_EXPRESSION_PARENTHESES)
     {
-        codegen_setup_new_logical_expression(history, node);
+        codegen_generate_branch(node->parenthesis.exp, jump_if, label);
+        return;
     }
-    codegen_generate_expressionable(node->exp.left, history_down(history, history->flags | EXPRESSION_IN_LOGICAL_EXPRESSION));
+
+    if (node->type == NODE_TYPE_UNARY && S_EQ(node->unary.op, "!"))
+    {
+        codegen_generate_branch(node->unary.operand, !jump_if, label);
+        return;
+    }
+
+    if (node->type == NODE_TYPE_NUMBER)
+    {
+        if ((node->llnum != 0) == jump_if)
+        {
+            asm_ins1(MIR_OPCODE_JMP, mir_label("%s", label));
+        }
+        return;
+    }
+
+    if (is_logical_node(node))
+    {
+        // a && b jumps on false and a || b on true as soon as the left operand decides it
+        bool short_circuit_on = !S_EQ(node->exp.op, "&&");
+        if (short_circuit_on == jump_if)
+        {
+            codegen_generate_branch(node->exp.left, jump_if, label);
+            codegen_generate_branch(node->exp.right, jump_if, label);
+            return;
+        }
+
+        char skip_label[32];
+        sprintf(skip_label, ".branch_skip_%i", codegen_label_count());
+        codegen_generate_branch(node->exp.left, short_circuit_on, skip_label);
+        codegen_generate_branch(node->exp.right, jump_if, label);
+        asm_label("%s", skip_label);
+        return;
+    }
+
+    if (node->type == NODE_TYPE_EXPRESSION && codegen_branch_condition(node->exp.op, jump_if))
+    {
+        codegen_generate_branch_for_relational(node, jump_if, label);
+        return;
+    }
+
+    codegen_generate_expressionable(node, HISTORY_BEGIN(0));
     asm_push_ins_pop("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
-    codegen_generate_logical_cmp(node->exp.op, history->exp.logical_end_label, history->exp.logical_end_label_positive);
-    codegen_generate_expressionable(node->exp.right, history_down(history, history->flags | EXPRESSION_IN_LOGICAL_EXPRESSION));
-    if (!is_logical_node(node->exp.right))
+    asm_ins2(MIR_OPCODE_CMP, mir_register("eax"), mir_immediate(0));
+    asm_ins_cc(MIR_OPCODE_JCC, jump_if ? "ne" : "e", mir_label("%s", label));
+}
+
+/**
+ * && and || as values, the branches decide between one and zero
+ */
+void codegen_generate_exp_node_for_logical_arithmetic(struct node *node, struct history *history)
+{
+    int false_label_id = codegen_label_count();
+    int end_label_id = codegen_label_count();
+    char false_label[32];
+    sprintf(false_label, ".logical_false_%i", false_label_id);
+    codegen_generate_branch(node, false, false_label);
+    asm_ins2(MIR_OPCODE_MOV, mir_register("eax"), mir_immediate(1));
+    asm_ins1(MIR_OPCODE_JMP, mir_label(".logical_end_%i", end_label_id));
+    asm_label("%s", false_label);
+    asm_ins2(MIR_OPCODE_XOR, mir_register("eax"), mir_register("eax"));
+    asm_label(".logical_end_%i", end_label_id);
+    asm_push_ins_push(mir_register("eax"), STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
+}
+
+bool codegen_operator_is_commutative(int op_flags)
+{
+    return op_flags & (EXPRESSION_IS_ADDITION | EXPRESSION_IS_MULTIPLICATION | EXPRESSION_IS_EQUAL | EXPRESSION_IS_NOT_EQUAL |
+                       EXPRESSION_IS_BITWISE_AND | EXPRESSION_IS_BITWISE_OR | EXPRESSION_IS_BITWISE_XOR);
+}
+
+bool codegen_is_arithmetic_node(struct node *node)
+{
+    return node->type == NODE_TYPE_EXPRESSION && !is_logical_operator(node->exp.op) && !is_node_assignment(node) &&
+           codegen_can_gen_math(codegen_set_flag_for_operator(node->exp.op));
+}
+
+/**
+ * Sethi-Ullman numbering, the number of registers needed to evaluate the node without touching the stack.
+ * Anything we cannot load straight into a register needs more than we have.
+ */
+int codegen_register_need(struct node *node)
+{
+    switch (node->type)
     {
+    case NODE_TYPE_NUMBER:
+    case NODE_TYPE_IDENTIFIER:
+        return 1;
+
+    case NODE_TYPE_EXPRESSION_PARENTHESES:
+        return codegen_register_need(node->parenthesis.exp);
+
+    case NODE_TYPE_EXPRESSION:
+        if (codegen_is_arithmetic_node(node))
+        {
+            int left_need = codegen_register_need(node->exp.left);
+            int right_need = codegen_register_need(node->exp.right);
+            return left_need == right_need ? left_need + 1 : (left_need > right_need ? left_need : right_need);
+        }
+        break;
+    }
+
+    return CODEGEN_ARITHMETIC_REGISTERS + 1;
+}
+
+/**
+ * Gives the node as a single instruction operand if it is a number or a plain dword variable, i.e 5, [ebp-4], esi
+ */
+bool codegen_leaf_operand(struct node *node, int flags, struct mir_operand *out, struct datatype *dtype_out, struct resolver_entity **entity_out)
+{
+    *entity_out = NULL;
+    if (node->type == NODE_TYPE_NUMBER)
+    {
+        *out = mir_immediate((int)node->llnum);
+        *dtype_out = datatype_for_numeric();
+        return true;
+    }
+
+    if (node->type != NODE_TYPE_IDENTIFIER || flags & (EXPRESSION_GET_ADDRESS | EXPRESSION_INDIRECTION))
+    {
+        return false;
+    }
+
+    struct resolver_result *result = resolver_follow(current_process->resolver, node);
+    if (!resolver_result_ok(result))
+    {
+        return false;
+    }
+
+    struct resolver_entity *entity = resolver_result_entity(result);
+    if (entity->type != RESOLVER_ENTITY_TYPE_VARIABLE || entity->dtype.flags & DATATYPE_FLAG_IS_ARRAY ||
+        datatype_is_struct_or_union_non_pointer(&entity->dtype) || datatype_element_size(&entity->dtype) != DATA_SIZE_DWORD)
+    {
+        return false;
+    }
+
+    *out = mir_memory(codegen_entity_private(entity)->address);
+    *dtype_out = entity->dtype;
+    *entity_out = entity;
+    return true;
+}
+
+// Leaves skip codegen_generate_identifier so they must acknowledge the entity themselves
+void codegen_acknowledge_leaf(struct resolver_entity *entity)
+{
+    if (entity)
+    {
+        codegen_response_acknowledge(&(struct response){.flags = RESPONSE_FLAG_RESOLVED_ENTITY, .data.resolved_entity = entity});
+    }
+}
+
+// The instruction for operators that take an immediate right operand as it is, -1 for the rest
+int codegen_immediate_math_opcode(int flags)
+{
+    if (flags & EXPRESSION_IS_ADDITION)
+    {
+        return MIR_OPCODE_ADD;
+    }
+    else if (flags & EXPRESSION_IS_SUBTRACTION)
+    {
+        return MIR_OPCODE_SUB;
+    }
+    else if (flags & EXPRESSION_IS_BITWISE_AND)
+    {
+        return MIR_OPCODE_AND;
+    }
+    else if (flags & EXPRESSION_IS_BITWISE_OR)
+    {
+        return MIR_OPCODE_OR;
+    }
+    else if (flags & EXPRESSION_IS_BITWISE_XOR)
+    {
+        return MIR_OPCODE_XOR;
+    }
+
+    return -1;
+}
+
+/**
+ * Evaluates the heavier operand first so the other one can be loaded straight into ecx rather than going through the stack.
+ * Returns false if neither operand is simple enough, the caller then falls back to pushing both.
+ */
+bool codegen_generate_exp_node_for_arithmetic_in_registers(struct node *node, int op_flags, struct history *history)
+{
+    int flags = history->flags;
+    struct node *first = node->exp.left;
+    struct node *second = node->exp.right;
+    bool swapped = false;
+    // Constants go second so they can be strength reduced
+    if (codegen_operator_is_commutative(op_flags) &&
+        (codegen_register_need(second) > codegen_register_need(first) || (first->type == NODE_TYPE_NUMBER && second->type != NODE_TYPE_NUMBER)))
+    {
+        first = node->exp.right;
+        second = node->exp.left;
+        swapped = true;
+    }
+
+    if (codegen_register_need(second) != 1)
+    {
+        return false;
+    }
+
+    struct mir_operand first_operand;
+    struct mir_operand second_operand;
+    struct datatype first_dtype;
+    struct datatype second_dtype;
+    struct resolver_entity *first_entity = NULL;
+    struct resolver_entity *second_entity = NULL;
+    if (!codegen_leaf_operand(second, flags, &second_operand, &second_dtype, &second_entity))
+    {
+        return false;
+    }
+
+    // Responses are acknowledged in source order so the right operand still has the final say
+    if (swapped)
+    {
+        codegen_acknowledge_leaf(second_entity);
+    }
+
+    if (codegen_leaf_operand(first, flags, &first_operand, &first_dtype, &first_entity))
+    {
+        codegen_acknowledge_leaf(first_entity);
+        asm_ins2(MIR_OPCODE_MOV, mir_register("eax"), first_operand);
+    }
+    else
+    {
+        codegen_generate_expressionable(first, HISTORY_DOWN(history, flags));
+        first_dtype = datatype_for_numeric();
+        asm_datatype_back(&first_dtype);
         asm_push_ins_pop("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
-        codegen_generate_logical_cmp(node->exp.op, history->exp.logical_end_label, history->exp.logical_end_label_positive);
-        codegen_generate_end_labels_for_logical_expression(node->exp.op, history->exp.logical_end_label, history->exp.logical_end_label_positive);
-        asm_push_ins_push("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
     }
+
+    if (!swapped)
+    {
+        codegen_acknowledge_leaf(second_entity);
+    }
+
+    struct datatype *left_dtype = swapped ? &second_dtype : &first_dtype;
+    struct datatype *right_dtype = swapped ? &first_dtype : &second_dtype;
+    struct datatype last_dtype = *right_dtype;
+    if (last_dtype.flags & DATATYPE_FLAG_IS_LITERAL)
+    {
+        last_dtype = *left_dtype;
+    }
+
+    struct datatype *pointer_datatype = datatype_thats_a_pointer(left_dtype, right_dtype);
+    if (!pointer_datatype && second_operand.type == MIR_OPERAND_IMMEDIATE &&
+        codegen_gen_math_for_constant(second_operand.imm, op_flags, last_dtype.flags & DATATYPE_FLAG_IS_SIGNED))
+    {
+        asm_push_ins_push_with_data(mir_register("eax"), STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype = last_dtype});
+        return true;
+    }
+
+    // A local kept in a register is used in place, shifts need their count in cl though
+    if (!pointer_datatype && second_operand.type == MIR_OPERAND_REGISTER &&
+        !(op_flags & (EXPRESSION_IS_BITSHIFT_LEFT | EXPRESSION_IS_BITSHIFT_RIGHT)))
+    {
+        codegen_gen_math_for_value("eax", second_operand.reg, op_flags, last_dtype.flags & DATATYPE_FLAG_IS_SIGNED);
+        asm_push_ins_push_with_data(mir_register("eax"), STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype = last_dtype});
+        return true;
+    }
+
+    if (!pointer_datatype && second_operand.type == MIR_OPERAND_IMMEDIATE && codegen_immediate_math_opcode(op_flags) != -1)
+    {
+        asm_ins2(codegen_immediate_math_opcode(op_flags), mir_register("eax"), second_operand);
+        asm_push_ins_push_with_data(mir_register("eax"), STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype = last_dtype});
+        return true;
+    }
+
+    asm_ins2(MIR_OPCODE_MOV, mir_register("ecx"), second_operand);
+    if (pointer_datatype && datatype_size(datatype_pointer_reduce(pointer_datatype, 1)) > DATA_SIZE_BYTE)
+    {
+        // Scale whichever operand is not the pointer, the left operand lives in ecx when we swapped
+        bool scale_left = pointer_datatype == right_dtype;
+        const char *reg = scale_left != swapped ? "eax" : "ecx";
+        codegen_gen_multiply_by_constant(reg, datatype_size(datatype_pointer_reduce(pointer_datatype, 1)), NULL);
+    }
+
+    codegen_gen_math_for_value("eax", "ecx", op_flags, last_dtype.flags & DATATYPE_FLAG_IS_SIGNED);
+    asm_push_ins_push_with_data(mir_register("eax"), STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype = last_dtype});
+    return true;
 }
 
 void codegen_generate_exp_node_for_arithmetic(struct node *node, struct history *history)
@@ -1913,11 +2679,17 @@ void codegen_generate_exp_node_for_arithmetic(struct node *node, struct history
         return;
     }
 
+    if (codegen_can_gen_math(codegen_set_flag_for_operator(node->exp.op)) &&
+        codegen_generate_exp_node_for_arithmetic_in_registers(node, codegen_set_flag_for_operator(node->exp.op), history))
+    {
+        return;
+    }
+
     struct node *left_node = node->exp.left;
     struct node *right_node = node->exp.right;
     int op_flags = codegen_set_flag_for_operator(node->exp.op);
-    codegen_generate_expressionable(left_node, history_down(history, flags));
-    codegen_generate_expressionable(right_node, history_down(history, flags));
+    codegen_generate_expressionable(left_node, HISTORY_DOWN(history, flags));
+    codegen_generate_expressionable(right_node, HISTORY_DOWN(history, flags));
     struct datatype last_dtype = datatype_for_numeric();
     asm_datatype_back(&last_dtype);
     if (codegen_can_gen_math(op_flags))
@@ -1941,13 +2713,13 @@ void codegen_generate_exp_node_for_arithmetic(struct node *node, struct history
             {
                 reg = "eax";
             }
-            asm_push("imul %s, %i", reg, datatype_size(datatype_pointer_reduce(pointer_datatype, 1)));
+            codegen_gen_multiply_by_constant(reg, datatype_size(datatype_pointer_reduce(pointer_datatype, 1)), NULL);
         }
 
         codegen_gen_math_for_value("eax", "ecx", op_flags, last_dtype.flags & DATATYPE_FLAG_IS_SIGNED);
     }
 
-    asm_push_ins_push_with_data("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype = last_dtype});
+    asm_push_ins_push_with_data(mir_register("eax"), STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype = last_dtype});
 }
 
 int codegen_remove_uninheritable_flags(int flags)
@@ -1962,6 +2734,12 @@ void codegen_generate_exp_node(struct node *node, struct history *history)
         return;
     }
 
+    if (S_EQ(node->exp.op, "?"))
+    {
+        codegen_generate_tenary(node, history);
+        return;
+    }
+
     // Can we locate a variable for a given expression?
     if (codegen_resolve_node_for_value(node, history))
     {
@@ -1969,7 +2747,7 @@ void codegen_generate_exp_node(struct node *node, struct history *history)
     }
 
     int additional_flags = get_additional_flags(history->flags, node);
-    codegen_generate_exp_node_for_arithmetic(node, history_down(history, codegen_remove_uninheritable_flags(history->flags) | additional_flags));
+    codegen_generate_exp_node_for_arithmetic(node, HISTORY_DOWN(history, codegen_remove_uninheritable_flags(history->flags) | additional_flags));
 }
 
 void codegen_discard_unused_stack()
@@ -1985,24 +2763,27 @@ void codegen_discard_unused_stack()
             break;
         }
 
-        stack_adjustment += DATA_SIZE_DWORD;
+        stack_adjustment += element->total_slots * STACK_PUSH_SIZE;
         element = asm_stack_peek();
     }
 
     codegen_stack_add(stack_adjustment);
 }
 
-void codegen_plus_or_minus_string_for_value(char *out, int val, size_t len)
+const char *codegen_address_string(struct asm_address *address, char *out, size_t len)
 {
-    memset(out, 0, len);
-    if (val < 0)
+    int written = snprintf(out, len, "%s", address->base);
+    if (address->index)
     {
-        sprintf(out, "%i", val);
+        written += snprintf(out + written, len - written, "+%s*%i", address->index, address->scale);
     }
-    else
+
+    // A displacement of zero is left out, i.e [ebx] rather than [ebx+0]
+    if (address->displacement != 0)
     {
-        sprintf(out, "+%i", val);
+        snprintf(out + written, len - written, "%+i", address->displacement);
     }
+    return out;
 }
 
 void codegen_generate_structure_push(struct resolver_entity *entity, struct history *history, int start_pos)
@@ -2012,10 +2793,8 @@ void codegen_generate_structure_push(struct resolver_entity *entity, struct hist
     int pushes = structure_size / DATA_SIZE_DWORD;
     for (int i = pushes - 1; i >= start_pos; i--)
     {
-        char fmt[10];
         int chunk_offset = (i * DATA_SIZE_DWORD);
-        codegen_plus_or_minus_string_for_value(fmt, chunk_offset, sizeof(fmt));
-        asm_push_ins_push_with_data("dword [%s%s]", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype = entity->dtype}, "ebx", fmt);
+        asm_push_ins_push_with_data(mir_sized("dword", mir_memory((struct asm_address){.base = "ebx", .displacement = chunk_offset})), STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value", 0, &(struct stack_frame_data){.dtype = entity->dtype});
     }
     asm_push("; END STRUCTURE PUSH");
     codegen_response_acknowledge(RESPONSE_SET(.flags = RESPONSE_FLAG_PUSHED_STRUCTURE));
@@ -2024,20 +2803,29 @@ void codegen_generate_structure_push(struct resolver_entity *entity, struct hist
 void codegen_generate_statement_return_exp(struct node *node)
 {
     codegen_response_expect();
-    codegen_generate_expressionable(node->stmt.return_stmt.exp, history_begin(IS_STATEMENT_RETURN));
+    codegen_generate_expressionable(node->stmt.return_stmt.exp, HISTORY_BEGIN(IS_STATEMENT_RETURN));
     struct datatype dtype;
     assert(asm_datatype_back(&dtype));
     if (datatype_is_struct_or_union_non_pointer(&dtype))
     {
-        asm_push("mov edx, [ebp+8]");
-        codegen_generate_move_struct(&dtype, "edx", 0);
-        asm_push("mov eax, [ebp+8]");
+        asm_ins2(MIR_OPCODE_MOV, mir_register("edx"), mir_memory((struct asm_address){.base = "ebp", .displacement = 8}));
+        codegen_generate_move_struct(&dtype, &(struct asm_address){.base = "edx"}, 0);
+        asm_ins2(MIR_OPCODE_MOV, mir_register("eax"), mir_memory((struct asm_address){.base = "ebp", .displacement = 8}));
         return;
     }
 
     asm_push_ins_pop("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
 }
 
+void codegen_restore_saved_registers_no_stack_frame_restore(struct node *func_node)
+{
+    struct vector *saved_registers = func_node->func->saved_registers;
+    for (int i = vector_count(saved_registers) - 1; i >= 0; i--)
+    {
+        asm_ins1(MIR_OPCODE_POP, mir_register(*(const char **)vector_at(saved_registers, i)));
+    }
+}
+
 void codegen_generate_statement_return(struct node *node)
 {
     if (node->stmt.return_stmt.exp)
@@ -2045,15 +2833,16 @@ void codegen_generate_statement_return(struct node *node)
         codegen_generate_statement_return_exp(node);
     }
 
+    codegen_restore_saved_registers_no_stack_frame_restore(node->binded.function);
     codegen_stack_add_no_compile_time_stack_frame_restore(C_ALIGN(function_node_stack_size(node->binded.function)));
     asm_pop_ebp_no_stack_frame_restore();
-    asm_push("ret");
+    asm_ins0(MIR_OPCODE_RET);
 }
 void _codegen_generate_if_stmt(struct node *node, int end_label_id);
 
 void codegen_generate_else_stmt(struct node *node)
 {
-    codegen_generate_body(node->stmt.else_stmt.body_node, history_begin(0));
+    codegen_generate_body(node->stmt.else_stmt.body_node, HISTORY_BEGIN(0));
 }
 
 void codegen_generate_else_or_else_if(struct node *node, int end_label_id)
@@ -2074,13 +2863,12 @@ void codegen_generate_else_or_else_if(struct node *node, int end_label_id)
 void _codegen_generate_if_stmt(struct node *node, int end_label_id)
 {
     int if_label_id = codegen_label_count();
-    codegen_generate_expressionable(node->stmt.if_stmt.cond_node, history_begin(0));
-    asm_push_ins_pop("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
-    asm_push("cmp eax, 0");
-    asm_push("je .if_%i", if_label_id);
-    codegen_generate_body(node->stmt.if_stmt.body_node, history_begin(IS_ALONE_STATEMENT));
-    asm_push("jmp .if_end_%i", end_label_id);
-    asm_push(".if_%i:", if_label_id);
+    char if_label[32];
+    sprintf(if_label, ".if_%i", if_label_id);
+    codegen_generate_branch(node->stmt.if_stmt.cond_node, false, if_label);
+    codegen_generate_body(node->stmt.if_stmt.body_node, HISTORY_BEGIN(IS_ALONE_STATEMENT));
+    asm_ins1(MIR_OPCODE_JMP, mir_label(".if_end_%i", end_label_id));
+    asm_label(".if_%i", if_label_id);
 
     if (node->stmt.if_stmt.next)
     {
@@ -2092,7 +2880,7 @@ void codegen_generate_if_stmt(struct node *node)
 {
     int end_label_id = codegen_label_count();
     _codegen_generate_if_stmt(node, end_label_id);
-    asm_push(".if_end_%i:", end_label_id);
+    asm_label(".if_end_%i", end_label_id);
 }
 
 void codegen_generate_while_stmt(struct node *node)
@@ -2100,14 +2888,13 @@ void codegen_generate_while_stmt(struct node *node)
     codegen_begin_entry_exit_point();
     int while_start_id = codegen_label_count();
     int while_end_id = codegen_label_count();
-    asm_push(".while_start_%i:", while_start_id);
-    codegen_generate_expressionable(node->stmt.while_stmt.exp_node, history_begin(0));
-    asm_push_ins_pop("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
-    asm_push("cmp eax, 0");
-    asm_push("je .while_end_%i", while_end_id);
-    codegen_generate_body(node->stmt.while_stmt.body_node, history_begin(IS_ALONE_STATEMENT));
-    asm_push("jmp .while_start_%i", while_start_id);
-    asm_push(".while_end_%i:", while_end_id);
+    asm_label(".while_start_%i", while_start_id);
+    char while_end_label[32];
+    sprintf(while_end_label, ".while_end_%i", while_end_id);
+    codegen_generate_branch(node->stmt.while_stmt.exp_node, false, while_end_label);
+    codegen_generate_body(node->stmt.while_stmt.body_node, HISTORY_BEGIN(IS_ALONE_STATEMENT));
+    asm_ins1(MIR_OPCODE_JMP, mir_label(".while_start_%i", while_start_id));
+    asm_label(".while_end_%i", while_end_id);
     codegen_end_entry_exit_point();
 }
 
@@ -2115,12 +2902,11 @@ void codegen_generate_do_while_stmt(struct node *node)
 {
     codegen_begin_entry_exit_point();
     int do_while_start_id = codegen_label_count();
-    asm_push(".do_while_start_%i:", do_while_start_id);
-    codegen_generate_body(node->stmt.do_while_stmt.body_node, history_begin(IS_ALONE_STATEMENT));
-    codegen_generate_expressionable(node->stmt.do_while_stmt.exp_node, history_begin(0));
-    asm_push_ins_pop("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
-    asm_push("cmp eax, 0");
-    asm_push("jne .do_while_start_%i", do_while_start_id);
+    asm_label(".do_while_start_%i", do_while_start_id);
+    codegen_generate_body(node->stmt.do_while_stmt.body_node, HISTORY_BEGIN(IS_ALONE_STATEMENT));
+    char do_while_start_label[32];
+    sprintf(do_while_start_label, ".do_while_start_%i", do_while_start_id);
+    codegen_generate_branch(node->stmt.do_while_stmt.exp_node, true, do_while_start_label);
     codegen_end_entry_exit_point();
 }
 
@@ -2131,39 +2917,38 @@ void codegen_generate_for_stmt(struct node *node)
     int for_loop_end_id = codegen_label_count();
     if (for_stmt->init_node)
     {
-        codegen_generate_expressionable(for_stmt->init_node, history_begin(0));
+        codegen_generate_expressionable(for_stmt->init_node, HISTORY_BEGIN(0));
         asm_push_ins_pop_or_ignore("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
     }
 
-    asm_push("jmp .for_loop%i", for_loop_start_id);
+    asm_ins1(MIR_OPCODE_JMP, mir_label(".for_loop%i", for_loop_start_id));
     codegen_begin_entry_exit_point();
     if (for_stmt->loop_node)
     {
-        codegen_generate_expressionable(for_stmt->loop_node, history_begin(0));
+        codegen_generate_expressionable(for_stmt->loop_node, HISTORY_BEGIN(0));
         asm_push_ins_pop_or_ignore("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
     }
-    asm_push(".for_loop%i:", for_loop_start_id);
+    asm_label(".for_loop%i", for_loop_start_id);
     if (for_stmt->cond_node)
     {
-        codegen_generate_expressionable(for_stmt->cond_node, history_begin(0));
-        asm_push_ins_pop_or_ignore("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
-        asm_push("cmp eax, 0");
-        asm_push("je .for_loop_end%i", for_loop_end_id);
+        char for_loop_end_label[32];
+        sprintf(for_loop_end_label, ".for_loop_end%i", for_loop_end_id);
+        codegen_generate_branch(for_stmt->cond_node, false, for_loop_end_label);
     }
 
     if (for_stmt->body_node)
     {
-        codegen_generate_body(for_stmt->body_node, history_begin(IS_ALONE_STATEMENT));
+        codegen_generate_body(for_stmt->body_node, HISTORY_BEGIN(IS_ALONE_STATEMENT));
     }
 
     if (for_stmt->loop_node)
     {
-        codegen_generate_expressionable(for_stmt->loop_node, history_begin(0));
+        codegen_generate_expressionable(for_stmt->loop_node, HISTORY_BEGIN(0));
         asm_push_ins_pop_or_ignore("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
     }
 
-    asm_push("jmp .for_loop%i", for_loop_start_id);
-    asm_push(".for_loop_end%i:", for_loop_end_id);
+    asm_ins1(MIR_OPCODE_JMP, mir_label(".for_loop%i", for_loop_start_id));
+    asm_label(".for_loop_end%i", for_loop_end_id);
 
     codegen_end_entry_exit_point();
 }
@@ -2173,23 +2958,190 @@ void codegen_generate_switch_default_stmt(struct node *node)
     asm_push("; DEFAULT CASE");
     struct code_generator *generator = current_process->generator;
     struct generator_switch_stmt *switch_stmt_data = &generator->_switch;
-    asm_push(".switch_stmt_%i_case_default:", switch_stmt_data->current.id);
+    asm_label(".switch_stmt_%i_case_default", switch_stmt_data->current.id);
 }
 
+// Fewest cases worth a jump table, and the lowest percentage of the table that must be real cases
+#define CODEGEN_SWITCH_TABLE_MIN_CASES 4
+#define CODEGEN_SWITCH_TABLE_MIN_DENSITY 40
+// Clusters tested one after another rather than split further
+#define CODEGEN_SWITCH_LINEAR_CLUSTERS 3
+
+/**
+ * A run of sorted case values dispatched the same way, either a single compare or a jump table over low to high
+ */
+struct codegen_switch_cluster
+{
+    int low;
+    int high;
+    // Index of the first case in the sorted case values and how many there are
+    int first;
+    int total;
+};
+
+struct codegen_switch_dispatch
+{
+    struct node *node;
+    // Sorted case values without duplicates
+    int *values;
+    struct codegen_switch_cluster *clusters;
+    int total_clusters;
+};
+
+static int codegen_switch_value_compare(const void *a, const void *b)
+{
+    int first = *(const int *)a;
+    int second = *(const int *)b;
+    return (first > second) - (first < second);
+}
+
+bool codegen_switch_cluster_is_table(struct codegen_switch_cluster *cluster)
+{
+    return cluster->total >= CODEGEN_SWITCH_TABLE_MIN_CASES;
+}
+
+/**
+ * Greedily takes the longest run from each case that is still dense enough for a jump table, runs too short become single compares
+ */
+int codegen_switch_clusters(int *values, int total, struct codegen_switch_cluster *clusters)
+{
+    int total_clusters = 0;
+    int i = 0;
+    while (i < total)
+    {
+        int end = i;
+        for (int j = i + CODEGEN_SWITCH_TABLE_MIN_CASES - 1; j < total; j++)
+        {
+            long long span = (long long)values[j] - values[i] + 1;
+            if ((long long)(j - i + 1) * 100 >= span * CODEGEN_SWITCH_TABLE_MIN_DENSITY)
+            {
+                end = j;
+            }
+        }
+
+        clusters[total_clusters++] = (struct codegen_switch_cluster){.low = values[i], .high = values[end], .first = i, .total = end - i + 1};
+        i = end + 1;
+    }
+    return total_clusters;
+}
+
+/**
+ * Jumps through a table in .rodata when eax is within the cluster, otherwise goes to the miss label.
+ * Holes in the table lead to the miss label of the whole switch.
+ */
+void codegen_generate_switch_table(struct codegen_switch_dispatch *dispatch, struct codegen_switch_cluster *cluster, const char *miss_label)
+{
+    int switch_id = codegen_switch_id();
+    const char *table_label = codegen_function_symbol("switch_table", codegen_label_count());
+
+    asm_ins2(MIR_OPCODE_MOV, mir_register("ecx"), mir_register("eax"));
+    if (cluster->low != 0)
+    {
+        asm_ins2(MIR_OPCODE_SUB, mir_register("ecx"), mir_immediate(cluster->low));
+    }
+    // Unsigned so values below the cluster wrap around and miss too
+    asm_ins2(MIR_OPCODE_CMP, mir_register("ecx"), mir_immediate((unsigned int)cluster->high - (unsigned int)cluster->low));
+    asm_ins_cc(MIR_OPCODE_JCC, "a", mir_label("%s", miss_label));
+    asm_ins1(MIR_OPCODE_JMP, mir_memory((struct asm_address){.base = table_label, .index = "ecx", .scale = DATA_SIZE_DWORD, .flags = ASM_ADDRESS_FLAG_BASE_IS_SYMBOL}));
+
+    // The table lives outside the function so the case labels need the function name in front
+    const char *function_name = current_function->func->name;
+    codegen_rodata_section_add("align %i", DATA_SIZE_DWORD);
+    codegen_rodata_section_add("%s:", table_label);
+    int case_index = cluster->first;
+    for (long long value = cluster->low; value <= cluster->high; value++)
+    {
+        if (dispatch->values[case_index] == value)
+        {
+            codegen_rodata_section_add("dd %s.switch_stmt_%i_case_%i", function_name, switch_id, (int)value);
+            case_index++;
+            continue;
+        }
+        codegen_rodata_section_add("dd %s.switch_stmt_%i_no_case", function_name, switch_id);
+    }
+}
+
+/**
+ * A balanced binary decision tree over the clusters, each level halves them with a single signed compare of eax
+ */
+void codegen_generate_switch_tree(struct codegen_switch_dispatch *dispatch, int low, int high)
+{
+    int switch_id = codegen_switch_id();
+    if (high - low < CODEGEN_SWITCH_LINEAR_CLUSTERS)
+    {
+        for (int i = low; i <= high; i++)
+        {
+            struct codegen_switch_cluster *cluster = &dispatch->clusters[i];
+            if (!codegen_switch_cluster_is_table(cluster))
+            {
+                for (int j = cluster->first; j < cluster->first + cluster->total; j++)
+                {
+                    asm_ins2(MIR_OPCODE_CMP, mir_register("eax"), mir_immediate(dispatch->values[j]));
+                    asm_ins_cc(MIR_OPCODE_JCC, "e", mir_label(".switch_stmt_%i_case_%i", switch_id, dispatch->values[j]));
+                }
+                continue;
+            }
+
+            int next_id = codegen_label_count();
+            char miss_label[64];
+            sprintf(miss_label, ".switch_stmt_%i_next_%i", switch_id, next_id);
+            codegen_generate_switch_table(dispatch, cluster, miss_label);
+            asm_label("%s", miss_label);
+        }
+        asm_ins1(MIR_OPCODE_JMP, mir_label(".switch_stmt_%i_no_case", switch_id));
+        return;
+    }
+
+    int middle = (low + high + 1) / 2;
+    int left_id = codegen_label_count();
+    asm_ins2(MIR_OPCODE_CMP, mir_register("eax"), mir_immediate(dispatch->clusters[middle].low));
+    asm_ins_cc(MIR_OPCODE_JCC, "l", mir_label(".switch_stmt_%i_less_%i", switch_id, left_id));
+    codegen_generate_switch_tree(dispatch, middle, high);
+    asm_label(".switch_stmt_%i_less_%i", switch_id, left_id);
+    codegen_generate_switch_tree(dispatch, low, middle - 1);
+}
+
+/**
+ * Dense runs of cases are dispatched through bounds checked jump tables, everything else through a binary decision tree.
+ * A switch value matching no case ends up at .switch_stmt_X_no_case which goes to the default case or out of the switch.
+ */
 void codegen_generate_switch_stmt_case_jumps(struct node *node)
 {
-    vector_set_peek_pointer(node->stmt.switch_stmt.cases, 0);
-    struct parsed_switch_case *switch_case = vector_peek(node->stmt.switch_stmt.cases);
+    struct vector *cases = node->stmt.switch_stmt.cases;
+    int total = 0;
+    int *values = calloc(vector_count(cases) + 1, sizeof(int));
+    vector_set_peek_pointer(cases, 0);
+    struct parsed_switch_case *switch_case = vector_peek(cases);
     while (switch_case)
     {
-        asm_push("cmp eax, %i", switch_case->index);
-        asm_push("je .switch_stmt_%i_case_%i", codegen_switch_id(), switch_case->index);
-        switch_case = vector_peek(node->stmt.switch_stmt.cases);
+        values[total++] = switch_case->index;
+        switch_case = vector_peek(cases);
+    }
+
+    qsort(values, total, sizeof(int), codegen_switch_value_compare);
+    int unique = 0;
+    for (int i = 0; i < total; i++)
+    {
+        if (unique == 0 || values[unique - 1] != values[i])
+        {
+            values[unique++] = values[i];
+        }
+    }
+
+    struct codegen_switch_dispatch dispatch = {.node = node, .values = values};
+    dispatch.clusters = calloc(unique + 1, sizeof(struct codegen_switch_cluster));
+    dispatch.total_clusters = codegen_switch_clusters(values, unique, dispatch.clusters);
+    if (dispatch.total_clusters)
+    {
+        codegen_generate_switch_tree(&dispatch, 0, dispatch.total_clusters - 1);
     }
+    free(dispatch.clusters);
+    free(values);
 
+    asm_label(".switch_stmt_%i_no_case", codegen_switch_id());
     if (node->stmt.switch_stmt.has_default_case)
     {
-        asm_push("jmp .switch_stmt_%i_case_default", codegen_switch_id());
+        asm_ins1(MIR_OPCODE_JMP, mir_label(".switch_stmt_%i_case_default", codegen_switch_id()));
         return;
     }
 
@@ -2200,12 +3152,12 @@ void codegen_generate_switch_stmt(struct node *node)
     codegen_begin_entry_exit_point();
     codegen_begin_switch_statement();
 
-    codegen_generate_expressionable(node->stmt.switch_stmt.exp, history_begin(0));
+    codegen_generate_expressionable(node->stmt.switch_stmt.exp, HISTORY_BEGIN(0));
     asm_push_ins_pop_or_ignore("eax", STACK_FRAME_ELEMENT_TYPE_PUSHED_VALUE, "result_value");
 
     codegen_generate_switch_stmt_case_jumps(node);
 
-    codegen_generate_body(node->stmt.switch_stmt.body, history_begin(IS_ALONE_STATEMENT));
+    codegen_generate_body(node->stmt.switch_stmt.body, HISTORY_BEGIN(IS_ALONE_STATEMENT));
     codegen_end_switch_statement();
     codegen_end_entry_exit_point();
 }
@@ -2231,12 +3183,12 @@ void codegen_generate_continue_stmt(struct node *node)
 
 void codegen_generate_goto_stmt(struct node *node)
 {
-    asm_push("jmp label_%s", node->stmt._goto.label->sval);
+    asm_ins1(MIR_OPCODE_JMP, mir_label("label_%s", node->stmt._goto.label->sval));
 }
 
 void codegen_generate_label(struct node *node)
 {
-    asm_push("label_%s:", node->label.name->sval);
+    asm_label("label_%s", node->label.name->sval);
 }
 
 void codegen_generate_scope_variable_for_list(struct node *var_list_node)
@@ -2252,14 +3204,15 @@ void codegen_generate_scope_variable_for_list(struct node *var_list_node)
 }
 void codegen_generate_statement(struct node *node, struct history *history)
 {
+    struct arena_mark resolver_mark = arena_mark(current_process->resolver->arena);
     switch (node->type)
     {
     case NODE_TYPE_EXPRESSION:
-        codegen_generate_exp_node(node, history_begin(history->flags));
+        codegen_generate_exp_node(node, HISTORY_BEGIN(history->flags));
         break;
 
     case NODE_TYPE_UNARY:
-        codegen_generate_unary(node, history_begin(history->flags));
+        codegen_generate_unary(node, HISTORY_BEGIN(history->flags));
         break;
 
     case NODE_TYPE_VARIABLE:
@@ -2318,6 +3271,9 @@ void codegen_generate_statement(struct node *node, struct history *history)
     }
 
     codegen_discard_unused_stack();
+
+    // Nothing resolved for this statement is needed once its code has been generated
+    resolver_release_results(current_process->resolver, &resolver_mark);
 }
 void codegen_generate_scope_no_new_scope(struct vector *statements, struct history *history)
 {
@@ -2340,25 +3296,69 @@ void codegen_generate_body(struct node *node, struct history *history)
 {
     codegen_generate_stack_scope(node->body.statements, node->body.size, history);
 }
+void codegen_save_registers(struct node *func_node)
+{
+    struct vector *saved_registers = func_node->func->saved_registers;
+    for (int i = 0; i < vector_count(saved_registers); i++)
+    {
+        asm_push_ins_push(mir_register(*(const char **)vector_at(saved_registers, i)), STACK_FRAME_ELEMENT_TYPE_SAVED_REGISTER, "saved_register");
+    }
+}
+
+void codegen_restore_saved_registers(struct node *func_node)
+{
+    struct vector *saved_registers = func_node->func->saved_registers;
+    for (int i = vector_count(saved_registers) - 1; i >= 0; i--)
+    {
+        asm_push_ins_pop(*(const char **)vector_at(saved_registers, i), STACK_FRAME_ELEMENT_TYPE_SAVED_REGISTER, "saved_register");
+    }
+}
+
+void codegen_flush_function_instructions()
+{
+    struct vector *function_instructions = current_process->generator->function_instructions;
+    current_process->generator->function_instructions = NULL;
+    peephole_optimize(function_instructions);
+    if (current_process->flags & (COMPILE_PROCESS_OPTIMIZE_O1 | COMPILE_PROCESS_OPTIMIZE_O2))
+    {
+        // The optimizer leaves new push, pop and jump patterns behind
+        ir_optimize(function_instructions, current_process->flags);
+        peephole_optimize(function_instructions);
+    }
+
+    for (int i = 0; i < vector_count(function_instructions); i++)
+    {
+        asm_emit(vector_at(function_instructions, i));
+    }
+    vector_free(function_instructions);
+}
+
 void codegen_generate_function_with_body(struct node *node)
 {
+    struct arena_mark function_symbols = arena_mark(current_process->generator->function_arena);
+    regalloc_function(node);
+    current_process->generator->function_instructions = vector_create(sizeof(struct mir_instruction));
     codegen_register_function(node, 0);
-    asm_push("global %s", node->func.name);
-    asm_push("; %s function", node->func.name);
-    asm_push("%s:", node->func.name);
+    asm_push("global %s", node->func->name);
+    asm_push("; %s function", node->func->name);
+    asm_label("%s", node->func->name);
 
     asm_push_ebp();
-    asm_push("mov ebp, esp");
+    asm_ins2(MIR_OPCODE_MOV, mir_register("ebp"), mir_register("esp"));
     codegen_stack_sub(C_ALIGN(function_node_stack_size(node)));
+    codegen_save_registers(node);
     codegen_new_scope(RESOLVER_DEFAULT_ENTITY_FLAG_IS_LOCAL_STACK);
     codegen_generate_function_arguments(function_node_argument_vec(node));
 
-    codegen_generate_body(node->func.body_n, history_begin(IS_ALONE_STATEMENT));
+    codegen_generate_body(node->func->body_n, HISTORY_BEGIN(IS_ALONE_STATEMENT));
     codegen_finish_scope();
+    codegen_restore_saved_registers(node);
     codegen_stack_add(C_ALIGN(function_node_stack_size(node)));
     asm_pop_ebp();
     stackframe_assert_empty(current_function);
-    asm_push("ret");
+    asm_ins0(MIR_OPCODE_RET);
+    codegen_flush_function_instructions();
+    arena_release(current_process->generator->function_arena, &function_symbols);
 }
 void codegen_generate_function(struct node *node)
 {
@@ -2388,7 +3388,7 @@ void codegen_generate_root_node(struct node *node)
 
 void codegen_generate_root()
 {
-    asm_push("section .text");
+    codegen_section(".text");
     struct node *node = NULL;
     while ((node = codegen_node_next()) != NULL)
     {
@@ -2396,66 +3396,142 @@ void codegen_generate_root()
     }
 }
 
-bool codegen_write_string_char_escaped(char c)
+/**
+ * Writes the string as db operands, runs of printable characters are quoted and everything else is written as a number.
+ * i.e 'Hello world', 10, 0
+ */
+void codegen_write_string(struct string_table_element *element)
 {
-    const char *c_out = NULL;
-    switch (c)
-    {
-    case '\n':
-        c_out = "10";
-        break;
+    size_t len = strlen(element->str);
+    // Worst case every character is written as "255, "
+    char *out = malloc(strlen(element->label) + len * 5 + 16);
+    char *ptr = out + sprintf(out, "%s: db ", element->label);
+    bool in_quotes = false;
+    for (size_t i = 0; i < len; i++)
+    {
+        unsigned char c = element->str[i];
+        bool printable = c >= ' ' && c <= '~' && c != '\'';
+        if (printable && !in_quotes)
+        {
+            *ptr++ = '\'';
+            in_quotes = true;
+        }
+        else if (!printable && in_quotes)
+        {
+            ptr += sprintf(ptr, "', ");
+            in_quotes = false;
+        }
 
-    case '\t':
-        c_out = "9";
-        break;
+        if (printable)
+        {
+            *ptr++ = c;
+            continue;
+        }
+        ptr += sprintf(ptr, "%i, ", c);
     }
 
-    if (c_out)
+    sprintf(ptr, in_quotes ? "', 0" : "0");
+    asm_push("%s", out);
+    free(out);
+}
+
+static int codegen_compare_strings_reversed(const void *a, const void *b)
+{
+    const char *str = (*(struct string_table_element **)a)->str;
+    const char *other_str = (*(struct string_table_element **)b)->str;
+    size_t len = strlen(str);
+    size_t other_len = strlen(other_str);
+    while (len && other_len)
     {
-        asm_push_no_nl("%s, ", c_out);
+        unsigned char c = str[--len];
+        unsigned char other_c = other_str[--other_len];
+        if (c != other_c)
+        {
+            return c - other_c;
+        }
     }
-    return c_out != NULL;
+
+    return (int)len - (int)other_len;
 }
-void codegen_write_string(struct string_table_element *element)
+
+static bool codegen_string_is_suffix(const char *str, const char *other_str)
 {
-    asm_push_no_nl("%s: db ", element->label);
-    size_t len = strlen(element->str);
-    for (int i = 0; i < len; i++)
+    size_t len = strlen(str);
+    size_t other_len = strlen(other_str);
+    return len <= other_len && S_EQ(str, other_str + (other_len - len));
+}
+
+/**
+ * Finds strings that are the tail of another string so they can point into its memory.
+ * Sorting by the reversed strings puts every suffix directly before a string that ends with it.
+ */
+void codegen_merge_string_suffixes()
+{
+    struct vector *string_table = current_process->generator->string_table;
+    int total = vector_count(string_table);
+    if (total < 2)
     {
-        char c = element->str[i];
-        bool handled = codegen_write_string_char_escaped(c);
-        if (handled)
+        return;
+    }
+
+    struct string_table_element **sorted = malloc(sizeof(struct string_table_element *) * total);
+    memcpy(sorted, vector_at(string_table, 0), sizeof(struct string_table_element *) * total);
+    qsort(sorted, total, sizeof(struct string_table_element *), codegen_compare_strings_reversed);
+    for (int i = total - 2; i >= 0; i--)
+    {
+        struct string_table_element *next = sorted[i + 1];
+        if (codegen_string_is_suffix(sorted[i]->str, next->str))
         {
-            continue;
+            sorted[i]->suffix_of = next->suffix_of ? next->suffix_of : next;
         }
-        asm_push_no_nl("'%c', ", c);
     }
-
-    asm_push_no_nl("0");
-    asm_push("");
+    free(sorted);
 }
 
 void codegen_write_strings()
 {
     struct code_generator *generator = current_process->generator;
+    codegen_merge_string_suffixes();
     vector_set_peek_pointer(generator->string_table, 0);
     struct string_table_element *element = vector_peek_ptr(generator->string_table);
     while (element)
     {
-        codegen_write_string(element);
+        if (!element->suffix_of)
+        {
+            codegen_write_string(element);
+        }
+        element = vector_peek_ptr(generator->string_table);
+    }
+
+    vector_set_peek_pointer(generator->string_table, 0);
+    element = vector_peek_ptr(generator->string_table);
+    while (element)
+    {
+        if (element->suffix_of)
+        {
+            asm_push("%s equ %s+%i", element->label, element->suffix_of->label, (int)(strlen(element->suffix_of->str) - strlen(element->str)));
+        }
         element = vector_peek_ptr(generator->string_table);
     }
 }
 
 void codegen_generate_rod()
 {
-    asm_push("section .rodata");
+    codegen_section(".rodata");
     codegen_write_strings();
+
+    vector_set_peek_pointer(current_process->generator->custom_rodata_section, 0);
+    const char *str = vector_peek_ptr(current_process->generator->custom_rodata_section);
+    while (str)
+    {
+        asm_push("%s", str);
+        str = vector_peek_ptr(current_process->generator->custom_rodata_section);
+    }
 }
 
 void codegen_generate_data_section_add_ons()
 {
-    asm_push("section .data");
+    codegen_section(".data");
     vector_set_peek_pointer(current_process->generator->custom_data_section, 0);
     const char* str = vector_peek_ptr(current_process->generator->custom_data_section);
     while(str)
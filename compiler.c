@@ -1,4 +1,6 @@
 #include "compiler.h"
+#include "helpers/arena.h"
+#include "helpers/vector.h"
 #include <stdarg.h>
 #include <stdlib.h>
 
@@ -27,12 +29,70 @@ void compiler_warning(struct compile_process* compiler, const char* msg, ...)
     fprintf(stderr, " on line %i, col %i in file %s\n", compiler->pos.line, compiler->pos.col, compiler->pos.filename);
 }
 
-int compile_file(const char* filename, const char* out_filename, int flags)
+struct compile_process* compile_include(const char* filename, struct compile_process* parent_process)
+{
+    // Include guards stop a file including itself, without them we would recurse until the stack runs out
+    if (parent_process->include_depth >= COMPILER_MAX_INCLUDE_DEPTH)
+    {
+        compiler_error(parent_process, "Includes nested more than %i deep, does %s include itself", COMPILER_MAX_INCLUDE_DEPTH, filename);
+    }
+
+    struct compile_process* process = compile_process_create(filename, NULL, parent_process->flags, parent_process);
+    if (!process)
+        return NULL;
+
+    struct lex_process* lex_process = lex_process_create(process, &compiler_lex_functions, NULL);
+    if (!lex_process)
+    {
+        return NULL;
+    }
+
+    if (lex(lex_process) != LEXICAL_ANALYSIS_ALL_OK)
+    {
+        return NULL;
+    }
+
+    process->token_vec_original = lex_process_tokens(lex_process);
+    if (preprocessor_run(process) != 0)
+    {
+        return NULL;
+    }
+
+    return process;
+}
+
+/**
+ * The dependency file is the output file with ".d" appended, i.e out.asm writes out.asm.d
+ */
+static void compile_dependency_filename(const char* out_filename, char* filename_out)
+{
+    snprintf(filename_out, PATH_MAX, "%s.d", out_filename);
+}
+
+static void compile_free_nodes(struct compile_process* process)
+{
+    arena_free(process->node_arena);
+    process->node_arena = NULL;
+    node_set_arena(NULL);
+}
+
+int compile_file(const char* filename, const char* out_filename, int flags, struct vector* include_dirs, const char* dependency_filename)
 {
     struct compile_process* process = compile_process_create(filename, out_filename, flags, NULL);
     if (!process)
         return COMPILER_FAILED_WITH_ERRORS;
 
+    if (include_dirs)
+    {
+        vector_set_peek_pointer(include_dirs, 0);
+        const char* dir = vector_peek_ptr(include_dirs);
+        while(dir)
+        {
+            vector_push(process->include_dirs, &dir);
+            dir = vector_peek_ptr(include_dirs);
+        }
+    }
+
     // Preform lexical analysis
     struct lex_process* lex_process = lex_process_create(process, &compiler_lex_functions, NULL);
     if (!lex_process)
@@ -50,20 +110,48 @@ int compile_file(const char* filename, const char* out_filename, int flags)
     {
         return COMPILER_FAILED_WITH_ERRORS;
     }
+
+    if (flags & COMPILE_PROCESS_WRITE_DEPENDENCY_FILE)
+    {
+        char default_dependency_filename[PATH_MAX];
+        if (!dependency_filename)
+        {
+            compile_dependency_filename(out_filename, default_dependency_filename);
+            dependency_filename = default_dependency_filename;
+        }
+
+        if (preprocessor_write_dependency_file(process, out_filename, dependency_filename) != 0)
+        {
+            compiler_error(process, "Unable to write the dependency file %s", dependency_filename);
+        }
+    }
+
+    if (flags & COMPILE_PROCESS_PREPROCESS_ONLY)
+    {
+        preprocessor_output(process, process->ofile);
+        fclose(process->ofile);
+        return COMPILER_FILE_COMPILED_OK;
+    }
     
     // Preform parsing
+    int res = COMPILER_FILE_COMPILED_OK;
     if (parse(process) != PARSE_ALL_OK)
     {
-        return COMPILER_FAILED_WITH_ERRORS;
+        res = COMPILER_FAILED_WITH_ERRORS;
     }
-
-    if (codegen(process) != CODEGEN_ALL_OK)
+    else
     {
-        return COMPILER_FAILED_WITH_ERRORS;
+        fold_constants(process);
+
+        // Preform code generation..
+        if (codegen(process) != CODEGEN_ALL_OK)
+        {
+            res = COMPILER_FAILED_WITH_ERRORS;
+        }
     }
-    
-    // Preform code generation..
 
+    // Nodes are no longer needed after code generation
+    compile_free_nodes(process);
     fclose(process->ofile);
-    return COMPILER_FILE_COMPILED_OK;
+    return res;
 }
\ No newline at end of file
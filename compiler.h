@@ -161,6 +161,14 @@ enum
 {
     COMPILE_PROCESS_EXECUTE_NASM = 0b00000001,
     COMPILE_PROCESS_EXPORT_AS_OBJECT = 0b00000010,
+    // Stop after the preprocessor and write the preprocessed source to the output file
+    COMPILE_PROCESS_PREPROCESS_ONLY = 0b00000100,
+    // Write a Makefile dependency file listing every file the preprocessor opened
+    COMPILE_PROCESS_WRITE_DEPENDENCY_FILE = 0b00001000,
+    // Run the SSA optimizer over every function, constant and copy propagation plus dead code elimination
+    COMPILE_PROCESS_OPTIMIZE_O1 = 0b00010000,
+    // Everything -O1 does plus global value numbering
+    COMPILE_PROCESS_OPTIMIZE_O2 = 0b00100000,
 };
 
 struct scope
@@ -191,6 +199,28 @@ struct symbol
     void *data;
 };
 
+struct struct_layout_member
+{
+    const char *name;
+    int offset;
+    size_t size;
+    int alignment;
+    struct node *var_node;
+};
+
+/**
+ * The member offsets of a structure or union body, computed once when the body is parsed
+ */
+struct struct_layout
+{
+    // Members in declaration order
+    struct struct_layout_member *members;
+    int total;
+
+    // Maps member names to struct struct_layout_member*
+    struct hashmap *members_by_name;
+};
+
 struct codegen_entry_point
 {
     // ID of the entry point
@@ -211,6 +241,9 @@ struct string_table_element
     // This is the assembly label that points to the memory
     // where the string can be found.
     const char label[50];
+
+    // Set when this string is the tail of another string and shares its memory
+    struct string_table_element *suffix_of;
 };
 
 struct code_generator
@@ -229,6 +262,8 @@ struct code_generator
 
     // A vector of struct string_table_element*
     struct vector *string_table;
+    // Maps strings to their struct string_table_element*
+    struct hashmap *string_labels;
 
     // vector of struct codegen_entry_point*
     struct vector *entry_points;
@@ -238,11 +273,25 @@ struct code_generator
     // Vector of const char* that will go in the data section
     struct vector* custom_data_section;
 
-    // vector of struct response*
+    // Vector of const char* that will go in the read only data section, i.e switch jump tables
+    struct vector *custom_rodata_section;
+
+    // The section currently being written to, i.e .data
+    const char *section;
+
+    // vector of struct response, used as a stack of pending responses
     struct vector *responses;
+
+    // Vector of struct mir_instruction of the function being generated, NULL when instructions are written straight out
+    struct vector *function_instructions;
+
+    // Symbol names the instructions of the function being generated refer to, released once the function is written out
+    struct arena *function_arena;
 };
 
 struct resolver_process;
+struct arena;
+struct hashmap;
 
 struct preprocessor;
 struct preprocessor_definition;
@@ -335,6 +384,19 @@ struct preprocessor
 struct preprocessor* preprocessor_create(struct compile_process* compiler);
 int preprocessor_run(struct compile_process* compiler);
 
+/**
+ * Writes the preprocessed token vector back out as C source to the given file
+ */
+int preprocessor_output(struct compile_process* compiler, FILE* fp);
+
+/**
+ * Writes a Makefile rule to "filename" making "target" depend on every file we included
+ */
+int preprocessor_write_dependency_file(struct compile_process* compiler, const char* target, const char* filename);
+
+
+// Deeper than this an include is assumed to include itself again
+#define COMPILER_MAX_INCLUDE_DEPTH 200
 
 struct compile_process
 {
@@ -357,6 +419,10 @@ struct compile_process
 
     struct vector *node_vec;
     struct vector *node_tree_vec;
+
+    // Owns every node and node vector created while parsing, released once the compile is done.
+    // Created by parse so included files, which are only preprocessed, never have one.
+    struct arena *node_arena;
     FILE *ofile;
 
     struct
@@ -367,10 +433,10 @@ struct compile_process
 
     struct
     {
-        // Current active symbol table. struct symbol*
-        struct vector *table;
+        // Current active symbol table, maps symbol names to struct symbol*
+        struct hashmap *table;
 
-        // struct vector* multiple symbol tables stored in here..
+        // struct hashmap* multiple symbol tables stored in here..
         struct vector *tables;
     } symbols;
 
@@ -381,6 +447,9 @@ struct compile_process
     // A vector of const char* that represents include directories.
     struct vector* include_dirs;
     struct preprocessor* preprocessor;
+
+    // How many includes deep this file is, zero for the file being compiled
+    int include_depth;
 };
 
 enum
@@ -502,6 +571,9 @@ struct stack_frame_element
     // The offset this element is on the base pointer
     int offset_from_bp;
 
+    // The number of STACK_PUSH_SIZE slots this element covers, reservations are recorded as one element
+    size_t total_slots;
+
     struct stack_frame_data data;
 };
 
@@ -534,6 +606,11 @@ void stackframe_sub(struct node *func_node, int type, const char *name, size_t a
 void stackframe_add(struct node *func_node, int type, const char *name, size_t amount);
 void stackframe_assert_empty(struct node *func_node);
 
+void fold_constants(struct compile_process *process);
+void regalloc_function(struct node *func_node);
+void peephole_optimize(struct vector *instructions);
+void ir_optimize(struct vector *instructions, int flags);
+
 enum
 {
     UNARY_FLAG_IS_LEFT_OPERANDED_UNARY = 0b00000001,
@@ -556,6 +633,47 @@ struct unary
         } indirection;
     };
 };
+/**
+ * The out of line part of a function node
+ */
+struct function
+{
+    // Special flags
+    int flags;
+    // Return type i.e void, int, long ect...
+    struct datatype rtype;
+
+    // I.e function name "main"
+    const char *name;
+
+    struct function_arguments
+    {
+        // Vector of struct node* . Must be type NODE_TYPE_VARIABLE
+        struct vector *vector;
+
+        // How much to add to the EBP to find the first argument.
+        size_t stack_addition;
+    } args;
+
+    // Pointer to the function body node, NULL if this is a function prototype
+    struct node *body_n;
+
+    struct stack_frame
+    {
+        // A vector of stack_frame_element
+        struct vector *elements;
+
+        // The number of STACK_PUSH_SIZE slots covered by all of the elements
+        size_t total_slots;
+    } frame;
+
+    // The stack size for all variables inside this function.
+    size_t stack_size;
+
+    // Vector of const char* callee saved registers given to locals, they are restored on return
+    struct vector *saved_registers;
+};
+
 struct node
 {
     int type;
@@ -589,12 +707,16 @@ struct node
 
         struct var
         {
-            struct datatype type;
+            // Out of line to keep variable nodes small
+            struct datatype *type;
             int padding;
             // Aligned offset
             int aoffset;
             const char *name;
             struct node *val;
+
+            // The register holding this local for its whole life, NULL if it lives on the stack
+            const char *reg;
         } var;
 
         struct node_tenary
@@ -620,6 +742,9 @@ struct node
             const char *name;
             struct node *body_n;
 
+            // NULL for forward declarations
+            struct struct_layout *layout;
+
             /**
              * struct abc
              * {
@@ -637,6 +762,9 @@ struct node
             const char *name;
             struct node *body_n;
 
+            // NULL for forward declarations
+            struct struct_layout *layout;
+
             /**
              * struct abc
              * {
@@ -666,39 +794,11 @@ struct node
             struct node *largest_var_node;
         } body;
 
-        struct function
-        {
-            // Special flags
-            int flags;
-            // Return type i.e void, int, long ect...
-            struct datatype rtype;
-
-            // I.e function name "main"
-            const char *name;
-
-            struct function_arguments
-            {
-                // Vector of struct node* . Must be type NODE_TYPE_VARIABLE
-                struct vector *vector;
+        // Function metadata is large and only needed by function nodes so it lives out of line.
+        struct function *func;
 
-                // How much to add to the EBP to find the first argument.
-                size_t stack_addition;
-            } args;
-
-            // Pointer to the function body node, NULL if this is a function prototype
-            struct node *body_n;
-
-            struct stack_frame
-            {
-                // A vector of stack_frame_element
-                struct vector *elements;
-            } frame;
-
-            // The stack size for all variables inside this function.
-            size_t stack_size;
-        } func;
-
-        struct statement
+        // Only one statement kind is used per node so they share storage
+        union statement
         {
 
             struct return_stmt
@@ -768,7 +868,7 @@ struct node
 
         struct cast
         {
-            struct datatype dtype;
+            struct datatype *dtype;
             struct node *operand;
         } cast;
 
@@ -838,6 +938,9 @@ struct resolver_callbacks
     RESOLVER_SET_RESULT_BASE set_result_base;
 };
 
+// Must be a power of two
+#define RESOLVER_CACHE_TOTAL_ENTRIES 256
+
 struct compile_process;
 struct resolver_process
 {
@@ -847,6 +950,26 @@ struct resolver_process
         struct resolver_scope *current;
     } scope;
 
+    // Maps entity names to the innermost struct resolver_binding* for that name
+    struct hashmap *bindings;
+
+    // Results and the entities built for them are allocated here, codegen releases them after every statement
+    struct arena *arena;
+
+    // Remembers the last result for a node, only valid while the generation is unchanged
+    struct resolver_cache
+    {
+        struct resolver_cache_entry
+        {
+            struct node *node;
+            int generation;
+            struct resolver_result *result;
+        } entries[RESOLVER_CACHE_TOTAL_ENTRIES];
+
+        // Bumped whenever scopes change or results are released
+        int generation;
+    } cache;
+
     struct compile_process *compiler;
     struct resolver_callbacks callbacks;
 };
@@ -873,14 +996,132 @@ enum
     RESOLVER_DEFAULT_ENTITY_DATA_TYPE_FUNCTION,
     RESOLVER_DEFAULT_ENTITY_DATA_TYPE_ARRAY_BRACKET,
 };
+enum
+{
+    // The base is a global symbol rather than a register
+    ASM_ADDRESS_FLAG_BASE_IS_SYMBOL = 0b00000001,
+    // Not memory at all, the value lives in the base register
+    ASM_ADDRESS_FLAG_IS_REGISTER = 0b00000010
+};
+
+// Longest formatted address, [ebp-4], [var_name+4]
+#define ASM_ADDRESS_MAX_LENGTH 128
+
+/**
+ * A memory operand [base+index*scale+displacement], only turned into text when an instruction is emitted
+ */
+struct asm_address
+{
+    // ebp, var_name. NULL if there is no address
+    const char *base;
+
+    // NULL if there is no index register
+    const char *index;
+    int scale;
+    int displacement;
+    int flags;
+};
+
+enum
+{
+    MIR_OPERAND_NONE,
+    MIR_OPERAND_REGISTER,
+    MIR_OPERAND_IMMEDIATE,
+    MIR_OPERAND_MEMORY,
+    // Labels and symbols, the text is owned by the operand
+    MIR_OPERAND_LABEL
+};
+
+struct mir_operand
+{
+    int type;
+
+    // Size keyword written in front of the operand i.e dword, NULL for none
+    const char *size;
+
+    union
+    {
+        const char *reg;
+        long long imm;
+        struct asm_address address;
+        char *label;
+    };
+};
+
+enum
+{
+    // Directives, comments and anything else that is only text
+    MIR_OPCODE_RAW,
+    MIR_OPCODE_LABEL,
+    MIR_OPCODE_PUSH,
+    MIR_OPCODE_POP,
+    MIR_OPCODE_MOV,
+    MIR_OPCODE_MOVZX,
+    MIR_OPCODE_MOVSX,
+    MIR_OPCODE_LEA,
+    MIR_OPCODE_ADD,
+    MIR_OPCODE_SUB,
+    MIR_OPCODE_IMUL,
+    MIR_OPCODE_MUL,
+    MIR_OPCODE_IDIV,
+    MIR_OPCODE_DIV,
+    MIR_OPCODE_CDQ,
+    MIR_OPCODE_NEG,
+    MIR_OPCODE_NOT,
+    MIR_OPCODE_INC,
+    MIR_OPCODE_DEC,
+    MIR_OPCODE_AND,
+    MIR_OPCODE_OR,
+    MIR_OPCODE_XOR,
+    MIR_OPCODE_SAL,
+    MIR_OPCODE_SAR,
+    MIR_OPCODE_SHR,
+    MIR_OPCODE_CMP,
+    MIR_OPCODE_SETCC,
+    MIR_OPCODE_JMP,
+    MIR_OPCODE_JCC,
+    MIR_OPCODE_CALL,
+    MIR_OPCODE_RET
+};
+
+#define MIR_MAX_OPERANDS 2
+
+/**
+ * One machine instruction, codegen builds these and the NASM printer turns them into text
+ */
+struct mir_instruction
+{
+    int opcode;
+
+    // Condition code for setcc and jcc, i.e "l" for setl
+    const char *cc;
+
+    struct mir_operand operands[MIR_MAX_OPERANDS];
+
+    // The line for raw instructions and the name for labels, owned by the instruction
+    char *text;
+};
+
+struct mir_operand mir_none();
+struct mir_operand mir_register(const char *reg);
+struct mir_operand mir_immediate(long long value);
+struct mir_operand mir_memory(struct asm_address address);
+struct mir_operand mir_label(const char *fmt, ...);
+struct mir_operand mir_sized(const char *size, struct mir_operand operand);
+bool mir_operand_is_register(struct mir_operand *operand, const char *reg);
+bool mir_operand_uses_register(struct mir_operand *operand, const char *reg);
+bool mir_operand_equals(struct mir_operand *a, struct mir_operand *b);
+struct mir_operand mir_operand_clone(struct mir_operand *operand);
+void mir_instruction_free(struct mir_instruction *instruction);
+void mir_print(FILE *fp, struct mir_instruction *instruction);
+const char *codegen_address_string(struct asm_address *address, char *out, size_t len);
+
 struct resolver_default_entity_data
 {
     // i.e variable, function, structure
     int type;
     // This is the address [ebp-4], [var_name+4]
-    char address[60];
-    // ebp, var_name
-    char base_address[60];
+    struct asm_address address;
     // -4
     int offset;
     // Flags relating to the entity data
@@ -928,9 +1169,7 @@ struct resolver_result
     struct resolver_result_base
     {
         // [ebp-4], [name+4]
-        char address[60];
-        // EBP, global_variable_name
-        char base_address[60];
+        struct asm_address address;
         // -4
         int offset;
     } base;
@@ -947,6 +1186,18 @@ struct resolver_scope
     void *private;
 };
 
+/**
+ * Binds an entity to its name, inner bindings shadow the outer ones they point to
+ */
+struct resolver_binding
+{
+    struct resolver_entity *entity;
+    struct resolver_scope *scope;
+
+    // The binding this one shadows, NULL if there is none.
+    struct resolver_binding *shadowed;
+};
+
 struct resolver_entity
 {
     int type;
@@ -1150,19 +1401,24 @@ enum
       EXPRESSION_IS_BITSHIFT_LEFT | EXPRESSION_IS_BITSHIFT_RIGHT | \
       EXPRESSION_IS_BITWISE_OR | EXPRESSION_IS_BITWISE_AND | EXPRESSION_IS_BITWISE_XOR | EXPRESSION_IS_ASSIGNMENT | IS_ALONE_STATEMENT)
 
-enum
-{
-    STRUCT_ACCESS_BACKWARDS = 0b00000001,
-    STRUCT_STOP_AT_POINTER_ACCESS = 0b00000010
-};
-
 enum
 {
     // The flag is set for native functions.
     FUNCTION_NODE_FLAG_IS_NATIVE = 0b00000001,
 };
 
-int compile_file(const char *filename, const char *out_filename, int flags);
+/**
+ * Compiles filename into out_filename.
+ * include_dirs is a vector of const char* directories searched for includes after the including file's own
+ * directory, it may be NULL. dependency_filename overrides where the dependency file is written, NULL puts it at <out_filename>.d
+ */
+int compile_file(const char *filename, const char *out_filename, int flags, struct vector *include_dirs, const char *dependency_filename);
+
+/**
+ * Lexes and preprocesses the given include file sharing the parent's preprocessor.
+ * Returns NULL on failure
+ */
+struct compile_process *compile_include(const char *filename, struct compile_process *parent_process);
 struct compile_process *compile_process_create(const char *filename, const char *filename_out, int flags, struct compile_process* parent_process);
 
 char compile_process_next_char(struct lex_process *lex_process);
@@ -1203,6 +1459,11 @@ size_t datatype_size_for_array_access(struct datatype *dtype);
 size_t datatype_element_size(struct datatype *dtype);
 size_t datatype_size_no_ptr(struct datatype *dtype);
 size_t datatype_size(struct datatype *dtype);
+/**
+ * Returns the shared instance of the given datatype, equal datatypes always return the same pointer.
+ * Canonical datatypes must never be modified.
+ */
+struct datatype *datatype_canonical(struct datatype *dtype);
 bool datatype_is_primitive(struct datatype *dtype);
 bool datatype_is_struct_or_union_non_pointer(struct datatype *dtype);
 struct datatype datatype_for_numeric();
@@ -1249,6 +1510,7 @@ void make_bracket_node(struct node *node);
 void make_body_node(struct vector *body_vec, size_t size, bool padded, struct node *largest_var_node);
 void make_struct_node(const char *name, struct node *body_node);
 void make_union_node(const char *name, struct node *body_node);
+struct struct_layout *struct_layout_create(struct node *body_node, bool is_union);
 void make_switch_node(struct node *exp_node, struct node *body_node, struct vector *cases, bool has_default_case);
 void make_function_node(struct datatype *ret_type, const char *name, struct vector *arguments, struct node *body_node);
 void make_while_node(struct node *exp_node, struct node *body_node);
@@ -1266,6 +1528,12 @@ struct node *node_peek();
 struct node *node_peek_or_null();
 void node_push(struct node *node);
 void node_set_vector(struct vector *vec, struct vector *root_vec);
+void node_set_arena(struct arena *arena);
+
+/**
+ * Returns the canonical datatype used for the out of line datatypes of nodes
+ */
+struct datatype *node_datatype_create(struct datatype *dtype);
 
 bool is_access_operator(const char *op);
 bool is_access_node(struct node *node);
@@ -1298,7 +1566,7 @@ struct node *variable_node_or_list(struct node *node);
 
 int array_multiplier(struct datatype *dtype, int index, int index_value);
 int array_offset(struct datatype *dtype, int index, int index_value);
-int struct_offset(struct compile_process *compile_proc, const char *struct_name, const char *var_name, struct node **var_node_out, int last_pos, int flags);
+int struct_offset(struct compile_process *compile_proc, const char *struct_name, const char *var_name, struct node **var_node_out);
 struct node *variable_struct_or_union_largest_variable_node(struct node *var_node);
 struct node *body_largest_variable_node(struct node *body_node);
 
@@ -1309,6 +1577,15 @@ struct resolver_entity *resolver_register_function(struct resolver_process *proc
 struct resolver_scope *resolver_new_scope(struct resolver_process *resolver, void *private, int flags);
 void resolver_finish_scope(struct resolver_process *resolver);
 struct resolver_result *resolver_follow(struct resolver_process *resolver, struct node *node);
+/**
+ * Allocates zeroed memory for resolver data, while following a node it belongs to the current statement
+ */
+void *resolver_alloc(size_t size);
+struct arena_mark;
+/**
+ * Releases every result resolved since the mark was taken from the resolver arena
+ */
+void resolver_release_results(struct resolver_process *resolver, struct arena_mark *mark);
 bool resolver_result_ok(struct resolver_result *result);
 struct resolver_entity *resolver_result_entity_root(struct resolver_result *result);
 struct resolver_entity *resolver_result_entity_next(struct resolver_entity *entity);
@@ -1320,9 +1597,10 @@ struct vector *function_node_argument_vec(struct node *node);
 
 struct resolver_default_entity_data *resolver_default_entity_private(struct resolver_entity *entity);
 struct resolver_default_scope_data *resolver_default_scope_private(struct resolver_scope *scope);
-char *resolver_default_stack_asm_address(int stack_offset, char *out);
+struct asm_address resolver_default_stack_asm_address(int stack_offset);
 struct resolver_default_entity_data *resolver_default_new_entity_data();
-void resolver_default_global_asm_address(const char *name, int offset, char *address_out);
+struct asm_address resolver_default_global_asm_address(const char *name, int offset);
+struct asm_address resolver_default_register_asm_address(const char *reg);
 
 void resolver_default_entity_data_set_address(struct resolver_default_entity_data *entity_data, struct node *var_node, int offset, int flags);
 void *resolver_default_make_private(struct resolver_entity *entity, struct node *node, int offset, struct resolver_scope *scope);
@@ -1360,6 +1638,16 @@ size_t variable_size_for_list(struct node *var_list_node);
 struct node *variable_node(struct node *node);
 bool variable_node_is_primitive(struct node *node);
 
+/**
+ * The parser and the code generator each have their own struct history, both start with their flags.
+ * Copies the parent history into history when there is one and sets its flags, returns history.
+ */
+void *history_init(void *history, const void *parent, size_t size, int flags);
+
+// Histories are compound literals on the caller's stack, they live until the end of the enclosing block.
+#define HISTORY_BEGIN(flags) history_init(&(struct history){}, NULL, sizeof(struct history), flags)
+#define HISTORY_DOWN(history, flags) history_init(&(struct history){}, history, sizeof(struct history), flags)
+
 int padding(int val, int to);
 int align_value(int val, int to);
 int align_value_treat_positive(int val, int to);
@@ -1390,6 +1678,7 @@ struct symbol *symresolver_get_symbol_for_native_function(struct compile_process
 struct expressionable;
 struct expressionable_callbacks;
 struct expressionable_config;
+struct expressionable_op_precedence_group;
 
 struct expressionable_callbacks *expressionable_callbacks(struct expressionable *expressionable);
 void *expressionable_node_pop(struct expressionable *expressionable);
@@ -1405,16 +1694,24 @@ struct expressionable* expressionable_create(struct expressionable_config* confi
 int expressionable_parse_number(struct expressionable *expressionable);
 int expressionable_parse_identifier(struct expressionable *expressionable);
 
-bool expressionable_parser_left_op_has_priority(const char *op_left, const char *op_right);
-void expressionable_parser_node_shift_children_left(struct expressionable *expressionable, void *node);
+int expressionable_parser_get_precedence_for_operator(const char *op, struct expressionable_op_precedence_group **group_out);
+
+/**
+ * Returns the precedence group of the operator, lower binds tighter. -1 if this is not a known operator
+ */
+int expressionable_op_precedence(const char *op);
 
-void expressionable_parser_reorder_expression(struct expressionable *expressionable, void **node_out);
+/**
+ * Returns true if "op" binds tighter than an operator of the given precedence,
+ * meaning it belongs in that operator's right operand.
+ */
+bool expressionable_op_binds_tighter(const char *op, int precedence);
+void expressionable_parse_right_operand(struct expressionable *expressionable, int precedence);
 
 bool expressionable_generic_type_is_value_expressionable(int type);
 void expressionable_expect_op(struct expressionable *expressionable, const char *op);
 
 void expressionable_expect_sym(struct expressionable *expressionable, char c);
-void expressionable_deal_with_additional_expression(struct expressionable *expressionable);
 void expressionable_parse_parentheses(struct expressionable *expressionable);
 int expressionable_get_pointer_depth(struct expressionable *expressionable);
 void expressionable_parse_for_indirection_unary(struct expressionable *expressionable);
@@ -1433,6 +1730,8 @@ size_t function_node_argument_stack_addition(struct node *node);
 long arithmetic(struct compile_process* compiler, long left_operand, long right_operand, const char* op, bool* success);
 
 #define TOTAL_OPERATOR_GROUPS 14
+// Unary operators bind looser than postfix operators (group 0) and tighter than every binary operator
+#define EXPRESSIONABLE_UNARY_PRECEDENCE 1
 #define MAX_OPERATORS_IN_GROUP 12
 
 enum
@@ -2,6 +2,7 @@
 #include <stdlib.h>
 #include "compiler.h"
 #include "helpers/vector.h"
+#include "helpers/arena.h"
 struct compile_process *compile_process_create(const char *filename, const char *filename_out, int flags, struct compile_process* parent_process)
 {
     FILE *file = fopen(filename, "r");
@@ -28,6 +29,7 @@ struct compile_process *compile_process_create(const char *filename, const char
     
     process->flags = flags;
     process->cfile.fp = file;
+    process->cfile.abs_path = realpath(filename, NULL);
     process->ofile = out_file;
     process->pos.line = 1;
     process->pos.col = 1;
@@ -41,12 +43,13 @@ struct compile_process *compile_process_create(const char *filename, const char
     {
         process->preprocessor = parent_process->preprocessor;
         process->include_dirs = parent_process->include_dirs;
+        process->include_depth = parent_process->include_depth + 1;
     }
     else
     {
         process->preprocessor = preprocessor_create(process);
+        // compile_file adds the directories given with -I
         process->include_dirs = vector_create(sizeof(const char*));
-        // setup default include dirs...
     }
     return process;
 }
@@ -1,4 +1,14 @@
 #include "compiler.h"
+#include "helpers/vector.h"
+#include "helpers/hashmap.h"
+
+// Every distinct datatype is stored here once, equal datatypes share the same instance.
+static struct datatype_table
+{
+    struct datatype **entries;
+    int capacity;
+    int count;
+} datatype_table;
 
 bool datatype_is_struct_or_union(struct datatype* dtype)
 {
@@ -66,3 +76,112 @@ bool datatype_is_struct_or_union_non_pointer(struct datatype* dtype)
 {
     return dtype->type != DATA_TYPE_UNKNOWN && !datatype_is_primitive(dtype) && !(dtype->flags & DATATYPE_FLAG_IS_POINTER);  
 }
+
+static unsigned int datatype_hash(struct datatype *dtype)
+{
+    unsigned int hash = dtype->type_str ? hashmap_hash(dtype->type_str) : 0;
+    hash = hash * 31 + dtype->type;
+    hash = hash * 31 + dtype->flags;
+    hash = hash * 31 + dtype->pointer_depth;
+    hash = hash * 31 + dtype->size;
+    hash = hash * 31 + dtype->array.size;
+    hash = hash * 31 + (unsigned int)((uintptr_t)dtype->secondary >> 4);
+    hash = hash * 31 + (unsigned int)((uintptr_t)dtype->struct_node >> 4);
+    return hash;
+}
+
+static bool datatype_array_brackets_equal(struct array_brackets *brackets, struct array_brackets *other_brackets)
+{
+    if (brackets == other_brackets)
+    {
+        return true;
+    }
+
+    if (!brackets || !other_brackets || vector_count(brackets->n_brackets) != vector_count(other_brackets->n_brackets))
+    {
+        return false;
+    }
+
+    for (int i = 0; i < vector_count(brackets->n_brackets); i++)
+    {
+        struct node *bracket = vector_peek_ptr_at(brackets->n_brackets, i);
+        struct node *other_bracket = vector_peek_ptr_at(other_brackets->n_brackets, i);
+        if (bracket->bracket.inner->type != NODE_TYPE_NUMBER || other_bracket->bracket.inner->type != NODE_TYPE_NUMBER ||
+            bracket->bracket.inner->llnum != other_bracket->bracket.inner->llnum)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static bool datatype_equal(struct datatype *dtype, struct datatype *other)
+{
+    if (dtype->flags != other->flags || dtype->type != other->type || dtype->pointer_depth != other->pointer_depth ||
+        dtype->size != other->size || dtype->secondary != other->secondary || dtype->struct_node != other->struct_node ||
+        dtype->array.size != other->array.size)
+    {
+        return false;
+    }
+
+    if (dtype->type_str != other->type_str && (!dtype->type_str || !other->type_str || !S_EQ(dtype->type_str, other->type_str)))
+    {
+        return false;
+    }
+
+    return !(dtype->flags & DATATYPE_FLAG_IS_ARRAY) || datatype_array_brackets_equal(dtype->array.brackets, other->array.brackets);
+}
+
+static struct datatype **datatype_table_slot(struct datatype **entries, int capacity, struct datatype *dtype, unsigned int hash)
+{
+    int index = hash & (capacity - 1);
+    while (entries[index] && !datatype_equal(entries[index], dtype))
+    {
+        index = (index + 1) & (capacity - 1);
+    }
+
+    return &entries[index];
+}
+
+static void datatype_table_grow()
+{
+    int capacity = datatype_table.capacity ? datatype_table.capacity * 2 : 64;
+    struct datatype **entries = calloc(capacity, sizeof(struct datatype *));
+    for (int i = 0; i < datatype_table.capacity; i++)
+    {
+        struct datatype *dtype = datatype_table.entries[i];
+        if (dtype)
+        {
+            *datatype_table_slot(entries, capacity, dtype, datatype_hash(dtype)) = dtype;
+        }
+    }
+
+    free(datatype_table.entries);
+    datatype_table.entries = entries;
+    datatype_table.capacity = capacity;
+}
+
+struct datatype *datatype_canonical(struct datatype *dtype)
+{
+    struct datatype key = *dtype;
+    if (key.secondary)
+    {
+        key.secondary = datatype_canonical(key.secondary);
+    }
+
+    if ((datatype_table.count + 1) * 4 > datatype_table.capacity * 3)
+    {
+        datatype_table_grow();
+    }
+
+    struct datatype **slot = datatype_table_slot(datatype_table.entries, datatype_table.capacity, &key, datatype_hash(&key));
+    if (!*slot)
+    {
+        *slot = calloc(1, sizeof(struct datatype));
+        memcpy(*slot, &key, sizeof(struct datatype));
+        datatype_table.count++;
+    }
+
+    return *slot;
+}
@@ -144,87 +144,29 @@ int expressionable_parser_get_precedence_for_operator(const char *op, struct exp
     return -1;
 }
 
-bool expressionable_parser_left_op_has_priority(const char *op_left, const char *op_right)
+int expressionable_op_precedence(const char *op)
 {
-    struct expressionable_op_precedence_group *group_left = NULL;
-    struct expressionable_op_precedence_group *group_right = NULL;
-
-    if (S_EQ(op_left, op_right))
-    {
-        return false;
-    }
-
-    int precedence_left = expressionable_parser_get_precedence_for_operator(op_left, &group_left);
-    int precedence_right = expressionable_parser_get_precedence_for_operator(op_right, &group_right);
-    if (group_left->associtivity == ASSOCIATIVITY_RIGHT_TO_LEFT)
-    {
-        return false;
-    }
-
-    return precedence_left <= precedence_right;
-}
-
-void expressionable_parser_node_shift_children_left(struct expressionable *expressionable, void *node)
-{
-    int node_type = expressionable_callbacks(expressionable)->get_node_type(expressionable, node);
-    assert(node_type == EXPRESSIONABLE_GENERIC_TYPE_EXPRESSION);
-
-    void *left_node = expressionable_callbacks(expressionable)->get_left_node(expressionable, node);
-    void *right_node = expressionable_callbacks(expressionable)->get_right_node(expressionable, node);
-    int right_node_type = expressionable_callbacks(expressionable)->get_node_type(expressionable, right_node);
-    assert(right_node_type == EXPRESSIONABLE_GENERIC_TYPE_EXPRESSION);
-
-    const char *right_op = expressionable_callbacks(expressionable)->get_node_operator(expressionable, right_node);
-    void *new_exp_left_node = left_node;
-    void *new_exp_right_node = expressionable_callbacks(expressionable)->get_left_node(expressionable, right_node);
-    const char *node_op = expressionable_callbacks(expressionable)->get_node_operator(expressionable, node);
-    expressionable_callbacks(expressionable)->make_expression_node(expressionable, new_exp_left_node, new_exp_right_node, node_op);
-
-    void *new_left_operand = expressionable_node_pop(expressionable);
-    void *new_right_operand = expressionable_callbacks(expressionable)->get_right_node(expressionable, right_node);
-    expressionable_callbacks(expressionable)->set_exp_node(expressionable, node, new_left_operand, new_right_operand, right_op);
+    struct expressionable_op_precedence_group *group = NULL;
+    return expressionable_parser_get_precedence_for_operator(op, &group);
 }
 
-void expressionable_parser_reorder_expression(struct expressionable *expressionable, void **node_out)
+bool expressionable_op_binds_tighter(const char *op, int precedence)
 {
-    void *node = *node_out;
-    int node_type = expressionable_callbacks(expressionable)->get_node_type(expressionable, node);
-
-    if (node_type != EXPRESSIONABLE_GENERIC_TYPE_EXPRESSION)
+    struct expressionable_op_precedence_group *group = NULL;
+    int op_precedence = expressionable_parser_get_precedence_for_operator(op, &group);
+    if (op_precedence == -1)
     {
-        return;
+        return false;
     }
 
-    void *left_node = expressionable_callbacks(expressionable)->get_left_node(expressionable, node);
-    void *right_node = expressionable_callbacks(expressionable)->get_right_node(expressionable, node);
-
-    int left_node_type = expressionable_callbacks(expressionable)->get_node_type(expressionable, left_node);
-    int right_node_type = expressionable_callbacks(expressionable)->get_node_type(expressionable, right_node);
-    assert(left_node_type >= 0);
-    assert(right_node_type >= 0);
-
-    if (left_node_type != EXPRESSIONABLE_GENERIC_TYPE_EXPRESSION && right_node &&
-        right_node_type != EXPRESSIONABLE_GENERIC_TYPE_EXPRESSION)
+    // Postfix and access operators always attach to the operand before them, a.b.c is a.(b.c)
+    if (op_precedence == 0)
     {
-        return;
+        return true;
     }
 
-    if (left_node_type != EXPRESSIONABLE_GENERIC_TYPE_EXPRESSION && right_node &&
-        right_node_type == EXPRESSIONABLE_GENERIC_TYPE_EXPRESSION)
-    {
-        const char *right_op = expressionable_callbacks(expressionable)->get_node_operator(expressionable, right_node);
-        const char *main_op = expressionable_callbacks(expressionable)->get_node_operator(expressionable, node);
-
-        if (expressionable_parser_left_op_has_priority(main_op, right_op))
-        {
-            expressionable_parser_node_shift_children_left(expressionable, node);
-
-            void **address_of_left = expressionable_callbacks(expressionable)->get_left_node_address(expressionable, node);
-            void **address_of_right = expressionable_callbacks(expressionable)->get_right_node_address(expressionable, node);
-            expressionable_parser_reorder_expression(expressionable, address_of_left);
-            expressionable_parser_reorder_expression(expressionable, address_of_right);
-        }
-    }
+    return op_precedence < precedence ||
+           (op_precedence == precedence && group->associtivity == ASSOCIATIVITY_RIGHT_TO_LEFT);
 }
 
 bool expressionable_generic_type_is_value_expressionable(int type)
@@ -254,13 +196,41 @@ void expressionable_expect_sym(struct expressionable *expressionable, char c)
     }
 }
 
-void expressionable_deal_with_additional_expression(struct expressionable *expressionable)
+/**
+ * Parses a single operand and then absorbs every following operator that binds tighter
+ * than the given precedence. This is precedence climbing, the tree comes out correct in one pass.
+ */
+void expressionable_parse_right_operand(struct expressionable *expressionable, int precedence)
 {
-    if (is_operator_token(expressionable_peek_next(expressionable)))
+    struct token *next_token = expressionable_peek_next(expressionable);
+    if (is_operator_token(next_token))
+    {
+        if (S_EQ(next_token->sval, "("))
+        {
+            expressionable_parse_parentheses(expressionable);
+        }
+        else if (is_unary_operator(next_token->sval))
+        {
+            expressionable_parse_unary(expressionable);
+        }
+        else
+        {
+            expressionable_error(expressionable, "Two operators are not expected for the given expression");
+        }
+    }
+    else
+    {
+        expressionable_parse_single(expressionable);
+    }
+
+    next_token = expressionable_peek_next(expressionable);
+    while (is_operator_token(next_token) && expressionable_op_binds_tighter(next_token->sval, precedence))
     {
-        expressionable_parse(expressionable);
+        expressionable_parse_exp(expressionable, next_token);
+        next_token = expressionable_peek_next(expressionable);
     }
 }
+
 void expressionable_parse_parentheses(struct expressionable *expressionable)
 {
     void *left_node = NULL;
@@ -282,7 +252,6 @@ void expressionable_parse_parentheses(struct expressionable *expressionable)
         void *parentheses_node = expressionable_node_pop(expressionable);
         expressionable_callbacks(expressionable)->make_expression_node(expressionable, left_node, parentheses_node, "()");
     }
-    expressionable_deal_with_additional_expression(expressionable);
 }
 
 int expressionable_get_pointer_depth(struct expressionable *expressionable)
@@ -300,7 +269,7 @@ int expressionable_get_pointer_depth(struct expressionable *expressionable)
 void expressionable_parse_for_indirection_unary(struct expressionable *expressionable)
 {
     int depth = expressionable_get_pointer_depth(expressionable);
-    expressionable_parse(expressionable);
+    expressionable_parse_right_operand(expressionable, EXPRESSIONABLE_UNARY_PRECEDENCE);
 
     void *unary_operand_node = expressionable_node_pop(expressionable);
     expressionable_callbacks(expressionable)->make_unary_indirection_node(expressionable, depth, unary_operand_node);
@@ -308,7 +277,7 @@ void expressionable_parse_for_indirection_unary(struct expressionable *expressio
 void expressionable_parse_for_normal_unary(struct expressionable *expressionable)
 {
     const char *unary_op = expressionable_token_next(expressionable)->sval;
-    expressionable_parse(expressionable);
+    expressionable_parse_right_operand(expressionable, EXPRESSIONABLE_UNARY_PRECEDENCE);
 
     void *unary_operand_node = expressionable_node_pop(expressionable);
     expressionable_callbacks(expressionable)->make_unary_node(expressionable, unary_op, unary_operand_node);
@@ -324,8 +293,6 @@ void expressionable_parse_unary(struct expressionable *expressionable)
     }
 
     expressionable_parse_for_normal_unary(expressionable);
-
-    expressionable_deal_with_additional_expression(expressionable);
 }
 void expressionable_parse_for_operator(struct expressionable *expressionable)
 {
@@ -350,32 +317,11 @@ void expressionable_parse_for_operator(struct expressionable *expressionable)
     // Pop the left node
     expressionable_node_pop(expressionable);
 
-    if (expressionable_peek_next(expressionable)->type == TOKEN_TYPE_OPERATOR)
-    {
-        if (S_EQ(expressionable_peek_next(expressionable)->sval, "("))
-        {
-            expressionable_parse_parentheses(expressionable);
-        }
-        else if (is_unary_operator(expressionable_peek_next(expressionable)->sval))
-        {
-             expressionable_parse_unary(expressionable);
-        }
-        else
-        {
-            expressionable_error(expressionable, "Two operators are not expected for the given expression");
-        }
-    }
-    else
-    {
-        // Parse the right operand.
-        expressionable_parse(expressionable);
-    }
+    // Parse the right operand.
+    expressionable_parse_right_operand(expressionable, expressionable_op_precedence(op));
 
     void *node_right = expressionable_node_pop(expressionable);
     expressionable_callbacks(expressionable)->make_expression_node(expressionable, node_left, node_right, op);
-    void *exp_node = expressionable_node_pop(expressionable);
-    expressionable_parser_reorder_expression(expressionable, &exp_node);
-    expressionable_node_push(expressionable, exp_node);
 }
 
 void expressionable_parse_tenary(struct expressionable* expressionable)
@@ -433,7 +379,7 @@ int expressionable_parse_token(struct expressionable *expressionable, struct tok
         break;
 
     case TOKEN_TYPE_OPERATOR:
-        expressionable_parse_exp(expressionable, token);
+        res = expressionable_parse_exp(expressionable, token);
         break;
     }
 
@@ -451,7 +397,7 @@ int expressionable_parse_single_with_flags(struct expressionable *expressionable
     if (expressionable_callbacks(expressionable)->is_custom_operator(expressionable, token))
     {
         token->flags |= TOKEN_FLAG_IS_CUSTOM_OPERATOR;
-        expressionable_parse_exp(expressionable, token);
+        res = expressionable_parse_exp(expressionable, token);
     }
     else
     {
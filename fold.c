@@ -0,0 +1,550 @@
+#include "compiler.h"
+#include "helpers/vector.h"
+#include <stdlib.h>
+#include <limits.h>
+
+/**
+ * Constant folding over the parsed tree.
+ *
+ * Expressions, unary operators and casts whose operands are all numbers collapse into a single number node,
+ * evaluated with the same arithmetic as the preprocessor. Identities such as x+0, x*1, x*0 and x-x are applied
+ * when the type of x is known to be an integer or pointer, the operand of a removed x must have no side effects.
+ *
+ * Numbers are 32 bit ints to the code generator so folding wraps the same way the generated code does,
+ * anything that would not be defined at runtime i.e division by zero is left alone.
+ */
+
+enum
+{
+    FOLD_TYPE_UNKNOWN,
+    FOLD_TYPE_INTEGER,
+    FOLD_TYPE_POINTER
+};
+
+struct fold_process
+{
+    struct compile_process *compiler;
+
+    // struct node* variables visible at the current position, innermost last
+    struct vector *visible;
+};
+
+static struct node *fold_node(struct fold_process *process, struct node *node);
+
+static struct node *fold_find(struct fold_process *process, const char *name)
+{
+    for (int i = vector_count(process->visible) - 1; i >= 0; i--)
+    {
+        struct node *var_node = *(struct node **)vector_at(process->visible, i);
+        if (S_EQ(var_node->var.name, name))
+        {
+            return var_node;
+        }
+    }
+
+    return NULL;
+}
+
+static bool fold_is_number(struct node *node)
+{
+    if (node->type != NODE_TYPE_NUMBER)
+    {
+        return false;
+    }
+
+    // Literals too large for an int are not ints
+    long long value = (long long)node->llnum;
+    return value >= INT_MIN && value <= INT_MAX;
+}
+
+static bool fold_is_number_of(struct node *node, int value)
+{
+    return fold_is_number(node) && (int)node->llnum == value;
+}
+
+static struct node *fold_to_number(struct node *node, int value)
+{
+    node->type = NODE_TYPE_NUMBER;
+    node->llnum = (long long)value;
+    return node;
+}
+
+static int fold_datatype_type(struct datatype *dtype)
+{
+    if (dtype->flags & DATATYPE_FLAG_IS_ARRAY)
+    {
+        return FOLD_TYPE_UNKNOWN;
+    }
+
+    if (dtype->flags & DATATYPE_FLAG_IS_POINTER)
+    {
+        return FOLD_TYPE_POINTER;
+    }
+
+    switch (dtype->type)
+    {
+    case DATA_TYPE_CHAR:
+    case DATA_TYPE_SHORT:
+    case DATA_TYPE_INTEGER:
+    case DATA_TYPE_LONG:
+        return FOLD_TYPE_INTEGER;
+    }
+
+    return FOLD_TYPE_UNKNOWN;
+}
+
+/**
+ * The type of the value the node computes as far as the identities care
+ */
+static int fold_type(struct fold_process *process, struct node *node)
+{
+    struct node *var_node = NULL;
+    int left = FOLD_TYPE_UNKNOWN;
+    int right = FOLD_TYPE_UNKNOWN;
+    switch (node->type)
+    {
+    case NODE_TYPE_NUMBER:
+        return fold_is_number(node) ? FOLD_TYPE_INTEGER : FOLD_TYPE_UNKNOWN;
+
+    case NODE_TYPE_IDENTIFIER:
+        var_node = fold_find(process, node->sval);
+        return var_node ? fold_datatype_type(var_node->var.type) : FOLD_TYPE_UNKNOWN;
+
+    case NODE_TYPE_EXPRESSION_PARENTHESES:
+        return fold_type(process, node->parenthesis.exp);
+
+    case NODE_TYPE_CAST:
+        return fold_datatype_type(node->cast.dtype);
+
+    case NODE_TYPE_UNARY:
+        if (S_EQ(node->unary.op, "-") || S_EQ(node->unary.op, "~") || S_EQ(node->unary.op, "!"))
+        {
+            return fold_type(process, node->unary.operand) == FOLD_TYPE_INTEGER ? FOLD_TYPE_INTEGER : FOLD_TYPE_UNKNOWN;
+        }
+        break;
+
+    case NODE_TYPE_EXPRESSION:
+        if (is_node_assignment(node) || is_access_node(node) || is_array_node(node) || is_parentheses_node(node) || is_argument_node(node))
+        {
+            break;
+        }
+
+        left = fold_type(process, node->exp.left);
+        right = fold_type(process, node->exp.right);
+        if (left == FOLD_TYPE_INTEGER && right == FOLD_TYPE_INTEGER)
+        {
+            return FOLD_TYPE_INTEGER;
+        }
+
+        // Pointer arithmetic, the difference of two pointers is a count
+        if (S_EQ(node->exp.op, "+") && left + right == FOLD_TYPE_INTEGER + FOLD_TYPE_POINTER)
+        {
+            return FOLD_TYPE_POINTER;
+        }
+
+        if (S_EQ(node->exp.op, "-") && left == FOLD_TYPE_POINTER)
+        {
+            return right == FOLD_TYPE_INTEGER ? FOLD_TYPE_POINTER : (right == FOLD_TYPE_POINTER ? FOLD_TYPE_INTEGER : FOLD_TYPE_UNKNOWN);
+        }
+        break;
+    }
+
+    return FOLD_TYPE_UNKNOWN;
+}
+
+/**
+ * True if evaluating the node only reads, nothing is assigned, incremented or called
+ */
+static bool fold_is_pure(struct node *node)
+{
+    switch (node->type)
+    {
+    case NODE_TYPE_NUMBER:
+    case NODE_TYPE_IDENTIFIER:
+    case NODE_TYPE_STRING:
+        return true;
+
+    case NODE_TYPE_EXPRESSION_PARENTHESES:
+        return fold_is_pure(node->parenthesis.exp);
+
+    case NODE_TYPE_CAST:
+        return fold_is_pure(node->cast.operand);
+
+    case NODE_TYPE_UNARY:
+        return !S_EQ(node->unary.op, "++") && !S_EQ(node->unary.op, "--") && fold_is_pure(node->unary.operand);
+
+    case NODE_TYPE_EXPRESSION:
+        if (is_node_assignment(node) || is_parentheses_node(node) || S_EQ(node->exp.op, "?"))
+        {
+            return false;
+        }
+
+        if (is_access_node(node))
+        {
+            // The right operand is a member name
+            return fold_is_pure(node->exp.left);
+        }
+
+        if (is_array_node(node))
+        {
+            return fold_is_pure(node->exp.left) && fold_is_pure(node->exp.right->bracket.inner);
+        }
+
+        return fold_is_pure(node->exp.left) && fold_is_pure(node->exp.right);
+    }
+
+    return false;
+}
+
+static bool fold_is_same(struct node *left, struct node *right)
+{
+    if (left->type != right->type)
+    {
+        return false;
+    }
+
+    switch (left->type)
+    {
+    case NODE_TYPE_NUMBER:
+        return left->llnum == right->llnum;
+
+    case NODE_TYPE_IDENTIFIER:
+        return S_EQ(left->sval, right->sval);
+
+    case NODE_TYPE_EXPRESSION_PARENTHESES:
+        return fold_is_same(left->parenthesis.exp, right->parenthesis.exp);
+
+    case NODE_TYPE_EXPRESSION:
+        return S_EQ(left->exp.op, right->exp.op) && !is_access_node(left) && !is_array_node(left) &&
+               fold_is_same(left->exp.left, right->exp.left) && fold_is_same(left->exp.right, right->exp.right);
+    }
+
+    return false;
+}
+
+/**
+ * Evaluates two numbers, false when the operation is not defined for them or is not arithmetic at all
+ */
+static bool fold_evaluate(struct fold_process *process, const char *op, int left, int right, int *result)
+{
+    if ((S_EQ(op, "/") || S_EQ(op, "%")) && (right == 0 || (left == INT_MIN && right == -1)))
+    {
+        return false;
+    }
+
+    if ((S_EQ(op, "<<") || S_EQ(op, ">>")) && (right < 0 || right >= 32))
+    {
+        return false;
+    }
+
+    bool success = false;
+    *result = (int)arithmetic(process->compiler, left, right, op, &success);
+    return success;
+}
+
+static struct node *fold_identity(struct fold_process *process, struct node *node)
+{
+    struct node *left = node->exp.left;
+    struct node *right = node->exp.right;
+    const char *op = node->exp.op;
+    int left_type = fold_type(process, left);
+    int right_type = fold_type(process, right);
+
+    // x+0, x-0 and 0+x hold for pointers too
+    if ((S_EQ(op, "+") || S_EQ(op, "-")) && fold_is_number_of(right, 0) && left_type != FOLD_TYPE_UNKNOWN)
+    {
+        return left;
+    }
+
+    if (S_EQ(op, "+") && fold_is_number_of(left, 0) && right_type != FOLD_TYPE_UNKNOWN)
+    {
+        return right;
+    }
+
+    if (S_EQ(op, "-") && left_type != FOLD_TYPE_UNKNOWN && left_type == right_type && fold_is_pure(left) && fold_is_same(left, right))
+    {
+        return fold_to_number(node, 0);
+    }
+
+    if ((S_EQ(op, "|") || S_EQ(op, "^") || S_EQ(op, "<<") || S_EQ(op, ">>")) && fold_is_number_of(right, 0) && left_type == FOLD_TYPE_INTEGER)
+    {
+        return left;
+    }
+
+    if ((S_EQ(op, "*") || S_EQ(op, "/")) && fold_is_number_of(right, 1) && left_type == FOLD_TYPE_INTEGER)
+    {
+        return left;
+    }
+
+    if (S_EQ(op, "*") && fold_is_number_of(left, 1) && right_type == FOLD_TYPE_INTEGER)
+    {
+        return right;
+    }
+
+    if ((S_EQ(op, "*") || S_EQ(op, "&")) && left_type == FOLD_TYPE_INTEGER && right_type == FOLD_TYPE_INTEGER &&
+        (fold_is_number_of(left, 0) || fold_is_number_of(right, 0)) && fold_is_pure(left) && fold_is_pure(right))
+    {
+        return fold_to_number(node, 0);
+    }
+
+    return node;
+}
+
+static struct node *fold_expression(struct fold_process *process, struct node *node)
+{
+    if (is_access_node(node))
+    {
+        // The right operand is a member name rather than a value
+        node->exp.left = fold_node(process, node->exp.left);
+        return node;
+    }
+
+    if (is_parentheses_node(node))
+    {
+        // The arguments of a call keep their parentheses node
+        node->exp.left = fold_node(process, node->exp.left);
+        node->exp.right->parenthesis.exp = fold_node(process, node->exp.right->parenthesis.exp);
+        return node;
+    }
+
+    node->exp.left = fold_node(process, node->exp.left);
+    node->exp.right = fold_node(process, node->exp.right);
+    if (is_node_assignment(node) || is_array_node(node) || is_argument_node(node))
+    {
+        return node;
+    }
+
+    int result = 0;
+    if (fold_is_number(node->exp.left) && fold_is_number(node->exp.right) &&
+        fold_evaluate(process, node->exp.op, (int)node->exp.left->llnum, (int)node->exp.right->llnum, &result))
+    {
+        return fold_to_number(node, result);
+    }
+
+    return fold_identity(process, node);
+}
+
+static struct node *fold_unary(struct fold_process *process, struct node *node)
+{
+    node->unary.operand = fold_node(process, node->unary.operand);
+    if (!fold_is_number(node->unary.operand))
+    {
+        return node;
+    }
+
+    int value = (int)node->unary.operand->llnum;
+    if (S_EQ(node->unary.op, "-"))
+    {
+        // Wraps like neg does
+        return fold_to_number(node, (int)(0u - (unsigned int)value));
+    }
+    else if (S_EQ(node->unary.op, "~"))
+    {
+        return fold_to_number(node, ~value);
+    }
+    else if (S_EQ(node->unary.op, "!"))
+    {
+        return fold_to_number(node, !value);
+    }
+
+    return node;
+}
+
+static struct node *fold_cast(struct fold_process *process, struct node *node)
+{
+    node->cast.operand = fold_node(process, node->cast.operand);
+    struct datatype *dtype = node->cast.dtype;
+    if (!fold_is_number(node->cast.operand) || fold_datatype_type(dtype) != FOLD_TYPE_INTEGER)
+    {
+        return node;
+    }
+
+    // Truncate the same way codegen_reduce_register does
+    int value = (int)node->cast.operand->llnum;
+    bool is_signed = dtype->flags & DATATYPE_FLAG_IS_SIGNED;
+    switch (datatype_size(dtype))
+    {
+    case DATA_SIZE_BYTE:
+        return fold_to_number(node, is_signed ? (int)(signed char)value : (int)(unsigned char)value);
+
+    case DATA_SIZE_WORD:
+        return fold_to_number(node, is_signed ? (int)(short)value : (int)(unsigned short)value);
+
+    case DATA_SIZE_DWORD:
+        // An unsigned int does not fit our int numbers
+        if (is_signed)
+        {
+            return fold_to_number(node, value);
+        }
+        break;
+    }
+
+    return node;
+}
+
+static void fold_variable(struct fold_process *process, struct node *node)
+{
+    // The initializer cannot see the variable it initializes
+    if (node->var.val)
+    {
+        node->var.val = fold_node(process, node->var.val);
+    }
+    vector_push(process->visible, &node);
+}
+
+static void fold_body(struct fold_process *process, struct node *node)
+{
+    int total_visible = vector_count(process->visible);
+    for (int i = 0; i < vector_count(node->body.statements); i++)
+    {
+        struct node **statement = vector_at(node->body.statements, i);
+        *statement = fold_node(process, *statement);
+    }
+
+    while (vector_count(process->visible) > total_visible)
+    {
+        vector_pop(process->visible);
+    }
+}
+
+static void fold_function(struct fold_process *process, struct node *node)
+{
+    if (!node->func->body_n)
+    {
+        return;
+    }
+
+    int total_visible = vector_count(process->visible);
+    struct vector *args = function_node_argument_vec(node);
+    for (int i = 0; i < vector_count(args); i++)
+    {
+        vector_push(process->visible, vector_at(args, i));
+    }
+
+    fold_body(process, node->func->body_n);
+    while (vector_count(process->visible) > total_visible)
+    {
+        vector_pop(process->visible);
+    }
+}
+
+/**
+ * Folds everything below the node, returns the node to use in its place
+ */
+static struct node *fold_node(struct fold_process *process, struct node *node)
+{
+    if (!node)
+    {
+        return NULL;
+    }
+
+    int total_visible = 0;
+    switch (node->type)
+    {
+    case NODE_TYPE_EXPRESSION:
+        return fold_expression(process, node);
+
+    case NODE_TYPE_EXPRESSION_PARENTHESES:
+        node->parenthesis.exp = fold_node(process, node->parenthesis.exp);
+        return node->parenthesis.exp->type == NODE_TYPE_NUMBER ? node->parenthesis.exp : node;
+
+    case NODE_TYPE_UNARY:
+        return fold_unary(process, node);
+
+    case NODE_TYPE_CAST:
+        return fold_cast(process, node);
+
+    case NODE_TYPE_TENARY:
+        node->tenary.true_node = fold_node(process, node->tenary.true_node);
+        node->tenary.false_node = fold_node(process, node->tenary.false_node);
+        break;
+
+    case NODE_TYPE_BRACKET:
+        node->bracket.inner = fold_node(process, node->bracket.inner);
+        break;
+
+    case NODE_TYPE_VARIABLE:
+        fold_variable(process, node);
+        break;
+
+    case NODE_TYPE_VARIABLE_LIST:
+        for (int i = 0; i < vector_count(node->var_list.list); i++)
+        {
+            fold_variable(process, *(struct node **)vector_at(node->var_list.list, i));
+        }
+        break;
+
+    case NODE_TYPE_STRUCT:
+    case NODE_TYPE_UNION:
+        // Members are not variables in scope, only a variable declared with the type is
+        if (node->type == NODE_TYPE_STRUCT ? node->_struct.var : node->_union.var)
+        {
+            fold_variable(process, node->type == NODE_TYPE_STRUCT ? node->_struct.var : node->_union.var);
+        }
+        break;
+
+    case NODE_TYPE_FUNCTION:
+        fold_function(process, node);
+        break;
+
+    case NODE_TYPE_BODY:
+        fold_body(process, node);
+        break;
+
+    case NODE_TYPE_STATEMENT_RETURN:
+        node->stmt.return_stmt.exp = fold_node(process, node->stmt.return_stmt.exp);
+        break;
+
+    case NODE_TYPE_STATEMENT_IF:
+        node->stmt.if_stmt.cond_node = fold_node(process, node->stmt.if_stmt.cond_node);
+        fold_node(process, node->stmt.if_stmt.body_node);
+        fold_node(process, node->stmt.if_stmt.next);
+        break;
+
+    case NODE_TYPE_STATEMENT_ELSE:
+        fold_node(process, node->stmt.else_stmt.body_node);
+        break;
+
+    case NODE_TYPE_STATEMENT_WHILE:
+        node->stmt.while_stmt.exp_node = fold_node(process, node->stmt.while_stmt.exp_node);
+        fold_node(process, node->stmt.while_stmt.body_node);
+        break;
+
+    case NODE_TYPE_STATEMENT_DO_WHILE:
+        fold_node(process, node->stmt.do_while_stmt.body_node);
+        node->stmt.do_while_stmt.exp_node = fold_node(process, node->stmt.do_while_stmt.exp_node);
+        break;
+
+    case NODE_TYPE_STATEMENT_FOR:
+        // A variable declared by the loop is only visible inside it
+        total_visible = vector_count(process->visible);
+        node->stmt.for_stmt.init_node = fold_node(process, node->stmt.for_stmt.init_node);
+        node->stmt.for_stmt.cond_node = fold_node(process, node->stmt.for_stmt.cond_node);
+        node->stmt.for_stmt.loop_node = fold_node(process, node->stmt.for_stmt.loop_node);
+        fold_node(process, node->stmt.for_stmt.body_node);
+        while (vector_count(process->visible) > total_visible)
+        {
+            vector_pop(process->visible);
+        }
+        break;
+
+    case NODE_TYPE_STATEMENT_SWITCH:
+        node->stmt.switch_stmt.exp = fold_node(process, node->stmt.switch_stmt.exp);
+        fold_node(process, node->stmt.switch_stmt.body);
+        break;
+    }
+
+    return node;
+}
+
+void fold_constants(struct compile_process *process)
+{
+    struct fold_process fold = {.compiler = process};
+    fold.visible = vector_create(sizeof(struct node *));
+    for (int i = 0; i < vector_count(process->node_tree_vec); i++)
+    {
+        struct node **node = vector_at(process->node_tree_vec, i);
+        *node = fold_node(&fold, *node);
+    }
+    vector_free(fold.visible);
+}
@@ -1,10 +1,23 @@
 #include "compiler.h"
 #include "helpers/vector.h"
+#include "helpers/hashmap.h"
 #include <assert.h>
+#include <string.h>
+
+void *history_init(void *history, const void *parent, size_t size, int flags)
+{
+    if (parent)
+    {
+        memcpy(history, parent, size);
+    }
+    *(int *)history = flags;
+    return history;
+}
+
 size_t variable_size(struct node *var_node)
 {
     assert(var_node->type == NODE_TYPE_VARIABLE);
-    return datatype_size(&var_node->var.type);
+    return datatype_size(var_node->var.type);
 }
 
 struct datatype* datatype_thats_a_pointer(struct datatype* d1, struct datatype* d2)
@@ -34,15 +47,14 @@ bool is_logical_node(struct node* node)
 
 struct datatype* datatype_pointer_reduce(struct datatype* datatype, int by)
 {
-    struct datatype* new_datatype = calloc(1, sizeof(struct datatype));
-    memcpy(new_datatype, datatype, sizeof(struct datatype));
-    new_datatype->pointer_depth -= by;
-    if (new_datatype->pointer_depth <= 0)
+    struct datatype new_datatype = *datatype;
+    new_datatype.pointer_depth -= by;
+    if (new_datatype.pointer_depth <= 0)
     {
-        new_datatype->flags &= ~DATATYPE_FLAG_IS_POINTER;
-        new_datatype->pointer_depth = 0;
+        new_datatype.flags &= ~DATATYPE_FLAG_IS_POINTER;
+        new_datatype.pointer_depth = 0;
     }
-    return new_datatype;
+    return datatype_canonical(&new_datatype);
 }
 
 
@@ -68,15 +80,15 @@ struct node *variable_struct_or_union_body_node(struct node *node)
         return NULL;
     }
 
-    if (node->var.type.type == DATA_TYPE_STRUCT)
+    if (node->var.type->type == DATA_TYPE_STRUCT)
     {
-        return node->var.type.struct_node->_struct.body_n;
+        return node->var.type->struct_node->_struct.body_n;
     }
 
     // return the union body.
-    if (node->var.type.type == DATA_TYPE_UNION)
+    if (node->var.type->type == DATA_TYPE_UNION)
     {
-        return node->var.type.union_node->_union.body_n;
+        return node->var.type->union_node->_union.body_n;
     }
     return NULL;
 }
@@ -132,7 +144,7 @@ int compute_sum_padding(struct vector *vec)
         }
 
         padding += cur_node->var.padding;
-        last_type = cur_node->var.type.type;
+        last_type = cur_node->var.type->type;
         last_node = cur_node;
         cur_node = vector_peek_ptr(vec);
     }
@@ -194,53 +206,22 @@ struct node* variable_struct_or_union_largest_variable_node(struct node* var_nod
     return body_largest_variable_node(variable_struct_or_union_body_node(var_node));
 }
 
-int struct_offset(struct compile_process* compile_proc, const char* struct_name, const char* var_name, struct node** var_node_out, int last_pos, int flags)
+int struct_offset(struct compile_process* compile_proc, const char* struct_name, const char* var_name, struct node** var_node_out)
 {
     struct symbol* struct_sym = symresolver_get_symbol(compile_proc, struct_name);
     assert(struct_sym && struct_sym->type == SYMBOL_TYPE_NODE);
     struct node* node = struct_sym->data;
     assert(node_is_struct_or_union(node));
 
-    struct vector* struct_vars_vec = node->_struct.body_n->body.statements;
-    vector_set_peek_pointer(struct_vars_vec, 0);
-    if (flags & STRUCT_ACCESS_BACKWARDS)
+    struct struct_layout* layout = node->type == NODE_TYPE_UNION ? node->_union.layout : node->_struct.layout;
+    struct struct_layout_member* member = layout ? hashmap_get(layout->members_by_name, var_name) : NULL;
+    if (!member)
     {
-        vector_set_peek_pointer_end(struct_vars_vec);
-        vector_set_flag(struct_vars_vec, VECTOR_FLAG_PEEK_DECREMENT);
+        compiler_error(compile_proc, "%s has no member named %s", struct_name, var_name);
     }
 
-    struct node* var_node_cur = variable_node(vector_peek_ptr(struct_vars_vec));
-    struct node* var_node_last = NULL;
-    int position = last_pos;
-    *var_node_out = NULL;
-    while(var_node_cur)
-    {
-        *var_node_out = var_node_cur;
-        if (var_node_last)
-        {
-            position += variable_size(var_node_last);
-            if (variable_node_is_primitive(var_node_cur))
-            {
-                position = align_value_treat_positive(position, var_node_cur->var.type.size);
-            }
-            else
-            {
-                position = align_value_treat_positive(position, variable_struct_or_union_largest_variable_node(var_node_cur)->var.type.size);
-            }
-        }
-
-        // Have we found the variable? then we are done
-        if (S_EQ(var_node_cur->var.name, var_name))
-        {
-            break;
-        }
-
-        var_node_last = var_node_cur;
-        var_node_cur = variable_node(vector_peek_ptr(struct_vars_vec));
-    }
-
-    vector_unset_flag(struct_vars_vec, VECTOR_FLAG_PEEK_DECREMENT);
-    return position;
+    *var_node_out = member->var_node;
+    return member->offset;
 }
 
 bool is_access_operator(const char* op)
@@ -370,6 +351,10 @@ long arithmetic(struct compile_process* compiler, long left_operand, long right_
     {
         result = left_operand - right_operand;
     }
+    else if(S_EQ(op, "%"))
+    {
+        result = left_operand % right_operand;
+    }
     else if(S_EQ(op, "=="))
     {
         result = left_operand == right_operand;
@@ -402,6 +387,18 @@ long arithmetic(struct compile_process* compiler, long left_operand, long right_
     {
         result = left_operand >> right_operand;
     }
+    else if(S_EQ(op, "&"))
+    {
+        result = left_operand & right_operand;
+    }
+    else if(S_EQ(op, "|"))
+    {
+        result = left_operand | right_operand;
+    }
+    else if(S_EQ(op, "^"))
+    {
+        result = left_operand ^ right_operand;
+    }
     else if(S_EQ(op, "&&"))
     {
         result = left_operand && right_operand;
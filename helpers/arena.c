@@ -0,0 +1,90 @@
+#include "arena.h"
+#include "vector.h"
+#include <stdlib.h>
+#include <memory.h>
+
+struct arena* arena_create()
+{
+    struct arena* arena = calloc(1, sizeof(struct arena));
+    arena->vectors = vector_create(sizeof(struct vector*));
+    return arena;
+}
+
+static struct arena_block* arena_block_new(struct arena* arena, size_t size)
+{
+    struct arena_block* block = malloc(sizeof(struct arena_block) + size);
+    block->used = 0;
+    block->size = size;
+    block->next = arena->block;
+    arena->block = block;
+    return block;
+}
+
+void* arena_alloc(struct arena* arena, size_t size)
+{
+    size = (size + ARENA_ALIGNMENT - 1) & ~(size_t)(ARENA_ALIGNMENT - 1);
+    struct arena_block* block = arena->block;
+    if (!block || block->size - block->used < size)
+    {
+        block = arena_block_new(arena, size > ARENA_BLOCK_SIZE ? size : ARENA_BLOCK_SIZE);
+    }
+
+    void* ptr = &block->data[block->used];
+    block->used += size;
+    memset(ptr, 0, size);
+    return ptr;
+}
+
+struct vector* arena_vector_create(struct arena* arena, size_t esize)
+{
+    struct vector* vector = vector_create(esize);
+    vector_push(arena->vectors, &vector);
+    return vector;
+}
+
+struct arena_mark arena_mark(struct arena* arena)
+{
+    return (struct arena_mark){.block = arena->block, .used = arena->block ? arena->block->used : 0, .total_vectors = vector_count(arena->vectors)};
+}
+
+void arena_release(struct arena* arena, struct arena_mark* mark)
+{
+    while (vector_count(arena->vectors) > mark->total_vectors)
+    {
+        vector_free(vector_back_ptr(arena->vectors));
+        vector_pop(arena->vectors);
+    }
+
+    while (arena->block != mark->block)
+    {
+        struct arena_block* next = arena->block->next;
+        free(arena->block);
+        arena->block = next;
+    }
+
+    if (arena->block)
+    {
+        arena->block->used = mark->used;
+    }
+}
+
+void arena_free(struct arena* arena)
+{
+    vector_set_peek_pointer(arena->vectors, 0);
+    struct vector* vector = vector_peek_ptr(arena->vectors);
+    while(vector)
+    {
+        vector_free(vector);
+        vector = vector_peek_ptr(arena->vectors);
+    }
+    vector_free(arena->vectors);
+
+    struct arena_block* block = arena->block;
+    while(block)
+    {
+        struct arena_block* next = block->next;
+        free(block);
+        block = next;
+    }
+    free(arena);
+}
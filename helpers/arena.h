@@ -0,0 +1,65 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+// Each block holds 64KB of allocations, larger requests get a block of their own
+#define ARENA_BLOCK_SIZE 65536
+#define ARENA_ALIGNMENT 16
+
+struct vector;
+struct arena_block
+{
+    struct arena_block* next;
+    size_t used;
+    size_t size;
+    char data[];
+};
+
+/**
+ * A bump allocator, memory is only ever released all at once with arena_free
+ */
+struct arena
+{
+    // The block we are allocating from, older blocks follow on from "next"
+    struct arena_block* block;
+
+    // Vectors whose lifetime is tied to this arena. struct vector*
+    struct vector* vectors;
+};
+
+/**
+ * A position in an arena that it can later be released back to
+ */
+struct arena_mark
+{
+    struct arena_block* block;
+    size_t used;
+    int total_vectors;
+};
+
+struct arena* arena_create();
+
+/**
+ * Returns zeroed memory that lives until the arena is freed
+ */
+void* arena_alloc(struct arena* arena, size_t size);
+
+/**
+ * Creates a vector that is freed along with the arena
+ */
+struct vector* arena_vector_create(struct arena* arena, size_t esize);
+
+struct arena_mark arena_mark(struct arena* arena);
+
+/**
+ * Releases everything allocated since the mark was taken, the arena can be used again afterwards
+ */
+void arena_release(struct arena* arena, struct arena_mark* mark);
+
+/**
+ * Releases every allocation and vector owned by the arena, and the arena its self
+ */
+void arena_free(struct arena* arena);
+
+#endif
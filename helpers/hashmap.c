@@ -0,0 +1,90 @@
+#include "hashmap.h"
+#include <stdlib.h>
+#include <string.h>
+
+struct hashmap* hashmap_create()
+{
+    struct hashmap* map = calloc(1, sizeof(struct hashmap));
+    map->capacity = HASHMAP_INITIAL_CAPACITY;
+    map->entries = calloc(map->capacity, sizeof(struct hashmap_entry));
+    return map;
+}
+
+void hashmap_free(struct hashmap* map)
+{
+    free(map->entries);
+    free(map);
+}
+
+unsigned int hashmap_hash(const char* key)
+{
+    // FNV-1a
+    unsigned int hash = 2166136261u;
+    while (*key)
+    {
+        hash ^= (unsigned char)*key;
+        hash *= 16777619u;
+        key++;
+    }
+    return hash;
+}
+
+static struct hashmap_entry* hashmap_find_entry(struct hashmap_entry* entries, int capacity, const char* key, unsigned int hash)
+{
+    int index = hash & (capacity - 1);
+    while (entries[index].key)
+    {
+        if (entries[index].hash == hash && strcmp(entries[index].key, key) == 0)
+        {
+            break;
+        }
+        index = (index + 1) & (capacity - 1);
+    }
+
+    return &entries[index];
+}
+
+static void hashmap_grow(struct hashmap* map)
+{
+    int capacity = map->capacity * 2;
+    struct hashmap_entry* entries = calloc(capacity, sizeof(struct hashmap_entry));
+    for (int i = 0; i < map->capacity; i++)
+    {
+        struct hashmap_entry* old_entry = &map->entries[i];
+        if (!old_entry->key)
+        {
+            continue;
+        }
+
+        *hashmap_find_entry(entries, capacity, old_entry->key, old_entry->hash) = *old_entry;
+    }
+
+    free(map->entries);
+    map->entries = entries;
+    map->capacity = capacity;
+}
+
+void* hashmap_get(struct hashmap* map, const char* key)
+{
+    struct hashmap_entry* entry = hashmap_find_entry(map->entries, map->capacity, key, hashmap_hash(key));
+    return entry->value;
+}
+
+void hashmap_set(struct hashmap* map, const char* key, void* value)
+{
+    // Keep the load factor under 3/4 so probe sequences stay short
+    if ((map->count + 1) * 4 > map->capacity * 3)
+    {
+        hashmap_grow(map);
+    }
+
+    unsigned int hash = hashmap_hash(key);
+    struct hashmap_entry* entry = hashmap_find_entry(map->entries, map->capacity, key, hash);
+    if (!entry->key)
+    {
+        entry->key = key;
+        entry->hash = hash;
+        map->count++;
+    }
+    entry->value = value;
+}
@@ -0,0 +1,42 @@
+#ifndef HASHMAP_H
+#define HASHMAP_H
+
+#include <stdbool.h>
+
+// Capacity is always a power of two so we can mask instead of divide
+#define HASHMAP_INITIAL_CAPACITY 16
+
+struct hashmap_entry
+{
+    // NULL when the slot is empty
+    const char* key;
+    unsigned int hash;
+    void* value;
+};
+
+/**
+ * An open addressing hash map with linear probing, keyed on null terminated strings.
+ * Keys are not copied, they must outlive the map.
+ */
+struct hashmap
+{
+    struct hashmap_entry* entries;
+    int capacity;
+    int count;
+};
+
+struct hashmap* hashmap_create();
+void hashmap_free(struct hashmap* map);
+unsigned int hashmap_hash(const char* key);
+
+/**
+ * Returns the value stored for the given key or NULL if there is none
+ */
+void* hashmap_get(struct hashmap* map, const char* key);
+
+/**
+ * Stores the value for the given key, replacing any value that was there before
+ */
+void hashmap_set(struct hashmap* map, const char* key, void* value);
+
+#endif
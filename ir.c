@@ -0,0 +1,1977 @@
+#include "compiler.h"
+#include "helpers/vector.h"
+#include "helpers/hashmap.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <assert.h>
+
+/**
+ * SSA optimizer over the instructions of one function.
+ *
+ * The instructions are split into basic blocks joined by a control flow graph. Every write to a register,
+ * the flags or memory then becomes its own SSA value with phi nodes placed on the dominance frontiers, so each
+ * instruction reads as a three address operation from the values it uses to the values it defines,
+ * i.e add eax, ecx is eax2, flags1 = add eax1, ecx1.
+ *
+ * The passes rewrite the machine instructions in place, every pass works on a freshly built SSA form:
+ * -O1 runs sparse conditional constant propagation, copy propagation and dead code elimination.
+ * -O2 adds global value numbering, an instruction computing a value some register already holds is removed.
+ */
+
+enum
+{
+    IR_LOCATION_EAX,
+    IR_LOCATION_EBX,
+    IR_LOCATION_ECX,
+    IR_LOCATION_EDX,
+    IR_LOCATION_ESI,
+    IR_LOCATION_EDI,
+    IR_LOCATION_ESP,
+    IR_LOCATION_EBP,
+    IR_LOCATION_FLAGS,
+    // The stack frame slots at a fixed offset from ebp, nothing is ever pushed over them
+    IR_LOCATION_FRAME,
+    // Everything else in memory
+    IR_LOCATION_MEMORY,
+    IR_TOTAL_LOCATIONS
+};
+
+// eax through edi, the registers the passes are free to rewrite
+#define IR_GENERAL_REGISTERS 6
+#define IR_LOCATION_BIT(location) (1 << (location))
+#define IR_ALL_LOCATIONS ((1 << IR_TOTAL_LOCATIONS) - 1)
+
+enum
+{
+    IR_WIDTH_DWORD,
+    IR_WIDTH_WORD,
+    IR_WIDTH_BYTE
+};
+
+// Indexed by location then width, i.e eax, ax, al
+static const char *ir_registers[][3] = {
+    {"eax", "ax", "al"},
+    {"ebx", "bx", "bl"},
+    {"ecx", "cx", "cl"},
+    {"edx", "dx", "dl"},
+    {"esi", "si", NULL},
+    {"edi", "di", NULL},
+    {"esp", "sp", NULL},
+    {"ebp", "bp", NULL}};
+
+enum
+{
+    IR_LATTICE_TOP,
+    IR_LATTICE_CONSTANT,
+    IR_LATTICE_BOTTOM
+};
+
+struct ir_lattice
+{
+    int state;
+    uint32_t value;
+
+    // Flags are constant when both operands of the comparison are, value is the left one and this the right
+    uint32_t compared;
+};
+
+struct ir_value
+{
+    int location;
+
+    // Defining instruction, -1 for phis and the values the function is entered with
+    int instruction;
+
+    // Block of a phi, -1 otherwise
+    int phi_block;
+
+    // SSA value per predecessor of the phi block, -1 until renaming reaches it
+    int *phi_args;
+
+    int total_uses;
+    bool live;
+
+    // Value number, values with the same number hold the same bits whenever both are defined
+    int vn;
+    struct ir_lattice lattice;
+};
+
+struct ir_block
+{
+    // Instructions [start, end)
+    int start;
+    int end;
+
+    // int block indexes
+    struct vector *successors;
+    struct vector *predecessors;
+
+    // Set per predecessor by constant propagation when that edge can be taken
+    bool *edge_executable;
+    bool executable;
+
+    // Position in reverse postorder, -1 if the block cannot be reached
+    int rpo;
+    int idom;
+
+    // int block indexes of the blocks this one immediately dominates
+    struct vector *children;
+    struct vector *frontier;
+
+    // Phi value per location, -1 if there is none
+    int phis[IR_TOTAL_LOCATIONS];
+};
+
+struct ir_instruction
+{
+    int block;
+
+    // Location bit masks
+    int uses;
+    int defs;
+
+    // Value held by every location before the instruction runs
+    int in[IR_TOTAL_LOCATIONS];
+
+    // Value written per location, -1 if the location is left alone
+    int out[IR_TOTAL_LOCATIONS];
+
+    bool removed;
+    bool live;
+};
+
+struct ir_process
+{
+    // struct mir_instruction, the function being optimized
+    struct vector *instructions;
+
+    // One per instruction
+    struct ir_instruction *info;
+
+    // struct ir_block
+    struct vector *blocks;
+
+    // int block indexes in reverse postorder
+    struct vector *rpo;
+
+    // struct ir_value
+    struct vector *values;
+
+    // Label name to block index + 1
+    struct hashmap *labels;
+
+    int next_vn;
+};
+
+typedef bool (*IR_PASS)(struct ir_process *process);
+
+static struct mir_instruction *ir_mir(struct ir_process *process, int index)
+{
+    return vector_at(process->instructions, index);
+}
+
+static struct ir_block *ir_block(struct ir_process *process, int index)
+{
+    return vector_at(process->blocks, index);
+}
+
+static struct ir_value *ir_value(struct ir_process *process, int index)
+{
+    return vector_at(process->values, index);
+}
+
+static int ir_int_at(struct vector *vec, int index)
+{
+    return *(int *)vector_at(vec, index);
+}
+
+static bool ir_reachable(struct ir_process *process, int block)
+{
+    return ir_block(process, block)->rpo != -1;
+}
+
+/**
+ * Returns the location of the register or -1, the width tells if only part of it is named i.e al
+ */
+static int ir_register_location(const char *reg, int *width)
+{
+    for (int location = 0; location < IR_LOCATION_FLAGS; location++)
+    {
+        for (int w = IR_WIDTH_DWORD; w <= IR_WIDTH_BYTE; w++)
+        {
+            if (S_EQ(ir_registers[location][w], reg))
+            {
+                *width = w;
+                return location;
+            }
+        }
+    }
+
+    return -1;
+}
+
+static int ir_operand_location(struct mir_operand *operand, int *width)
+{
+    if (operand->type != MIR_OPERAND_REGISTER)
+    {
+        return -1;
+    }
+
+    return ir_register_location(operand->reg, width);
+}
+
+// A full eax through edi, the only register operands the passes rewrite
+static int ir_operand_general_register(struct mir_operand *operand)
+{
+    int width = 0;
+    int location = ir_operand_location(operand, &width);
+    if (location == -1 || location >= IR_GENERAL_REGISTERS || width != IR_WIDTH_DWORD)
+    {
+        return -1;
+    }
+
+    return location;
+}
+
+// The memory location the address reads from
+static int ir_address_memory(struct asm_address *address)
+{
+    if (S_EQ(address->base, "ebp") && !address->index && !(address->flags & ASM_ADDRESS_FLAG_BASE_IS_SYMBOL))
+    {
+        return IR_LOCATION_FRAME;
+    }
+
+    return IR_LOCATION_MEMORY;
+}
+
+static int ir_address_reads(struct asm_address *address)
+{
+    int width = 0;
+    int reads = 0;
+    int location = -1;
+    if (address->base && !(address->flags & ASM_ADDRESS_FLAG_BASE_IS_SYMBOL))
+    {
+        location = ir_register_location(address->base, &width);
+        reads |= location != -1 ? IR_LOCATION_BIT(location) : 0;
+    }
+
+    if (address->index)
+    {
+        location = ir_register_location(address->index, &width);
+        reads |= location != -1 ? IR_LOCATION_BIT(location) : 0;
+    }
+    return reads;
+}
+
+static int ir_operand_reads(struct mir_operand *operand)
+{
+    int width = 0;
+    int location = -1;
+    switch (operand->type)
+    {
+    case MIR_OPERAND_REGISTER:
+        location = ir_operand_location(operand, &width);
+        return location != -1 ? IR_LOCATION_BIT(location) : 0;
+
+    case MIR_OPERAND_MEMORY:
+        return ir_address_reads(&operand->address) | IR_LOCATION_BIT(ir_address_memory(&operand->address));
+    }
+
+    return 0;
+}
+
+/**
+ * The locations written by writing to the operand, writing only part of a register reads the rest of it
+ */
+static void ir_operand_writes(struct mir_operand *operand, int *uses, int *defs)
+{
+    int width = 0;
+    int location = -1;
+    switch (operand->type)
+    {
+    case MIR_OPERAND_REGISTER:
+        location = ir_operand_location(operand, &width);
+        if (location == -1)
+        {
+            return;
+        }
+        *defs |= IR_LOCATION_BIT(location);
+        if (width != IR_WIDTH_DWORD)
+        {
+            *uses |= IR_LOCATION_BIT(location);
+        }
+        break;
+
+    case MIR_OPERAND_MEMORY:
+        // Pointers can reach the frame so a store anywhere may change it
+        *uses |= ir_address_reads(&operand->address);
+        *defs |= IR_LOCATION_BIT(IR_LOCATION_FRAME) | IR_LOCATION_BIT(IR_LOCATION_MEMORY);
+        break;
+    }
+}
+
+static bool ir_is_comment(struct mir_instruction *instruction)
+{
+    return instruction->opcode == MIR_OPCODE_RAW && instruction->text[0] == ';';
+}
+
+static bool ir_is_one_operand_multiply(struct mir_instruction *instruction)
+{
+    return (instruction->opcode == MIR_OPCODE_IMUL || instruction->opcode == MIR_OPCODE_MUL) && instruction->operands[1].type == MIR_OPERAND_NONE;
+}
+
+/**
+ * Works out what the instruction reads and writes as location bit masks
+ */
+static void ir_effects(struct mir_instruction *instruction, int *uses, int *defs)
+{
+    struct mir_operand *first = &instruction->operands[0];
+    struct mir_operand *second = &instruction->operands[1];
+    *uses = 0;
+    *defs = 0;
+    switch (instruction->opcode)
+    {
+    case MIR_OPCODE_RAW:
+        if (!ir_is_comment(instruction))
+        {
+            // We cannot know what text does
+            *uses = IR_ALL_LOCATIONS;
+            *defs = IR_ALL_LOCATIONS;
+        }
+        break;
+
+    case MIR_OPCODE_LABEL:
+        break;
+
+    case MIR_OPCODE_PUSH:
+        *uses = ir_operand_reads(first) | IR_LOCATION_BIT(IR_LOCATION_ESP);
+        *defs = IR_LOCATION_BIT(IR_LOCATION_ESP) | IR_LOCATION_BIT(IR_LOCATION_MEMORY);
+        break;
+
+    case MIR_OPCODE_POP:
+        *uses = IR_LOCATION_BIT(IR_LOCATION_ESP) | IR_LOCATION_BIT(IR_LOCATION_MEMORY);
+        *defs = IR_LOCATION_BIT(IR_LOCATION_ESP);
+        ir_operand_writes(first, uses, defs);
+        break;
+
+    case MIR_OPCODE_MOV:
+    case MIR_OPCODE_MOVZX:
+    case MIR_OPCODE_MOVSX:
+        *uses = ir_operand_reads(second);
+        ir_operand_writes(first, uses, defs);
+        break;
+
+    case MIR_OPCODE_LEA:
+        *uses = ir_address_reads(&second->address);
+        ir_operand_writes(first, uses, defs);
+        break;
+
+    case MIR_OPCODE_IMUL:
+    case MIR_OPCODE_MUL:
+        if (ir_is_one_operand_multiply(instruction))
+        {
+            // edx:eax = eax * operand
+            *uses = ir_operand_reads(first) | IR_LOCATION_BIT(IR_LOCATION_EAX);
+            *defs = IR_LOCATION_BIT(IR_LOCATION_EAX) | IR_LOCATION_BIT(IR_LOCATION_EDX) | IR_LOCATION_BIT(IR_LOCATION_FLAGS);
+            break;
+        }
+        // Two operand imul is plain arithmetic
+        // fallthrough
+    case MIR_OPCODE_ADD:
+    case MIR_OPCODE_SUB:
+    case MIR_OPCODE_AND:
+    case MIR_OPCODE_OR:
+    case MIR_OPCODE_XOR:
+    case MIR_OPCODE_SAL:
+    case MIR_OPCODE_SAR:
+    case MIR_OPCODE_SHR:
+        *uses = ir_operand_reads(first) | ir_operand_reads(second);
+        *defs = IR_LOCATION_BIT(IR_LOCATION_FLAGS);
+        ir_operand_writes(first, uses, defs);
+        break;
+
+    case MIR_OPCODE_NEG:
+    case MIR_OPCODE_INC:
+    case MIR_OPCODE_DEC:
+        *defs = IR_LOCATION_BIT(IR_LOCATION_FLAGS);
+        // fallthrough
+    case MIR_OPCODE_NOT:
+        *uses = ir_operand_reads(first);
+        ir_operand_writes(first, uses, defs);
+        break;
+
+    case MIR_OPCODE_IDIV:
+    case MIR_OPCODE_DIV:
+        *uses = ir_operand_reads(first) | IR_LOCATION_BIT(IR_LOCATION_EAX) | IR_LOCATION_BIT(IR_LOCATION_EDX);
+        *defs = IR_LOCATION_BIT(IR_LOCATION_EAX) | IR_LOCATION_BIT(IR_LOCATION_EDX) | IR_LOCATION_BIT(IR_LOCATION_FLAGS);
+        break;
+
+    case MIR_OPCODE_CDQ:
+        *uses = IR_LOCATION_BIT(IR_LOCATION_EAX);
+        *defs = IR_LOCATION_BIT(IR_LOCATION_EDX);
+        break;
+
+    case MIR_OPCODE_CMP:
+        *uses = ir_operand_reads(first) | ir_operand_reads(second);
+        *defs = IR_LOCATION_BIT(IR_LOCATION_FLAGS);
+        break;
+
+    case MIR_OPCODE_SETCC:
+        *uses = IR_LOCATION_BIT(IR_LOCATION_FLAGS);
+        ir_operand_writes(first, uses, defs);
+        break;
+
+    case MIR_OPCODE_JMP:
+        *uses = ir_operand_reads(first);
+        break;
+
+    case MIR_OPCODE_JCC:
+        *uses = IR_LOCATION_BIT(IR_LOCATION_FLAGS);
+        break;
+
+    case MIR_OPCODE_CALL:
+        // Arguments are on the stack, the callee may read anything. ebx is not preserved by our own functions
+        *uses = IR_ALL_LOCATIONS;
+        *defs = IR_LOCATION_BIT(IR_LOCATION_EAX) | IR_LOCATION_BIT(IR_LOCATION_EBX) | IR_LOCATION_BIT(IR_LOCATION_ECX) |
+                IR_LOCATION_BIT(IR_LOCATION_EDX) | IR_LOCATION_BIT(IR_LOCATION_FLAGS) | IR_LOCATION_BIT(IR_LOCATION_FRAME) |
+                IR_LOCATION_BIT(IR_LOCATION_MEMORY);
+        break;
+
+    case MIR_OPCODE_RET:
+        *uses = IR_ALL_LOCATIONS;
+        break;
+
+    default:
+        *uses = IR_ALL_LOCATIONS;
+        *defs = IR_ALL_LOCATIONS;
+        break;
+    }
+}
+
+static int ir_new_value(struct ir_process *process, int location, int instruction, int phi_block)
+{
+    struct ir_value value = {.location = location, .instruction = instruction, .phi_block = phi_block, .vn = -1};
+    value.lattice.state = IR_LATTICE_TOP;
+    vector_push(process->values, &value);
+    return vector_count(process->values) - 1;
+}
+
+static int ir_label_block(struct ir_process *process, struct mir_operand *operand)
+{
+    if (operand->type != MIR_OPERAND_LABEL)
+    {
+        return -1;
+    }
+
+    return (int)(intptr_t)hashmap_get(process->labels, operand->label) - 1;
+}
+
+static void ir_add_edge(struct ir_process *process, int from, int to)
+{
+    struct ir_block *from_block = ir_block(process, from);
+    for (int i = 0; i < vector_count(from_block->successors); i++)
+    {
+        if (ir_int_at(from_block->successors, i) == to)
+        {
+            return;
+        }
+    }
+
+    vector_push(from_block->successors, &to);
+    vector_push(ir_block(process, to)->predecessors, &from);
+}
+
+static bool ir_ends_block(struct mir_instruction *instruction)
+{
+    return instruction->opcode == MIR_OPCODE_JMP || instruction->opcode == MIR_OPCODE_JCC || instruction->opcode == MIR_OPCODE_RET;
+}
+
+/**
+ * Splits the instructions into basic blocks, a block starts at every label and after every jump or return
+ */
+static void ir_build_blocks(struct ir_process *process)
+{
+    int total = vector_count(process->instructions);
+    for (int i = 0; i < total; i++)
+    {
+        struct mir_instruction *instruction = ir_mir(process, i);
+        bool leader = i == 0 || instruction->opcode == MIR_OPCODE_LABEL || ir_ends_block(ir_mir(process, i - 1));
+        if (leader)
+        {
+            struct ir_block block = {.start = i, .end = i, .rpo = -1, .idom = -1};
+            block.successors = vector_create(sizeof(int));
+            block.predecessors = vector_create(sizeof(int));
+            block.children = vector_create(sizeof(int));
+            block.frontier = vector_create(sizeof(int));
+            memset(block.phis, -1, sizeof(block.phis));
+            vector_push(process->blocks, &block);
+        }
+
+        int block_index = vector_count(process->blocks) - 1;
+        ir_block(process, block_index)->end = i + 1;
+        process->info[i].block = block_index;
+        if (instruction->opcode == MIR_OPCODE_LABEL)
+        {
+            hashmap_set(process->labels, instruction->text, (void *)(intptr_t)(block_index + 1));
+        }
+    }
+
+    int total_blocks = vector_count(process->blocks);
+    for (int b = 0; b < total_blocks; b++)
+    {
+        struct mir_instruction *last = ir_mir(process, ir_block(process, b)->end - 1);
+        if (last->opcode == MIR_OPCODE_RET)
+        {
+            continue;
+        }
+
+        if (last->opcode == MIR_OPCODE_JMP || last->opcode == MIR_OPCODE_JCC)
+        {
+            int target = ir_label_block(process, &last->operands[0]);
+            if (target != -1)
+            {
+                ir_add_edge(process, b, target);
+            }
+            else if (last->operands[0].type != MIR_OPERAND_LABEL)
+            {
+                // An indirect jump can land on any label
+                for (int i = 0; i < total_blocks; i++)
+                {
+                    if (ir_mir(process, ir_block(process, i)->start)->opcode == MIR_OPCODE_LABEL)
+                    {
+                        ir_add_edge(process, b, i);
+                    }
+                }
+            }
+
+            if (last->opcode == MIR_OPCODE_JMP)
+            {
+                continue;
+            }
+        }
+
+        if (b + 1 < total_blocks)
+        {
+            ir_add_edge(process, b, b + 1);
+        }
+    }
+
+    for (int b = 0; b < total_blocks; b++)
+    {
+        struct ir_block *block = ir_block(process, b);
+        block->edge_executable = calloc(vector_count(block->predecessors) + 1, sizeof(bool));
+    }
+}
+
+static void ir_postorder(struct ir_process *process, int b, bool *visited, struct vector *postorder)
+{
+    visited[b] = true;
+    struct ir_block *block = ir_block(process, b);
+    for (int i = 0; i < vector_count(block->successors); i++)
+    {
+        int successor = ir_int_at(block->successors, i);
+        if (!visited[successor])
+        {
+            ir_postorder(process, successor, visited, postorder);
+        }
+    }
+    vector_push(postorder, &b);
+}
+
+static int ir_intersect(struct ir_process *process, int first, int second)
+{
+    while (first != second)
+    {
+        while (ir_block(process, first)->rpo > ir_block(process, second)->rpo)
+        {
+            first = ir_block(process, first)->idom;
+        }
+        while (ir_block(process, second)->rpo > ir_block(process, first)->rpo)
+        {
+            second = ir_block(process, second)->idom;
+        }
+    }
+    return first;
+}
+
+/**
+ * Immediate dominators with the iterative algorithm of Cooper, Harvey and Kennedy, then the dominance frontiers
+ */
+static void ir_build_dominators(struct ir_process *process)
+{
+    int total_blocks = vector_count(process->blocks);
+    bool *visited = calloc(total_blocks, sizeof(bool));
+    struct vector *postorder = vector_create(sizeof(int));
+    ir_postorder(process, 0, visited, postorder);
+    free(visited);
+    for (int i = vector_count(postorder) - 1; i >= 0; i--)
+    {
+        int b = ir_int_at(postorder, i);
+        ir_block(process, b)->rpo = vector_count(process->rpo);
+        vector_push(process->rpo, &b);
+    }
+    vector_free(postorder);
+
+    ir_block(process, 0)->idom = 0;
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (int i = 1; i < vector_count(process->rpo); i++)
+        {
+            int b = ir_int_at(process->rpo, i);
+            struct ir_block *block = ir_block(process, b);
+            int new_idom = -1;
+            for (int p = 0; p < vector_count(block->predecessors); p++)
+            {
+                int predecessor = ir_int_at(block->predecessors, p);
+                if (ir_block(process, predecessor)->idom == -1)
+                {
+                    continue;
+                }
+                new_idom = new_idom == -1 ? predecessor : ir_intersect(process, predecessor, new_idom);
+            }
+
+            if (new_idom != block->idom)
+            {
+                block->idom = new_idom;
+                changed = true;
+            }
+        }
+    }
+
+    for (int i = 1; i < vector_count(process->rpo); i++)
+    {
+        int b = ir_int_at(process->rpo, i);
+        vector_push(ir_block(process, ir_block(process, b)->idom)->children, &b);
+    }
+
+    for (int i = 0; i < vector_count(process->rpo); i++)
+    {
+        int b = ir_int_at(process->rpo, i);
+        struct ir_block *block = ir_block(process, b);
+        if (vector_count(block->predecessors) < 2)
+        {
+            continue;
+        }
+
+        for (int p = 0; p < vector_count(block->predecessors); p++)
+        {
+            int runner = ir_int_at(block->predecessors, p);
+            while (ir_reachable(process, runner) && runner != block->idom)
+            {
+                struct ir_block *runner_block = ir_block(process, runner);
+                bool present = false;
+                for (int f = 0; f < vector_count(runner_block->frontier); f++)
+                {
+                    present |= ir_int_at(runner_block->frontier, f) == b;
+                }
+
+                if (!present)
+                {
+                    vector_push(runner_block->frontier, &b);
+                }
+                runner = runner_block->idom;
+            }
+        }
+    }
+}
+
+/**
+ * Places phis on the iterated dominance frontier of the blocks writing each location.
+ * The entry block counts as writing everything as the function is entered with unknown values.
+ */
+static void ir_place_phis(struct ir_process *process)
+{
+    int total_blocks = vector_count(process->blocks);
+    bool *queued = calloc(total_blocks, sizeof(bool));
+    struct vector *worklist = vector_create(sizeof(int));
+    for (int location = 0; location < IR_TOTAL_LOCATIONS; location++)
+    {
+        memset(queued, 0, total_blocks * sizeof(bool));
+        for (int i = 0; i < vector_count(process->rpo); i++)
+        {
+            int b = ir_int_at(process->rpo, i);
+            struct ir_block *block = ir_block(process, b);
+            bool writes = b == 0;
+            for (int index = block->start; index < block->end && !writes; index++)
+            {
+                int uses = 0;
+                int defs = 0;
+                ir_effects(ir_mir(process, index), &uses, &defs);
+                writes = defs & IR_LOCATION_BIT(location);
+            }
+
+            if (writes)
+            {
+                queued[b] = true;
+                vector_push(worklist, &b);
+            }
+        }
+
+        while (vector_count(worklist))
+        {
+            int b = *(int *)vector_back(worklist);
+            vector_pop(worklist);
+            struct ir_block *block = ir_block(process, b);
+            for (int f = 0; f < vector_count(block->frontier); f++)
+            {
+                int frontier = ir_int_at(block->frontier, f);
+                if (ir_block(process, frontier)->phis[location] != -1)
+                {
+                    continue;
+                }
+
+                int phi = ir_new_value(process, location, -1, frontier);
+                int total_predecessors = vector_count(ir_block(process, frontier)->predecessors);
+                ir_value(process, phi)->phi_args = malloc(total_predecessors * sizeof(int));
+                memset(ir_value(process, phi)->phi_args, -1, total_predecessors * sizeof(int));
+                ir_block(process, frontier)->phis[location] = phi;
+                if (!queued[frontier])
+                {
+                    queued[frontier] = true;
+                    vector_push(worklist, &frontier);
+                }
+            }
+        }
+    }
+    vector_free(worklist);
+    free(queued);
+}
+
+static void ir_rename(struct ir_process *process, int b, const int *incoming)
+{
+    int current[IR_TOTAL_LOCATIONS];
+    memcpy(current, incoming, sizeof(current));
+    struct ir_block *block = ir_block(process, b);
+    for (int location = 0; location < IR_TOTAL_LOCATIONS; location++)
+    {
+        if (block->phis[location] != -1)
+        {
+            current[location] = block->phis[location];
+        }
+    }
+
+    for (int index = block->start; index < block->end; index++)
+    {
+        struct ir_instruction *info = &process->info[index];
+        ir_effects(ir_mir(process, index), &info->uses, &info->defs);
+        memcpy(info->in, current, sizeof(current));
+        for (int location = 0; location < IR_TOTAL_LOCATIONS; location++)
+        {
+            info->out[location] = -1;
+            if (info->defs & IR_LOCATION_BIT(location))
+            {
+                info->out[location] = ir_new_value(process, location, index, -1);
+                current[location] = info->out[location];
+            }
+        }
+    }
+
+    for (int s = 0; s < vector_count(block->successors); s++)
+    {
+        struct ir_block *successor = ir_block(process, ir_int_at(block->successors, s));
+        for (int p = 0; p < vector_count(successor->predecessors); p++)
+        {
+            if (ir_int_at(successor->predecessors, p) != b)
+            {
+                continue;
+            }
+
+            for (int location = 0; location < IR_TOTAL_LOCATIONS; location++)
+            {
+                if (successor->phis[location] != -1)
+                {
+                    ir_value(process, successor->phis[location])->phi_args[p] = current[location];
+                }
+            }
+        }
+    }
+
+    for (int c = 0; c < vector_count(block->children); c++)
+    {
+        ir_rename(process, ir_int_at(block->children, c), current);
+    }
+}
+
+static void ir_count_uses(struct ir_process *process)
+{
+    for (int i = 0; i < vector_count(process->instructions); i++)
+    {
+        struct ir_instruction *info = &process->info[i];
+        if (!ir_reachable(process, info->block))
+        {
+            continue;
+        }
+
+        for (int location = 0; location < IR_TOTAL_LOCATIONS; location++)
+        {
+            if (info->uses & IR_LOCATION_BIT(location))
+            {
+                ir_value(process, info->in[location])->total_uses++;
+            }
+        }
+    }
+
+    for (int v = 0; v < vector_count(process->values); v++)
+    {
+        struct ir_value *value = ir_value(process, v);
+        if (value->phi_block == -1)
+        {
+            continue;
+        }
+
+        for (int p = 0; p < vector_count(ir_block(process, value->phi_block)->predecessors); p++)
+        {
+            if (value->phi_args[p] != -1)
+            {
+                ir_value(process, value->phi_args[p])->total_uses++;
+            }
+        }
+    }
+}
+
+static void ir_build(struct ir_process *process)
+{
+    int total = vector_count(process->instructions);
+    process->info = calloc(total, sizeof(struct ir_instruction));
+    process->blocks = vector_create(sizeof(struct ir_block));
+    process->rpo = vector_create(sizeof(int));
+    process->values = vector_create(sizeof(struct ir_value));
+    process->labels = hashmap_create();
+    process->next_vn = 0;
+    ir_build_blocks(process);
+    ir_build_dominators(process);
+    ir_place_phis(process);
+
+    int entry[IR_TOTAL_LOCATIONS];
+    for (int location = 0; location < IR_TOTAL_LOCATIONS; location++)
+    {
+        entry[location] = ir_new_value(process, location, -1, -1);
+        ir_value(process, entry[location])->lattice.state = IR_LATTICE_BOTTOM;
+    }
+    ir_rename(process, 0, entry);
+    ir_count_uses(process);
+}
+
+static void ir_free(struct ir_process *process)
+{
+    for (int b = 0; b < vector_count(process->blocks); b++)
+    {
+        struct ir_block *block = ir_block(process, b);
+        vector_free(block->successors);
+        vector_free(block->predecessors);
+        vector_free(block->children);
+        vector_free(block->frontier);
+        free(block->edge_executable);
+    }
+
+    for (int v = 0; v < vector_count(process->values); v++)
+    {
+        free(ir_value(process, v)->phi_args);
+    }
+
+    vector_free(process->blocks);
+    vector_free(process->rpo);
+    vector_free(process->values);
+    hashmap_free(process->labels);
+    free(process->info);
+}
+
+/**
+ * Drops the instructions the pass removed, returns true if there were any
+ */
+static bool ir_compact(struct ir_process *process)
+{
+    bool removed = false;
+    for (int i = vector_count(process->instructions) - 1; i >= 0; i--)
+    {
+        if (process->info[i].removed)
+        {
+            mir_instruction_free(ir_mir(process, i));
+            vector_pop_at(process->instructions, i);
+            removed = true;
+        }
+    }
+    return removed;
+}
+
+static void ir_replace(struct ir_process *process, int index, struct mir_instruction replacement)
+{
+    mir_instruction_free(ir_mir(process, index));
+    *ir_mir(process, index) = replacement;
+}
+
+static struct ir_lattice ir_lattice_of(uint32_t value)
+{
+    return (struct ir_lattice){.state = IR_LATTICE_CONSTANT, .value = value};
+}
+
+static struct ir_lattice ir_lattice_bottom()
+{
+    return (struct ir_lattice){.state = IR_LATTICE_BOTTOM};
+}
+
+static struct ir_lattice ir_lattice_meet(struct ir_lattice first, struct ir_lattice second)
+{
+    if (first.state == IR_LATTICE_TOP)
+    {
+        return second;
+    }
+
+    if (second.state == IR_LATTICE_TOP)
+    {
+        return first;
+    }
+
+    if (first.state == IR_LATTICE_CONSTANT && second.state == IR_LATTICE_CONSTANT &&
+        first.value == second.value && first.compared == second.compared)
+    {
+        return first;
+    }
+
+    return ir_lattice_bottom();
+}
+
+// Lowers the lattice of the value, returns true if it changed
+static bool ir_lattice_lower(struct ir_process *process, int value, struct ir_lattice lattice)
+{
+    struct ir_lattice *current = &ir_value(process, value)->lattice;
+    struct ir_lattice lowered = ir_lattice_meet(*current, lattice);
+    if (lowered.state == current->state && lowered.value == current->value && lowered.compared == current->compared)
+    {
+        return false;
+    }
+
+    *current = lowered;
+    return true;
+}
+
+static struct ir_lattice ir_lattice_at(struct ir_process *process, int index, int location)
+{
+    return ir_value(process, process->info[index].in[location])->lattice;
+}
+
+static struct ir_lattice ir_operand_lattice(struct ir_process *process, int index, struct mir_operand *operand)
+{
+    if (operand->type == MIR_OPERAND_IMMEDIATE)
+    {
+        return ir_lattice_of((uint32_t)operand->imm);
+    }
+
+    int width = 0;
+    int location = ir_operand_location(operand, &width);
+    if (location == -1 || location >= IR_GENERAL_REGISTERS)
+    {
+        return ir_lattice_bottom();
+    }
+
+    struct ir_lattice lattice = ir_lattice_at(process, index, location);
+    if (width == IR_WIDTH_WORD)
+    {
+        lattice.value &= 0xffff;
+    }
+    else if (width == IR_WIDTH_BYTE)
+    {
+        lattice.value &= 0xff;
+    }
+    return lattice;
+}
+
+/**
+ * Sets result to the comparison of first and second under the condition code, false if the code is unknown
+ */
+static bool ir_condition(const char *cc, uint32_t first, uint32_t second, bool *result)
+{
+    int32_t signed_first = (int32_t)first;
+    int32_t signed_second = (int32_t)second;
+    if (S_EQ(cc, "e") || S_EQ(cc, "z"))
+    {
+        *result = first == second;
+    }
+    else if (S_EQ(cc, "ne") || S_EQ(cc, "nz"))
+    {
+        *result = first != second;
+    }
+    else if (S_EQ(cc, "l"))
+    {
+        *result = signed_first < signed_second;
+    }
+    else if (S_EQ(cc, "ge"))
+    {
+        *result = signed_first >= signed_second;
+    }
+    else if (S_EQ(cc, "g"))
+    {
+        *result = signed_first > signed_second;
+    }
+    else if (S_EQ(cc, "le"))
+    {
+        *result = signed_first <= signed_second;
+    }
+    else if (S_EQ(cc, "b"))
+    {
+        *result = first < second;
+    }
+    else if (S_EQ(cc, "ae"))
+    {
+        *result = first >= second;
+    }
+    else if (S_EQ(cc, "a"))
+    {
+        *result = first > second;
+    }
+    else if (S_EQ(cc, "be"))
+    {
+        *result = first <= second;
+    }
+    else
+    {
+        return false;
+    }
+
+    return true;
+}
+
+static bool ir_arithmetic(int opcode, uint32_t first, uint32_t second, uint32_t *result)
+{
+    switch (opcode)
+    {
+    case MIR_OPCODE_ADD:
+        *result = first + second;
+        break;
+    case MIR_OPCODE_SUB:
+        *result = first - second;
+        break;
+    case MIR_OPCODE_AND:
+        *result = first & second;
+        break;
+    case MIR_OPCODE_OR:
+        *result = first | second;
+        break;
+    case MIR_OPCODE_XOR:
+        *result = first ^ second;
+        break;
+    case MIR_OPCODE_IMUL:
+        *result = first * second;
+        break;
+    case MIR_OPCODE_SAL:
+        *result = first << (second & 31);
+        break;
+    case MIR_OPCODE_SAR:
+        *result = (uint32_t)((int32_t)first >> (second & 31));
+        break;
+    case MIR_OPCODE_SHR:
+        *result = first >> (second & 31);
+        break;
+    case MIR_OPCODE_NEG:
+        *result = -first;
+        break;
+    case MIR_OPCODE_NOT:
+        *result = ~first;
+        break;
+    case MIR_OPCODE_INC:
+        *result = first + 1;
+        break;
+    case MIR_OPCODE_DEC:
+        *result = first - 1;
+        break;
+    default:
+        return false;
+    }
+    return true;
+}
+
+// Top if any input is still unknown, bottom if any input varies
+static bool ir_lattice_inputs_constant(struct ir_lattice first, struct ir_lattice second, struct ir_lattice *result)
+{
+    if (first.state == IR_LATTICE_BOTTOM || second.state == IR_LATTICE_BOTTOM)
+    {
+        *result = ir_lattice_bottom();
+        return false;
+    }
+
+    if (first.state == IR_LATTICE_TOP || second.state == IR_LATTICE_TOP)
+    {
+        *result = (struct ir_lattice){.state = IR_LATTICE_TOP};
+        return false;
+    }
+
+    return true;
+}
+
+/**
+ * The lattice of what the instruction writes to the location given what it reads
+ */
+static struct ir_lattice ir_evaluate(struct ir_process *process, int index, int location)
+{
+    struct mir_instruction *instruction = ir_mir(process, index);
+    if (location >= IR_GENERAL_REGISTERS && location != IR_LOCATION_FLAGS)
+    {
+        return ir_lattice_bottom();
+    }
+
+    struct ir_lattice first = ir_operand_lattice(process, index, &instruction->operands[0]);
+    struct ir_lattice second = ir_operand_lattice(process, index, &instruction->operands[1]);
+    struct ir_lattice result = {};
+    int width = 0;
+    uint32_t value = 0;
+    bool condition = false;
+    switch (instruction->opcode)
+    {
+    case MIR_OPCODE_MOV:
+        ir_operand_location(&instruction->operands[0], &width);
+        return width == IR_WIDTH_DWORD ? second : ir_lattice_bottom();
+
+    case MIR_OPCODE_MOVZX:
+        return second;
+
+    case MIR_OPCODE_MOVSX:
+        ir_operand_location(&instruction->operands[1], &width);
+        if (second.state == IR_LATTICE_CONSTANT)
+        {
+            second.value = width == IR_WIDTH_BYTE ? (uint32_t)(int8_t)second.value : (uint32_t)(int16_t)second.value;
+        }
+        return second;
+
+    case MIR_OPCODE_CMP:
+        if (ir_lattice_inputs_constant(first, second, &result))
+        {
+            result = ir_lattice_of(first.value);
+            result.compared = second.value;
+        }
+        return result;
+
+    case MIR_OPCODE_SETCC:
+        first = ir_lattice_at(process, index, IR_LOCATION_EAX);
+        second = ir_lattice_at(process, index, IR_LOCATION_FLAGS);
+        if (ir_lattice_inputs_constant(first, second, &result))
+        {
+            if (!ir_condition(instruction->cc, second.value, second.compared, &condition))
+            {
+                return ir_lattice_bottom();
+            }
+            result = ir_lattice_of((first.value & ~0xffu) | condition);
+        }
+        return result;
+
+    case MIR_OPCODE_CDQ:
+        first = ir_lattice_at(process, index, IR_LOCATION_EAX);
+        if (first.state == IR_LATTICE_CONSTANT)
+        {
+            return ir_lattice_of((int32_t)first.value < 0 ? 0xffffffff : 0);
+        }
+        return first;
+
+    case MIR_OPCODE_IMUL:
+    case MIR_OPCODE_MUL:
+        if (ir_is_one_operand_multiply(instruction))
+        {
+            if (location == IR_LOCATION_FLAGS || !ir_lattice_inputs_constant(ir_lattice_at(process, index, IR_LOCATION_EAX), first, &result))
+            {
+                return location == IR_LOCATION_FLAGS ? ir_lattice_bottom() : result;
+            }
+
+            uint32_t eax = ir_lattice_at(process, index, IR_LOCATION_EAX).value;
+            uint64_t product = instruction->opcode == MIR_OPCODE_IMUL ? (uint64_t)((int64_t)(int32_t)eax * (int32_t)first.value) : (uint64_t)eax * first.value;
+            return ir_lattice_of(location == IR_LOCATION_EAX ? (uint32_t)product : (uint32_t)(product >> 32));
+        }
+        // fallthrough
+    case MIR_OPCODE_ADD:
+    case MIR_OPCODE_SUB:
+    case MIR_OPCODE_AND:
+    case MIR_OPCODE_OR:
+    case MIR_OPCODE_XOR:
+    case MIR_OPCODE_SAL:
+    case MIR_OPCODE_SAR:
+    case MIR_OPCODE_SHR:
+        if (location == IR_LOCATION_FLAGS)
+        {
+            return ir_lattice_bottom();
+        }
+
+        if (ir_lattice_inputs_constant(first, second, &result) && ir_arithmetic(instruction->opcode, first.value, second.value, &value))
+        {
+            result = ir_lattice_of(value);
+        }
+        return result;
+
+    case MIR_OPCODE_NEG:
+    case MIR_OPCODE_NOT:
+    case MIR_OPCODE_INC:
+    case MIR_OPCODE_DEC:
+        if (location == IR_LOCATION_FLAGS)
+        {
+            return ir_lattice_bottom();
+        }
+
+        if (first.state == IR_LATTICE_CONSTANT && ir_arithmetic(instruction->opcode, first.value, 0, &value))
+        {
+            return ir_lattice_of(value);
+        }
+        return first;
+    }
+
+    return ir_lattice_bottom();
+}
+
+static bool ir_mark_edge(struct ir_process *process, int from, int to)
+{
+    struct ir_block *block = ir_block(process, to);
+    for (int p = 0; p < vector_count(block->predecessors); p++)
+    {
+        if (ir_int_at(block->predecessors, p) == from && !block->edge_executable[p])
+        {
+            block->edge_executable[p] = true;
+            block->executable = true;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool ir_mark_successors(struct ir_process *process, int b)
+{
+    struct ir_block *block = ir_block(process, b);
+    struct mir_instruction *last = ir_mir(process, block->end - 1);
+    struct ir_lattice flags = {};
+    bool changed = false;
+    bool taken = false;
+    if (last->opcode == MIR_OPCODE_JCC)
+    {
+        flags = ir_lattice_at(process, block->end - 1, IR_LOCATION_FLAGS);
+        if (flags.state == IR_LATTICE_TOP)
+        {
+            return false;
+        }
+
+        if (flags.state == IR_LATTICE_CONSTANT && ir_condition(last->cc, flags.value, flags.compared, &taken))
+        {
+            int target = taken ? ir_label_block(process, &last->operands[0]) : b + 1;
+            return target != -1 && target < vector_count(process->blocks) && ir_mark_edge(process, b, target);
+        }
+    }
+
+    for (int s = 0; s < vector_count(block->successors); s++)
+    {
+        changed |= ir_mark_edge(process, b, ir_int_at(block->successors, s));
+    }
+    return changed;
+}
+
+/**
+ * Propagates constants only along edges that can be taken, values start unknown and are lowered until nothing changes
+ */
+static void ir_propagate_constants(struct ir_process *process)
+{
+    ir_block(process, 0)->executable = true;
+    bool changed = true;
+    while (changed)
+    {
+        changed = false;
+        for (int i = 0; i < vector_count(process->rpo); i++)
+        {
+            int b = ir_int_at(process->rpo, i);
+            struct ir_block *block = ir_block(process, b);
+            if (!block->executable)
+            {
+                continue;
+            }
+
+            for (int location = 0; location < IR_TOTAL_LOCATIONS; location++)
+            {
+                int phi = block->phis[location];
+                if (phi == -1)
+                {
+                    continue;
+                }
+
+                struct ir_lattice lattice = {.state = IR_LATTICE_TOP};
+                for (int p = 0; p < vector_count(block->predecessors); p++)
+                {
+                    int arg = ir_value(process, phi)->phi_args[p];
+                    if (block->edge_executable[p] && arg != -1)
+                    {
+                        lattice = ir_lattice_meet(lattice, ir_value(process, arg)->lattice);
+                    }
+                }
+                changed |= ir_lattice_lower(process, phi, lattice);
+            }
+
+            for (int index = block->start; index < block->end; index++)
+            {
+                for (int location = 0; location < IR_TOTAL_LOCATIONS; location++)
+                {
+                    int out = process->info[index].out[location];
+                    if (out != -1)
+                    {
+                        changed |= ir_lattice_lower(process, out, ir_evaluate(process, index, location));
+                    }
+                }
+            }
+            changed |= ir_mark_successors(process, b);
+        }
+    }
+}
+
+// Replaces a register the instruction reads with its constant value
+static bool ir_substitute_constant(struct ir_process *process, int index, int operand_index)
+{
+    struct mir_instruction *instruction = ir_mir(process, index);
+    struct mir_operand *operand = &instruction->operands[operand_index];
+    int width = 0;
+    int location = ir_operand_location(operand, &width);
+    bool is_shift_count = location == IR_LOCATION_ECX && width == IR_WIDTH_BYTE &&
+                          (instruction->opcode == MIR_OPCODE_SAL || instruction->opcode == MIR_OPCODE_SAR || instruction->opcode == MIR_OPCODE_SHR);
+    if (location == -1 || location >= IR_GENERAL_REGISTERS || (width != IR_WIDTH_DWORD && !is_shift_count))
+    {
+        return false;
+    }
+
+    struct ir_lattice lattice = ir_lattice_at(process, index, location);
+    if (lattice.state != IR_LATTICE_CONSTANT)
+    {
+        return false;
+    }
+
+    // The processor only looks at the low five bits of a shift count
+    *operand = mir_immediate(is_shift_count ? (lattice.value & 31) : (int32_t)lattice.value);
+    if (instruction->opcode == MIR_OPCODE_PUSH)
+    {
+        *operand = mir_sized("dword", *operand);
+    }
+
+    if (operand_index == 1 && instruction->operands[0].type == MIR_OPERAND_MEMORY && !instruction->operands[0].size)
+    {
+        instruction->operands[0].size = "dword";
+    }
+    return true;
+}
+
+static bool ir_substitute_constants(struct ir_process *process, int index)
+{
+    struct mir_instruction *instruction = ir_mir(process, index);
+    switch (instruction->opcode)
+    {
+    case MIR_OPCODE_PUSH:
+        return ir_substitute_constant(process, index, 0);
+
+    case MIR_OPCODE_MOV:
+        if (instruction->operands[0].type == MIR_OPERAND_MEMORY || ir_operand_general_register(&instruction->operands[0]) != -1)
+        {
+            return ir_substitute_constant(process, index, 1);
+        }
+        break;
+
+    case MIR_OPCODE_IMUL:
+        if (ir_is_one_operand_multiply(instruction))
+        {
+            break;
+        }
+        // fallthrough
+    case MIR_OPCODE_ADD:
+    case MIR_OPCODE_SUB:
+    case MIR_OPCODE_AND:
+    case MIR_OPCODE_OR:
+    case MIR_OPCODE_XOR:
+    case MIR_OPCODE_CMP:
+    case MIR_OPCODE_SAL:
+    case MIR_OPCODE_SAR:
+    case MIR_OPCODE_SHR:
+        return ir_substitute_constant(process, index, 1);
+    }
+
+    return false;
+}
+
+/**
+ * The one general register the instruction writes if it computes nothing else anyone reads, -1 otherwise
+ */
+static int ir_pure_destination(struct ir_process *process, int index)
+{
+    struct mir_instruction *instruction = ir_mir(process, index);
+    struct ir_instruction *info = &process->info[index];
+    switch (instruction->opcode)
+    {
+    case MIR_OPCODE_IMUL:
+        if (ir_is_one_operand_multiply(instruction))
+        {
+            return -1;
+        }
+    case MIR_OPCODE_MOV:
+    case MIR_OPCODE_MOVZX:
+    case MIR_OPCODE_MOVSX:
+    case MIR_OPCODE_LEA:
+    case MIR_OPCODE_ADD:
+    case MIR_OPCODE_SUB:
+    case MIR_OPCODE_AND:
+    case MIR_OPCODE_OR:
+    case MIR_OPCODE_XOR:
+    case MIR_OPCODE_SAL:
+    case MIR_OPCODE_SAR:
+    case MIR_OPCODE_SHR:
+    case MIR_OPCODE_NEG:
+    case MIR_OPCODE_NOT:
+    case MIR_OPCODE_INC:
+    case MIR_OPCODE_DEC:
+    case MIR_OPCODE_SETCC:
+    case MIR_OPCODE_CDQ:
+        break;
+
+    default:
+        return -1;
+    }
+
+    int destination = -1;
+    for (int location = 0; location < IR_TOTAL_LOCATIONS; location++)
+    {
+        if (!(info->defs & IR_LOCATION_BIT(location)))
+        {
+            continue;
+        }
+
+        if (location < IR_GENERAL_REGISTERS && destination == -1)
+        {
+            destination = location;
+        }
+        else if (location != IR_LOCATION_FLAGS || ir_value(process, info->out[location])->total_uses)
+        {
+            return -1;
+        }
+    }
+    return destination;
+}
+
+static bool ir_constant_propagation(struct ir_process *process)
+{
+    ir_propagate_constants(process);
+    bool changed = false;
+    for (int b = 0; b < vector_count(process->blocks); b++)
+    {
+        struct ir_block *block = ir_block(process, b);
+        for (int index = block->start; index < block->end; index++)
+        {
+            struct mir_instruction *instruction = ir_mir(process, index);
+            if (!block->executable)
+            {
+                // Nothing can reach this, labels stay as jump tables in the data sections may still name them
+                if (instruction->opcode == MIR_OPCODE_LABEL)
+                {
+                    continue;
+                }
+                process->info[index].removed = true;
+                changed = true;
+                continue;
+            }
+
+            if (instruction->opcode == MIR_OPCODE_JCC)
+            {
+                struct ir_lattice flags = ir_lattice_at(process, index, IR_LOCATION_FLAGS);
+                bool taken = false;
+                if (flags.state == IR_LATTICE_CONSTANT && ir_condition(instruction->cc, flags.value, flags.compared, &taken))
+                {
+                    instruction->opcode = MIR_OPCODE_JMP;
+                    instruction->cc = NULL;
+                    process->info[index].removed = !taken;
+                    changed = true;
+                }
+                continue;
+            }
+
+            int destination = ir_pure_destination(process, index);
+            if (destination != -1)
+            {
+                struct ir_lattice lattice = ir_value(process, process->info[index].out[destination])->lattice;
+                bool is_constant_move = instruction->opcode == MIR_OPCODE_MOV && instruction->operands[1].type == MIR_OPERAND_IMMEDIATE;
+                if (lattice.state == IR_LATTICE_CONSTANT && !is_constant_move)
+                {
+                    ir_replace(process, index, (struct mir_instruction){.opcode = MIR_OPCODE_MOV, .operands = {mir_register(ir_registers[destination][IR_WIDTH_DWORD]), mir_immediate((int32_t)lattice.value)}});
+                    changed = true;
+                    continue;
+                }
+            }
+
+            changed |= ir_substitute_constants(process, index);
+        }
+    }
+    return changed;
+}
+
+/**
+ * Reads the register the value was copied from if it still holds the same value at the instruction
+ */
+static bool ir_propagate_copy(struct ir_process *process, int index, const char **reg)
+{
+    int width = 0;
+    int location = ir_register_location(*reg, &width);
+    if (location == -1 || location >= IR_GENERAL_REGISTERS || width != IR_WIDTH_DWORD)
+    {
+        return false;
+    }
+
+    int copy_index = ir_value(process, process->info[index].in[location])->instruction;
+    if (copy_index == -1)
+    {
+        return false;
+    }
+
+    struct mir_instruction *copy = ir_mir(process, copy_index);
+    int source = ir_operand_general_register(&copy->operands[1]);
+    if (copy->opcode != MIR_OPCODE_MOV || ir_operand_general_register(&copy->operands[0]) == -1 || source == -1 ||
+        process->info[index].in[source] != process->info[copy_index].in[source])
+    {
+        return false;
+    }
+
+    *reg = ir_registers[source][IR_WIDTH_DWORD];
+    return true;
+}
+
+static bool ir_propagate_copy_operand(struct ir_process *process, int index, struct mir_operand *operand, bool register_is_read)
+{
+    bool changed = false;
+    if (operand->type == MIR_OPERAND_REGISTER && register_is_read)
+    {
+        changed = ir_propagate_copy(process, index, &operand->reg);
+    }
+    else if (operand->type == MIR_OPERAND_MEMORY)
+    {
+        if (operand->address.base && !(operand->address.flags & ASM_ADDRESS_FLAG_BASE_IS_SYMBOL))
+        {
+            changed |= ir_propagate_copy(process, index, &operand->address.base);
+        }
+
+        if (operand->address.index)
+        {
+            changed |= ir_propagate_copy(process, index, &operand->address.index);
+        }
+    }
+    return changed;
+}
+
+static bool ir_copy_propagation(struct ir_process *process)
+{
+    bool changed = false;
+    for (int index = 0; index < vector_count(process->instructions); index++)
+    {
+        struct mir_instruction *instruction = ir_mir(process, index);
+        if (!ir_reachable(process, process->info[index].block))
+        {
+            continue;
+        }
+
+        // Only operands that are read and not written can name a different register
+        bool first_is_read = false;
+        bool second_is_read = false;
+        switch (instruction->opcode)
+        {
+        case MIR_OPCODE_PUSH:
+        case MIR_OPCODE_CMP:
+            first_is_read = true;
+            second_is_read = true;
+            break;
+
+        case MIR_OPCODE_IMUL:
+        case MIR_OPCODE_MUL:
+            first_is_read = ir_is_one_operand_multiply(instruction);
+            second_is_read = true;
+            break;
+
+        case MIR_OPCODE_IDIV:
+        case MIR_OPCODE_DIV:
+            first_is_read = true;
+            break;
+
+        case MIR_OPCODE_MOV:
+        case MIR_OPCODE_ADD:
+        case MIR_OPCODE_SUB:
+        case MIR_OPCODE_AND:
+        case MIR_OPCODE_OR:
+        case MIR_OPCODE_XOR:
+            second_is_read = true;
+            break;
+
+        case MIR_OPCODE_MOVZX:
+        case MIR_OPCODE_MOVSX:
+        case MIR_OPCODE_LEA:
+        case MIR_OPCODE_SAL:
+        case MIR_OPCODE_SAR:
+        case MIR_OPCODE_SHR:
+        case MIR_OPCODE_NEG:
+        case MIR_OPCODE_NOT:
+        case MIR_OPCODE_INC:
+        case MIR_OPCODE_DEC:
+        case MIR_OPCODE_POP:
+        case MIR_OPCODE_SETCC:
+            break;
+
+        default:
+            // Memory operands of anything else are left alone
+            continue;
+        }
+
+        changed |= ir_propagate_copy_operand(process, index, &instruction->operands[0], first_is_read);
+        changed |= ir_propagate_copy_operand(process, index, &instruction->operands[1], second_is_read);
+    }
+    return changed;
+}
+
+static void ir_mark_live(struct ir_process *process, int value, struct vector *worklist)
+{
+    if (value == -1 || ir_value(process, value)->live)
+    {
+        return;
+    }
+
+    ir_value(process, value)->live = true;
+    int instruction = ir_value(process, value)->instruction;
+    if (instruction != -1 && !process->info[instruction].live)
+    {
+        process->info[instruction].live = true;
+        vector_push(worklist, &instruction);
+    }
+
+    int phi_block = ir_value(process, value)->phi_block;
+    if (phi_block != -1)
+    {
+        for (int p = 0; p < vector_count(ir_block(process, phi_block)->predecessors); p++)
+        {
+            ir_mark_live(process, ir_value(process, value)->phi_args[p], worklist);
+        }
+    }
+}
+
+/**
+ * Anything that changes memory, control flow or could trap is kept, so is everything those read from
+ */
+static bool ir_dead_code_elimination(struct ir_process *process)
+{
+    struct vector *worklist = vector_create(sizeof(int));
+    for (int index = 0; index < vector_count(process->instructions); index++)
+    {
+        struct ir_instruction *info = &process->info[index];
+        int opcode = ir_mir(process, index)->opcode;
+        bool has_effect = opcode == MIR_OPCODE_RAW || opcode == MIR_OPCODE_LABEL || opcode == MIR_OPCODE_JMP ||
+                          opcode == MIR_OPCODE_JCC || opcode == MIR_OPCODE_RET || opcode == MIR_OPCODE_CALL ||
+                          opcode == MIR_OPCODE_IDIV || opcode == MIR_OPCODE_DIV ||
+                          info->defs & (IR_LOCATION_BIT(IR_LOCATION_FRAME) | IR_LOCATION_BIT(IR_LOCATION_MEMORY));
+        if (ir_reachable(process, info->block) && has_effect)
+        {
+            info->live = true;
+            vector_push(worklist, &index);
+        }
+    }
+
+    while (vector_count(worklist))
+    {
+        int index = *(int *)vector_back(worklist);
+        vector_pop(worklist);
+        for (int location = 0; location < IR_TOTAL_LOCATIONS; location++)
+        {
+            if (process->info[index].uses & IR_LOCATION_BIT(location))
+            {
+                ir_mark_live(process, process->info[index].in[location], worklist);
+            }
+        }
+    }
+    vector_free(worklist);
+
+    bool changed = false;
+    for (int index = 0; index < vector_count(process->instructions); index++)
+    {
+        struct ir_instruction *info = &process->info[index];
+        if (ir_reachable(process, info->block) && !info->live)
+        {
+            info->removed = true;
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+static int ir_unique_vn(struct ir_process *process)
+{
+    return process->next_vn++;
+}
+
+/**
+ * Value number for the expression, equal expressions get equal numbers
+ */
+static int ir_expression_vn(struct ir_process *process, struct hashmap *expressions, struct vector *keys, const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    char *key = malloc(256);
+    vsnprintf(key, 256, fmt, args);
+    va_end(args);
+    int vn = (int)(intptr_t)hashmap_get(expressions, key) - 1;
+    if (vn != -1)
+    {
+        free(key);
+        return vn;
+    }
+
+    vn = ir_unique_vn(process);
+    vector_push(keys, &key);
+    hashmap_set(expressions, key, (void *)(intptr_t)(vn + 1));
+    return vn;
+}
+
+static int ir_vn_at(struct ir_process *process, int index, int location)
+{
+    return ir_value(process, process->info[index].in[location])->vn;
+}
+
+/**
+ * Describes an operand in terms of value numbers, false if it cannot be i.e it reads a value not yet numbered
+ */
+static bool ir_operand_key(struct ir_process *process, int index, struct mir_operand *operand, char *out, size_t len)
+{
+    int width = 0;
+    int location = -1;
+    int base_vn = -1;
+    int index_vn = -1;
+    switch (operand->type)
+    {
+    case MIR_OPERAND_IMMEDIATE:
+        snprintf(out, len, "i%lld", operand->imm);
+        return true;
+
+    case MIR_OPERAND_LABEL:
+        snprintf(out, len, "l%s", operand->label);
+        return true;
+
+    case MIR_OPERAND_REGISTER:
+        location = ir_operand_location(operand, &width);
+        if (location == -1 || ir_vn_at(process, index, location) == -1)
+        {
+            return false;
+        }
+        snprintf(out, len, "v%i/%i", ir_vn_at(process, index, location), width);
+        return true;
+
+    case MIR_OPERAND_MEMORY:
+        if (operand->address.base && !(operand->address.flags & ASM_ADDRESS_FLAG_BASE_IS_SYMBOL))
+        {
+            location = ir_register_location(operand->address.base, &width);
+            base_vn = location != -1 ? ir_vn_at(process, index, location) : -1;
+            if (base_vn == -1)
+            {
+                return false;
+            }
+        }
+
+        if (operand->address.index)
+        {
+            location = ir_register_location(operand->address.index, &width);
+            index_vn = location != -1 ? ir_vn_at(process, index, location) : -1;
+            if (index_vn == -1)
+            {
+                return false;
+            }
+        }
+
+        snprintf(out, len, "[%s %s v%i v%i*%i%+i m%i]", operand->size ? operand->size : "", base_vn == -1 ? operand->address.base : "",
+                 base_vn, index_vn, operand->address.scale, operand->address.displacement, ir_vn_at(process, index, ir_address_memory(&operand->address)));
+        return true;
+    }
+
+    return false;
+}
+
+static int ir_instruction_vn(struct ir_process *process, int index, int location, struct hashmap *expressions, struct vector *keys)
+{
+    struct mir_instruction *instruction = ir_mir(process, index);
+    if (ir_pure_destination(process, index) != location || instruction->opcode == MIR_OPCODE_SETCC)
+    {
+        return ir_unique_vn(process);
+    }
+
+    char first[128];
+    char second[128];
+    int source = -1;
+    switch (instruction->opcode)
+    {
+    case MIR_OPCODE_MOV:
+        // A copy is the value it copies
+        source = ir_operand_general_register(&instruction->operands[1]);
+        if (source != -1 && ir_vn_at(process, index, source) != -1)
+        {
+            return ir_vn_at(process, index, source);
+        }
+        // fallthrough
+    case MIR_OPCODE_MOVZX:
+    case MIR_OPCODE_MOVSX:
+    case MIR_OPCODE_LEA:
+        if (!ir_operand_key(process, index, &instruction->operands[1], second, sizeof(second)))
+        {
+            return ir_unique_vn(process);
+        }
+        return ir_expression_vn(process, expressions, keys, "%i %s", instruction->opcode == MIR_OPCODE_MOV ? -1 : instruction->opcode, second);
+
+    case MIR_OPCODE_CDQ:
+        return ir_expression_vn(process, expressions, keys, "cdq v%i", ir_vn_at(process, index, IR_LOCATION_EAX));
+    }
+
+    if (!ir_operand_key(process, index, &instruction->operands[0], first, sizeof(first)))
+    {
+        return ir_unique_vn(process);
+    }
+
+    if (instruction->operands[1].type == MIR_OPERAND_NONE)
+    {
+        return ir_expression_vn(process, expressions, keys, "%i %s", instruction->opcode, first);
+    }
+
+    if (!ir_operand_key(process, index, &instruction->operands[1], second, sizeof(second)))
+    {
+        return ir_unique_vn(process);
+    }
+
+    bool commutative = instruction->opcode == MIR_OPCODE_ADD || instruction->opcode == MIR_OPCODE_IMUL || instruction->opcode == MIR_OPCODE_AND ||
+                       instruction->opcode == MIR_OPCODE_OR || instruction->opcode == MIR_OPCODE_XOR;
+    if (commutative && strcmp(first, second) > 0)
+    {
+        return ir_expression_vn(process, expressions, keys, "%i %s %s", instruction->opcode, second, first);
+    }
+    return ir_expression_vn(process, expressions, keys, "%i %s %s", instruction->opcode, first, second);
+}
+
+static int ir_phi_vn(struct ir_process *process, int phi)
+{
+    struct ir_value *value = ir_value(process, phi);
+    int vn = -1;
+    for (int p = 0; p < vector_count(ir_block(process, value->phi_block)->predecessors); p++)
+    {
+        int arg = value->phi_args[p];
+        if (arg == -1 || arg == phi)
+        {
+            continue;
+        }
+
+        int arg_vn = ir_value(process, arg)->vn;
+        if (arg_vn == -1 || (vn != -1 && arg_vn != vn))
+        {
+            return ir_unique_vn(process);
+        }
+        vn = arg_vn;
+    }
+    return vn != -1 ? vn : ir_unique_vn(process);
+}
+
+static void ir_number_values(struct ir_process *process)
+{
+    struct hashmap *expressions = hashmap_create();
+    struct vector *keys = vector_create(sizeof(char *));
+    for (int v = 0; v < vector_count(process->values); v++)
+    {
+        struct ir_value *value = ir_value(process, v);
+        if (value->instruction == -1 && value->phi_block == -1)
+        {
+            value->vn = ir_unique_vn(process);
+        }
+    }
+
+    for (int i = 0; i < vector_count(process->rpo); i++)
+    {
+        struct ir_block *block = ir_block(process, ir_int_at(process->rpo, i));
+        for (int location = 0; location < IR_TOTAL_LOCATIONS; location++)
+        {
+            if (block->phis[location] != -1)
+            {
+                ir_value(process, block->phis[location])->vn = ir_phi_vn(process, block->phis[location]);
+            }
+        }
+
+        for (int index = block->start; index < block->end; index++)
+        {
+            for (int location = 0; location < IR_TOTAL_LOCATIONS; location++)
+            {
+                int out = process->info[index].out[location];
+                if (out != -1)
+                {
+                    ir_value(process, out)->vn = ir_instruction_vn(process, index, location, expressions, keys);
+                }
+            }
+        }
+    }
+
+    for (int i = 0; i < vector_count(keys); i++)
+    {
+        free(*(char **)vector_at(keys, i));
+    }
+    vector_free(keys);
+    hashmap_free(expressions);
+}
+
+static bool ir_value_numbering(struct ir_process *process)
+{
+    ir_number_values(process);
+    bool changed = false;
+    for (int index = 0; index < vector_count(process->instructions); index++)
+    {
+        struct mir_instruction *instruction = ir_mir(process, index);
+        int destination = ir_pure_destination(process, index);
+        if (!ir_reachable(process, process->info[index].block) || destination == -1)
+        {
+            continue;
+        }
+
+        int vn = ir_value(process, process->info[index].out[destination])->vn;
+        if (ir_vn_at(process, index, destination) == vn)
+        {
+            // The register already holds the value
+            process->info[index].removed = true;
+            changed = true;
+            continue;
+        }
+
+        // Moving a register is only cheaper than loading from memory or computing
+        if (instruction->opcode == MIR_OPCODE_MOV && instruction->operands[1].type != MIR_OPERAND_MEMORY)
+        {
+            continue;
+        }
+
+        for (int location = 0; location < IR_GENERAL_REGISTERS; location++)
+        {
+            if (location != destination && ir_vn_at(process, index, location) == vn)
+            {
+                ir_replace(process, index, (struct mir_instruction){.opcode = MIR_OPCODE_MOV, .operands = {mir_register(ir_registers[destination][IR_WIDTH_DWORD]), mir_register(ir_registers[location][IR_WIDTH_DWORD])}});
+                changed = true;
+                break;
+            }
+        }
+    }
+    return changed;
+}
+
+static bool ir_run(struct vector *instructions, IR_PASS pass)
+{
+    if (!vector_count(instructions))
+    {
+        return false;
+    }
+
+    struct ir_process process = {.instructions = instructions};
+    ir_build(&process);
+    bool changed = pass(&process);
+    changed |= ir_compact(&process);
+    ir_free(&process);
+    return changed;
+}
+
+void ir_optimize(struct vector *instructions, int flags)
+{
+    bool changed = true;
+    while (changed)
+    {
+        changed = ir_run(instructions, ir_constant_propagation);
+        changed |= ir_run(instructions, ir_copy_propagation);
+        if (flags & COMPILE_PROCESS_OPTIMIZE_O2)
+        {
+            changed |= ir_run(instructions, ir_value_numbering);
+        }
+        changed |= ir_run(instructions, ir_dead_code_elimination);
+    }
+}
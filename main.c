@@ -26,7 +26,45 @@ int main(int argc, char** argv)
     {
         compile_flags |= COMPILE_PROCESS_EXPORT_AS_OBJECT;
     }
-    int res = compile_file(input_file, output_file, compile_flags);
+    else if(S_EQ(option, "preprocess"))
+    {
+        // Nothing to assemble, the output file is preprocessed C source
+        compile_flags = COMPILE_PROCESS_PREPROCESS_ONLY;
+    }
+
+    struct vector* include_dirs = vector_create(sizeof(const char*));
+    const char* dependency_file = NULL;
+    for (int i = 4; i < argc; i++)
+    {
+        if (S_EQ(argv[i], "-MD"))
+        {
+            compile_flags |= COMPILE_PROCESS_WRITE_DEPENDENCY_FILE;
+        }
+        else if (S_EQ(argv[i], "-MF") && i + 1 < argc)
+        {
+            // -MF <file> writes the dependency file there, -MD is implied
+            compile_flags |= COMPILE_PROCESS_WRITE_DEPENDENCY_FILE;
+            dependency_file = argv[++i];
+        }
+        else if (strncmp(argv[i], "-I", 2) == 0)
+        {
+            // Both -Idir and -I dir
+            const char* dir = argv[i][2] ? &argv[i][2] : (i + 1 < argc ? argv[++i] : NULL);
+            if (dir)
+            {
+                vector_push(include_dirs, &dir);
+            }
+        }
+        else if (S_EQ(argv[i], "-O1"))
+        {
+            compile_flags |= COMPILE_PROCESS_OPTIMIZE_O1;
+        }
+        else if (S_EQ(argv[i], "-O2"))
+        {
+            compile_flags |= COMPILE_PROCESS_OPTIMIZE_O2;
+        }
+    }
+    int res = compile_file(input_file, output_file, compile_flags, include_dirs, dependency_file);
     if (res == COMPILER_FILE_COMPILED_OK)
     {
         printf("everything compiled file\n");
@@ -42,16 +80,17 @@ int main(int argc, char** argv)
 
     if (compile_flags & COMPILE_PROCESS_EXECUTE_NASM)
     {
-        char nasm_output_file[40];
-        char nasm_cmd[512];
-        sprintf(nasm_output_file, "%s.o", output_file);
+        char nasm_output_file[PATH_MAX];
+        // Room for the output file three times over plus the commands
+        char nasm_cmd[PATH_MAX * 4];
+        snprintf(nasm_output_file, sizeof(nasm_output_file), "%s.o", output_file);
         if (compile_flags & COMPILE_PROCESS_EXPORT_AS_OBJECT)
         {
-            sprintf(nasm_cmd, "nasm -f elf32 %s -o %s", output_file, nasm_output_file);
+            snprintf(nasm_cmd, sizeof(nasm_cmd), "nasm -f elf32 %s -o %s", output_file, nasm_output_file);
         }
         else
         {
-            sprintf(nasm_cmd, "nasm -f elf32 %s -o %s && gcc -m32 %s -o %s", output_file, nasm_output_file, nasm_output_file, output_file);
+            snprintf(nasm_cmd, sizeof(nasm_cmd), "nasm -f elf32 %s -o %s && gcc -m32 %s -o %s", output_file, nasm_output_file, nasm_output_file, output_file);
         }
 
         printf("%s", nasm_cmd);
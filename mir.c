@@ -0,0 +1,204 @@
+#include "compiler.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+
+/**
+ * Machine instructions as records rather than text. Codegen appends these per function,
+ * the peephole optimizer rewrites them and mir_print writes them out as NASM.
+ */
+
+static const char *mir_mnemonics[] = {
+    [MIR_OPCODE_PUSH] = "push",
+    [MIR_OPCODE_POP] = "pop",
+    [MIR_OPCODE_MOV] = "mov",
+    [MIR_OPCODE_MOVZX] = "movzx",
+    [MIR_OPCODE_MOVSX] = "movsx",
+    [MIR_OPCODE_LEA] = "lea",
+    [MIR_OPCODE_ADD] = "add",
+    [MIR_OPCODE_SUB] = "sub",
+    [MIR_OPCODE_IMUL] = "imul",
+    [MIR_OPCODE_MUL] = "mul",
+    [MIR_OPCODE_IDIV] = "idiv",
+    [MIR_OPCODE_DIV] = "div",
+    [MIR_OPCODE_CDQ] = "cdq",
+    [MIR_OPCODE_NEG] = "neg",
+    [MIR_OPCODE_NOT] = "not",
+    [MIR_OPCODE_INC] = "inc",
+    [MIR_OPCODE_DEC] = "dec",
+    [MIR_OPCODE_AND] = "and",
+    [MIR_OPCODE_OR] = "or",
+    [MIR_OPCODE_XOR] = "xor",
+    [MIR_OPCODE_SAL] = "sal",
+    [MIR_OPCODE_SAR] = "sar",
+    [MIR_OPCODE_SHR] = "shr",
+    [MIR_OPCODE_CMP] = "cmp",
+    [MIR_OPCODE_SETCC] = "set",
+    [MIR_OPCODE_JMP] = "jmp",
+    [MIR_OPCODE_JCC] = "j",
+    [MIR_OPCODE_CALL] = "call",
+    [MIR_OPCODE_RET] = "ret",
+};
+
+struct mir_operand mir_none()
+{
+    return (struct mir_operand){.type = MIR_OPERAND_NONE};
+}
+
+struct mir_operand mir_register(const char *reg)
+{
+    return (struct mir_operand){.type = MIR_OPERAND_REGISTER, .reg = reg};
+}
+
+struct mir_operand mir_immediate(long long value)
+{
+    return (struct mir_operand){.type = MIR_OPERAND_IMMEDIATE, .imm = value};
+}
+
+/**
+ * Memory at the given address, addresses of locals kept in a register give the register itself
+ */
+struct mir_operand mir_memory(struct asm_address address)
+{
+    if (address.flags & ASM_ADDRESS_FLAG_IS_REGISTER)
+    {
+        return mir_register(address.base);
+    }
+
+    return (struct mir_operand){.type = MIR_OPERAND_MEMORY, .address = address};
+}
+
+struct mir_operand mir_label(const char *fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    va_list args2;
+    va_copy(args2, args);
+    int len = vsnprintf(NULL, 0, fmt, args);
+    char *label = malloc(len + 1);
+    vsnprintf(label, len + 1, fmt, args2);
+    va_end(args2);
+    va_end(args);
+    return (struct mir_operand){.type = MIR_OPERAND_LABEL, .label = label};
+}
+
+/**
+ * Gives the operand a size keyword, registers already have a size so they are left alone
+ */
+struct mir_operand mir_sized(const char *size, struct mir_operand operand)
+{
+    if (operand.type != MIR_OPERAND_REGISTER)
+    {
+        operand.size = size;
+    }
+    return operand;
+}
+
+bool mir_operand_is_register(struct mir_operand *operand, const char *reg)
+{
+    return operand->type == MIR_OPERAND_REGISTER && S_EQ(operand->reg, reg);
+}
+
+bool mir_operand_uses_register(struct mir_operand *operand, const char *reg)
+{
+    if (operand->type == MIR_OPERAND_MEMORY)
+    {
+        return (operand->address.base && !(operand->address.flags & ASM_ADDRESS_FLAG_BASE_IS_SYMBOL) && S_EQ(operand->address.base, reg)) ||
+               (operand->address.index && S_EQ(operand->address.index, reg));
+    }
+
+    return mir_operand_is_register(operand, reg);
+}
+
+bool mir_operand_equals(struct mir_operand *a, struct mir_operand *b)
+{
+    if (a->type != b->type)
+    {
+        return false;
+    }
+
+    switch (a->type)
+    {
+    case MIR_OPERAND_NONE:
+        return true;
+    case MIR_OPERAND_REGISTER:
+        return S_EQ(a->reg, b->reg);
+    case MIR_OPERAND_IMMEDIATE:
+        return a->imm == b->imm;
+    case MIR_OPERAND_LABEL:
+        return S_EQ(a->label, b->label);
+    }
+
+    return S_EQ(a->address.base, b->address.base) && a->address.displacement == b->address.displacement &&
+           a->address.scale == b->address.scale && (a->address.index == b->address.index || (a->address.index && b->address.index && S_EQ(a->address.index, b->address.index)));
+}
+
+struct mir_operand mir_operand_clone(struct mir_operand *operand)
+{
+    struct mir_operand clone = *operand;
+    if (operand->type == MIR_OPERAND_LABEL)
+    {
+        clone.label = strdup(operand->label);
+    }
+    return clone;
+}
+
+void mir_instruction_free(struct mir_instruction *instruction)
+{
+    for (int i = 0; i < MIR_MAX_OPERANDS; i++)
+    {
+        if (instruction->operands[i].type == MIR_OPERAND_LABEL)
+        {
+            free(instruction->operands[i].label);
+        }
+    }
+    free(instruction->text);
+}
+
+static void mir_print_operand(FILE *fp, struct mir_operand *operand)
+{
+    if (operand->size)
+    {
+        fprintf(fp, "%s ", operand->size);
+    }
+
+    char address[ASM_ADDRESS_MAX_LENGTH];
+    switch (operand->type)
+    {
+    case MIR_OPERAND_REGISTER:
+        fprintf(fp, "%s", operand->reg);
+        break;
+    case MIR_OPERAND_IMMEDIATE:
+        fprintf(fp, "%lld", operand->imm);
+        break;
+    case MIR_OPERAND_MEMORY:
+        fprintf(fp, "[%s]", codegen_address_string(&operand->address, address, sizeof(address)));
+        break;
+    case MIR_OPERAND_LABEL:
+        fprintf(fp, "%s", operand->label);
+        break;
+    }
+}
+
+void mir_print(FILE *fp, struct mir_instruction *instruction)
+{
+    if (instruction->opcode == MIR_OPCODE_RAW)
+    {
+        fprintf(fp, "%s\n", instruction->text);
+        return;
+    }
+
+    if (instruction->opcode == MIR_OPCODE_LABEL)
+    {
+        fprintf(fp, "%s:\n", instruction->text);
+        return;
+    }
+
+    fprintf(fp, "%s%s", mir_mnemonics[instruction->opcode], instruction->cc ? instruction->cc : "");
+    for (int i = 0; i < MIR_MAX_OPERANDS && instruction->operands[i].type != MIR_OPERAND_NONE; i++)
+    {
+        fprintf(fp, i == 0 ? " " : ", ");
+        mir_print_operand(fp, &instruction->operands[i]);
+    }
+    fprintf(fp, "\n");
+}
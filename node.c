@@ -1,9 +1,12 @@
 #include "compiler.h"
 #include "helpers/vector.h"
+#include "helpers/arena.h"
+#include "helpers/hashmap.h"
 #include <assert.h>
 
 struct vector *node_vector = NULL;
 struct vector *node_vector_root = NULL;
+struct arena *node_arena = NULL;
 
 struct node *parser_current_body = NULL;
 struct node *parser_current_function = NULL;
@@ -14,6 +17,11 @@ void node_set_vector(struct vector *vec, struct vector *root_vec)
     node_vector_root = root_vec;
 }
 
+void node_set_arena(struct arena *arena)
+{
+    node_arena = arena;
+}
+
 void node_push(struct node *node)
 {
     vector_push(node_vector, &node);
@@ -55,13 +63,18 @@ struct node *node_peek_expressionable_or_null()
     return node_is_expressionable(last_node) ? last_node : NULL;
 }
 
+struct datatype *node_datatype_create(struct datatype *dtype)
+{
+    return datatype_canonical(dtype);
+}
+
 void make_default_node()
 {
     node_create(&(struct node){.type=NODE_TYPE_STATEMENT_DEFAULT});
 }
 void make_cast_node(struct datatype *dtype, struct node *operand_node)
 {
-    node_create(&(struct node){.type = NODE_TYPE_CAST, .cast.dtype = *dtype, .cast.operand = operand_node});
+    node_create(&(struct node){.type = NODE_TYPE_CAST, .cast.dtype = node_datatype_create(dtype), .cast.operand = operand_node});
 }
 
 void make_tenary_node(struct node *true_node, struct node *false_node)
@@ -123,7 +136,7 @@ void make_struct_node(const char *name, struct node *body_node)
         flags |= NODE_FLAG_IS_FORWARD_DECLARATION;
     }
 
-    node_create(&(struct node){.type = NODE_TYPE_STRUCT, ._struct.body_n = body_node, ._struct.name = name, .flags = flags});
+    node_create(&(struct node){.type = NODE_TYPE_STRUCT, ._struct.body_n = body_node, ._struct.layout = body_node ? struct_layout_create(body_node, false) : NULL, ._struct.name = name, .flags = flags});
 }
 
 void make_union_node(const char *name, struct node *body_node)
@@ -134,13 +147,58 @@ void make_union_node(const char *name, struct node *body_node)
         flags |= NODE_FLAG_IS_FORWARD_DECLARATION;
     }
 
-    node_create(&(struct node){.type = NODE_TYPE_UNION, ._union.body_n = body_node, ._union.name = name, .flags = flags});
+    node_create(&(struct node){.type = NODE_TYPE_UNION, ._union.body_n = body_node, ._union.layout = body_node ? struct_layout_create(body_node, true) : NULL, ._union.name = name, .flags = flags});
+}
+
+struct struct_layout *struct_layout_create(struct node *body_node, bool is_union)
+{
+    struct struct_layout *layout = arena_alloc(node_arena, sizeof(struct struct_layout));
+    struct vector *statements = body_node->body.statements;
+    layout->members = arena_alloc(node_arena, sizeof(struct struct_layout_member) * (vector_count(statements) + 1));
+    layout->members_by_name = hashmap_create();
+
+    int position = 0;
+    struct node *var_node_last = NULL;
+    vector_set_peek_pointer(statements, 0);
+    struct node *statement = vector_peek_ptr(statements);
+    while (statement)
+    {
+        struct node *var_node = variable_node(statement);
+        statement = vector_peek_ptr(statements);
+        if (!var_node)
+        {
+            continue;
+        }
+
+        int alignment = variable_node_is_primitive(var_node) ? var_node->var.type->size : variable_struct_or_union_largest_variable_node(var_node)->var.type->size;
+        if (var_node_last)
+        {
+            position = align_value_treat_positive(position + variable_size(var_node_last), alignment);
+        }
+
+        struct struct_layout_member *member = &layout->members[layout->total++];
+        member->name = var_node->var.name;
+        member->offset = is_union ? 0 : position;
+        member->size = variable_size(var_node);
+        member->alignment = alignment;
+        member->var_node = var_node;
+        hashmap_set(layout->members_by_name, member->name, member);
+        var_node_last = var_node;
+    }
+
+    return layout;
 }
 
 void make_function_node(struct datatype *ret_type, const char *name, struct vector *arguments, struct node *body_node)
 {
-    struct node* function_node = node_create(&(struct node){.type = NODE_TYPE_FUNCTION, .func.name = name, .func.args.vector = arguments, .func.body_n = body_node, .func.rtype = *ret_type, .func.args.stack_addition = DATA_SIZE_DDWORD});
-    function_node->func.frame.elements = vector_create(sizeof(struct stack_frame_element));
+    struct function *func = arena_alloc(node_arena, sizeof(struct function));
+    func->name = name;
+    func->args.vector = arguments;
+    func->args.stack_addition = DATA_SIZE_DDWORD;
+    func->body_n = body_node;
+    func->rtype = *ret_type;
+    func->frame.elements = arena_vector_create(node_arena, sizeof(struct stack_frame_element));
+    node_create(&(struct node){.type = NODE_TYPE_FUNCTION, .func = func});
 }
 
 void make_switch_node(struct node *exp_node, struct node *body_node, struct vector *cases, bool has_default_case)
@@ -229,7 +287,8 @@ struct node *union_node_for_name(struct compile_process *current_process, const
 
 struct node *node_create(struct node *_node)
 {
-    struct node *node = malloc(sizeof(struct node));
+    assert(node_arena);
+    struct node *node = arena_alloc(node_arena, sizeof(struct node));
     memcpy(node, _node, sizeof(struct node));
     node->binded.owner = parser_current_body;
     node->binded.function = parser_current_function;
@@ -249,7 +308,7 @@ bool node_is_struct_or_union_variable(struct node *node)
         return false;
     }
 
-    return datatype_is_struct_or_union(&node->var.type);
+    return datatype_is_struct_or_union(node->var.type);
 }
 
 struct node *variable_node(struct node *node)
@@ -277,7 +336,7 @@ struct node *variable_node(struct node *node)
 bool variable_node_is_primitive(struct node *node)
 {
     assert(node->type == NODE_TYPE_VARIABLE);
-    return datatype_is_primitive(&node->var.type);
+    return datatype_is_primitive(node->var.type);
 }
 
 struct node *variable_node_or_list(struct node *node)
@@ -293,24 +352,24 @@ struct node *variable_node_or_list(struct node *node)
 size_t function_node_argument_stack_addition(struct node *node)
 {
     assert(node->type == NODE_TYPE_FUNCTION);
-    return node->func.args.stack_addition;
+    return node->func->args.stack_addition;
 }
 
 size_t function_node_stack_size(struct node* node)
 {
     assert(node->type == NODE_TYPE_FUNCTION);
-    return node->func.stack_size;
+    return node->func->stack_size;
 }
 
 bool function_node_is_prototype(struct node* node)
 {
-    return node->func.body_n == NULL;
+    return node->func->body_n == NULL;
 }
 
 struct vector* function_node_argument_vec(struct node* node)
 {
     assert(node->type == NODE_TYPE_FUNCTION);
-    return node->func.args.vector;
+    return node->func->args.vector;
 }
 bool node_is_expression_or_parentheses(struct node *node)
 {
@@ -1,5 +1,6 @@
 #include "compiler.h"
 #include "helpers/vector.h"
+#include "helpers/arena.h"
 #include <assert.h>
 
 static struct compile_process *current_process;
@@ -68,6 +69,7 @@ struct history_cases
 
 struct history
 {
+    // Stays the first member, history_init sets it
     int flags;
     struct parser_history_switch
     {
@@ -76,29 +78,13 @@ struct history
 };
 
 int parser_get_pointer_depth();
-void parser_deal_with_additional_expression();
 void parse_for_parentheses(struct history *history);
 
-static struct history *history_begin(int flags)
-{
-    struct history *history = calloc(1, sizeof(struct history));
-    history->flags = flags;
-    return history;
-}
-
-static struct history *history_down(struct history *history, int flags)
-{
-    struct history *new_history = calloc(1, sizeof(struct history));
-    memcpy(new_history, history, sizeof(struct history));
-    new_history->flags = flags;
-    return new_history;
-}
-
 struct parser_history_switch parser_new_switch_statement(struct history *history)
 {
     memset(&history->_switch, 0, sizeof(&history->_switch));
     history->_switch.case_data = calloc(1, sizeof(struct history_cases));
-    history->_switch.case_data->cases = vector_create(sizeof(struct parsed_switch_case));
+    history->_switch.case_data->cases = arena_vector_create(current_process->node_arena, sizeof(struct parsed_switch_case));
     history->flags |= HISTORY_FLAG_IN_SWITCH_STATEMENT;
     return history->_switch;
 }
@@ -118,6 +104,8 @@ void parser_register_case(struct history *history, struct node *case_node)
 
 int parse_expressionable_single(struct history *history);
 void parse_expressionable(struct history *history);
+bool parser_is_unary_operator(const char *op);
+void parse_for_unary();
 void parse_body(size_t *variable_size, struct history *history);
 void parse_keyword(struct history *history);
 struct vector *parse_function_arguments(struct history *history);
@@ -243,117 +231,43 @@ void parse_single_token_to_node()
     }
 }
 
-void parse_expressionable_for_op(struct history *history, const char *op)
-{
-    parse_expressionable(history);
-}
+int parse_exp(struct history *history);
 
-static int parser_get_precedence_for_operator(const char *op, struct expressionable_op_precedence_group **group_out)
+/**
+ * Parses the right operand of "op". Following operators that bind tighter than "op"
+ * are absorbed into the operand so the expression is built with the correct precedence in one pass.
+ */
+void parse_expressionable_for_op(struct history *history, const char *op)
 {
-    *group_out = NULL;
-    for (int i = 0; i < TOTAL_OPERATOR_GROUPS; i++)
+    if (token_peek_next()->type == TOKEN_TYPE_OPERATOR)
     {
-        for (int b = 0; op_precedence[i].operators[b]; b++)
+        if (S_EQ(token_peek_next()->sval, "("))
         {
-            const char *_op = op_precedence[i].operators[b];
-            if (S_EQ(op, _op))
-            {
-                *group_out = &op_precedence[i];
-                return i;
-            }
+            parse_for_parentheses(HISTORY_DOWN(history, history->flags | HISTORY_FLAG_PARENTHESES_IS_NOT_A_FUNCTION_CALL));
+        }
+        else if (parser_is_unary_operator(token_peek_next()->sval))
+        {
+            parse_for_unary();
+        }
+        else
+        {
+            compiler_error(current_process, "Two operators are expected for a given expression for operator %s\n", token_peek_next()->sval);
         }
     }
-
-    return -1;
-}
-
-static bool parser_left_op_has_priority(const char *op_left, const char *op_right)
-{
-    struct expressionable_op_precedence_group *group_left = NULL;
-    struct expressionable_op_precedence_group *group_right = NULL;
-
-    if (S_EQ(op_left, op_right))
-    {
-        return false;
-    }
-
-    int precdence_left = parser_get_precedence_for_operator(op_left, &group_left);
-    int precdence_right = parser_get_precedence_for_operator(op_right, &group_right);
-    if (group_left->associtivity == ASSOCIATIVITY_RIGHT_TO_LEFT)
-    {
-        return false;
-    }
-
-    return precdence_left <= precdence_right;
-}
-
-void parser_node_shift_children_left(struct node *node)
-{
-    assert(node->type == NODE_TYPE_EXPRESSION);
-    assert(node->exp.right->type == NODE_TYPE_EXPRESSION);
-
-    const char *right_op = node->exp.right->exp.op;
-    struct node *new_exp_left_node = node->exp.left;
-    struct node *new_exp_right_node = node->exp.right->exp.left;
-    make_exp_node(new_exp_left_node, new_exp_right_node, node->exp.op);
-
-    // (50*20)
-    struct node *new_left_operand = node_pop();
-    // 120
-    struct node *new_right_operand = node->exp.right->exp.right;
-    node->exp.left = new_left_operand;
-    node->exp.right = new_right_operand;
-    node->exp.op = right_op;
-}
-
-void parser_node_move_right_left_to_left(struct node *node)
-{
-    make_exp_node(node->exp.left, node->exp.right->exp.left, node->exp.op);
-    struct node *completed_node = node_pop();
-
-    // We still need to deal with the right node
-    const char *new_op = node->exp.right->exp.op;
-    node->exp.left = completed_node;
-    node->exp.right = node->exp.right->exp.right;
-    node->exp.op = new_op;
-}
-void parser_reorder_expression(struct node **node_out)
-{
-    struct node *node = *node_out;
-    if (node->type != NODE_TYPE_EXPRESSION)
-    {
-        return;
-    }
-
-    // No expressions, nothing to do
-    if (node->exp.left->type != NODE_TYPE_EXPRESSION &&
-        node->exp.right && node->exp.right->type != NODE_TYPE_EXPRESSION)
+    else
     {
-        return;
+        parse_expressionable_single(history);
     }
 
-    // 50*E(30+20)
-    // 50*EXPRESSION
-    // EXPRESSION(50*EXPRESSION(30+20))
-    // (50*30)+20
-    if (node->exp.left->type != NODE_TYPE_EXPRESSION &&
-        node->exp.right && node->exp.right->type == NODE_TYPE_EXPRESSION)
+    int precedence = expressionable_op_precedence(op);
+    struct token *next_token = token_peek_next();
+    while (is_operator_token(next_token) && expressionable_op_binds_tighter(next_token->sval, precedence))
     {
-        const char *right_op = node->exp.right->exp.op;
-        if (parser_left_op_has_priority(node->exp.op, right_op))
+        if (parse_exp(history) != 0)
         {
-            // 50*E(20+120)
-            // E(50*20)+120
-            parser_node_shift_children_left(node);
-
-            parser_reorder_expression(&node->exp.left);
-            parser_reorder_expression(&node->exp.right);
+            break;
         }
-    }
-
-    if ((is_array_node(node->exp.left) && is_node_assignment(node->exp.right)) || ((node_is_expression(node->exp.left, "()") || node_is_expression(node->exp.left, "[]")) && node_is_expression(node->exp.right, ",")))
-    {
-        parser_node_move_right_left_to_left(node);
+        next_token = token_peek_next();
     }
 }
 
@@ -365,7 +279,7 @@ bool parser_is_unary_operator(const char *op)
 void parse_for_indirection_unary()
 {
     int depth = parser_get_pointer_depth();
-    parse_expressionable(history_begin(EXPRESSION_IS_UNARY));
+    parse_expressionable(HISTORY_BEGIN(EXPRESSION_IS_UNARY));
     struct node *unary_operand_node = node_pop();
     make_unary_node("*", unary_operand_node, 0);
 
@@ -377,7 +291,7 @@ void parse_for_indirection_unary()
 void parse_for_normal_unary()
 {
     const char *unary_op = token_next()->sval;
-    parse_expressionable(history_begin(EXPRESSION_IS_UNARY));
+    parse_expressionable(HISTORY_BEGIN(EXPRESSION_IS_UNARY));
     struct node *unary_operand_node = node_pop();
     make_unary_node(unary_op, unary_operand_node, 0);
 }
@@ -392,7 +306,6 @@ void parse_for_unary()
     }
 
     parse_for_normal_unary();
-    parser_deal_with_additional_expression();
 }
 
 void parse_for_left_operanded_unary(struct node* left_operand_node, const char* unary_op)
@@ -429,43 +342,12 @@ void parse_exp_normal(struct history *history)
 
     node_left->flags |= NODE_FLAG_INSIDE_EXPRESSION;
 
-    if (token_peek_next()->type == TOKEN_TYPE_OPERATOR)
-    {
-        if (S_EQ(token_peek_next()->sval, "("))
-        {
-            parse_for_parentheses(history_down(history, history->flags | HISTORY_FLAG_PARENTHESES_IS_NOT_A_FUNCTION_CALL));
-        }
-        else if (parser_is_unary_operator(token_peek_next()->sval))
-        {
-            parse_for_unary();
-        }
-        else
-        {
-            compiler_error(current_process, "Two operators are expected for a given expression for operator %s\n", token_peek_next()->sval);
-        }
-    }
-    else
-    {
-        parse_expressionable_for_op(history_down(history, history->flags), op);
-    }
+    parse_expressionable_for_op(HISTORY_DOWN(history, history->flags), op);
 
     struct node *node_right = node_pop();
     node_right->flags |= NODE_FLAG_INSIDE_EXPRESSION;
 
     make_exp_node(node_left, node_right, op);
-    struct node *exp_node = node_pop();
-
-    // Reorder the expression
-    parser_reorder_expression(&exp_node);
-    node_push(exp_node);
-}
-
-void parser_deal_with_additional_expression()
-{
-    if (token_peek_next()->type == TOKEN_TYPE_OPERATOR)
-    {
-        parse_expressionable(history_begin(0));
-    }
 }
 
 void parse_for_parentheses(struct history *history)
@@ -490,7 +372,7 @@ void parse_for_parentheses(struct history *history)
     struct node *exp_node = parser_blank_node;
     if (!token_next_is_symbol(')'))
     {
-        parse_expressionable_root(history_begin(0));
+        parse_expressionable_root(HISTORY_BEGIN(0));
         exp_node = node_pop();
     }
     expect_sym(')');
@@ -502,8 +384,6 @@ void parse_for_parentheses(struct history *history)
         struct node *parentheses_node = node_pop();
         make_exp_node(left_node, parentheses_node, "()");
     }
-
-    parser_deal_with_additional_expression();
 }
 
 void parse_for_comma(struct history *history)
@@ -545,7 +425,7 @@ void parse_for_cast()
     parse_datatype(&dtype);
     expect_sym(')');
 
-    parse_expressionable(history_begin(0));
+    parse_expressionable(HISTORY_BEGIN(0));
     struct node *operand_node = node_pop();
     make_cast_node(&dtype, operand_node);
 }
@@ -710,10 +590,10 @@ void parser_datatype_adjust_size_for_secondary(struct datatype *datatype, struct
         return;
     }
 
-    struct datatype *secondary_data_type = calloc(1, sizeof(struct datatype));
-    parser_datatype_init_type_and_size_for_primitive(datatype_secondary_token, NULL, secondary_data_type);
-    datatype->size += secondary_data_type->size;
-    datatype->secondary = secondary_data_type;
+    struct datatype secondary_data_type = {};
+    parser_datatype_init_type_and_size_for_primitive(datatype_secondary_token, NULL, &secondary_data_type);
+    datatype->size += secondary_data_type.size;
+    datatype->secondary = datatype_canonical(&secondary_data_type);
     datatype->flags |= DATATYPE_FLAG_IS_SECONDARY;
 }
 
@@ -917,15 +797,17 @@ struct datatype_struct_node_fix_private
 bool datatype_struct_node_fix(struct fixup *fixup)
 {
     struct datatype_struct_node_fix_private *private = fixup_private(fixup);
-    struct datatype *dtype = &private->node->var.type;
-    dtype->type = DATA_TYPE_STRUCT;
-    dtype->size = size_of_struct(dtype->type_str);
-    dtype->struct_node = struct_node_for_name(current_process, dtype->type_str);
-    if (!dtype->struct_node)
+    // Variable datatypes are shared, so the node gets a fixed copy rather than changing the original.
+    struct datatype dtype = *private->node->var.type;
+    dtype.type = DATA_TYPE_STRUCT;
+    dtype.size = size_of_struct(dtype.type_str);
+    dtype.struct_node = struct_node_for_name(current_process, dtype.type_str);
+    if (!dtype.struct_node)
     {
         return false;
     }
 
+    private->node->var.type = datatype_canonical(&dtype);
     return true;
 }
 
@@ -942,9 +824,9 @@ void make_variable_node(struct datatype *dtype, struct token *name_token, struct
         name_str = name_token->sval;
     }
 
-    node_create(&(struct node){.type = NODE_TYPE_VARIABLE, .var.name = name_str, .var.type = *dtype, .var.val = value_node});
+    node_create(&(struct node){.type = NODE_TYPE_VARIABLE, .var.name = name_str, .var.type = node_datatype_create(dtype), .var.val = value_node});
     struct node *var_node = node_peek_or_null();
-    if (var_node->var.type.type == DATA_TYPE_STRUCT && !var_node->var.type.struct_node)
+    if (var_node->var.type->type == DATA_TYPE_STRUCT && !var_node->var.type->struct_node)
     {
         struct datatype_struct_node_fix_private *private = calloc(1, sizeof(struct datatype_struct_node_fix_private));
         private
@@ -964,7 +846,7 @@ void parser_scope_offset_for_stack(struct node *node, struct history *history)
         offset = stack_addition;
         if (last_entity)
         {
-            offset = datatype_size(&variable_node(last_entity->node)->var.type);
+            offset = datatype_size(variable_node(last_entity->node)->var.type);
         }
     }
 
@@ -973,7 +855,7 @@ void parser_scope_offset_for_stack(struct node *node, struct history *history)
         offset += variable_node(last_entity->node)->var.aoffset;
         if (variable_node_is_primitive(node))
         {
-            variable_node(node)->var.padding = padding(upward_stack ? offset : -offset, node->var.type.size);
+            variable_node(node)->var.padding = padding(upward_stack ? offset : -offset, node->var.type->size);
         }
     }
 
@@ -995,10 +877,10 @@ void parser_scope_offset_for_structure(struct node *node, struct history *histor
     struct parser_scope_entity *last_entity = parser_scope_last_entity();
     if (last_entity)
     {
-        offset += last_entity->stack_offset + last_entity->node->var.type.size;
+        offset += last_entity->stack_offset + last_entity->node->var.type->size;
         if (variable_node_is_primitive(node))
         {
-            node->var.padding = padding(offset, node->var.type.size);
+            node->var.padding = padding(offset, node->var.type->size);
         }
 
         node->var.aoffset = offset + node->var.padding;
@@ -1030,7 +912,7 @@ void make_variable_node_and_register(struct history *history, struct datatype *d
     // Calculate the scope offset
     parser_scope_offset(var_node, history);
     // Push the variable node to the scope
-    parser_scope_push(parser_new_scope_entity(var_node, var_node->var.aoffset, 0), var_node->var.type.size);
+    parser_scope_push(parser_new_scope_entity(var_node, var_node->var.aoffset, 0), var_node->var.type->size);
 
     resolver_default_new_scope_entity(current_process->resolver, var_node, var_node->var.aoffset, 0);
     node_push(var_node);
@@ -1095,7 +977,7 @@ void parse_variable(struct datatype *dtype, struct token *name_token, struct his
 
 void parse_function_body(struct history *history)
 {
-    parse_body(NULL, history_down(history, history->flags | HISTORY_FLAG_INSIDE_FUNCTION_BODY));
+    parse_body(NULL, HISTORY_DOWN(history, history->flags | HISTORY_FLAG_INSIDE_FUNCTION_BODY));
 }
 
 void parse_function(struct datatype *ret_type, struct token *name_token, struct history *history)
@@ -1108,24 +990,24 @@ void parse_function(struct datatype *ret_type, struct token *name_token, struct
     parser_current_function = function_node;
     if (datatype_is_struct_or_union(ret_type))
     {
-        function_node->func.args.stack_addition += DATA_SIZE_DWORD;
+        function_node->func->args.stack_addition += DATA_SIZE_DWORD;
     }
 
     expect_op("(");
-    arguments_vector = parse_function_arguments(history_begin(0));
+    arguments_vector = parse_function_arguments(HISTORY_BEGIN(0));
     expect_sym(')');
 
-    function_node->func.args.vector = arguments_vector;
+    function_node->func->args.vector = arguments_vector;
     if (symresolver_get_symbol_for_native_function(current_process, name_token->sval))
     {
-        function_node->func.flags |= FUNCTION_NODE_FLAG_IS_NATIVE;
+        function_node->func->flags |= FUNCTION_NODE_FLAG_IS_NATIVE;
     }
 
     if (token_next_is_symbol('{'))
     {
-        parse_function_body(history_begin(0));
+        parse_function_body(HISTORY_BEGIN(0));
         struct node *body_node = node_pop();
-        function_node->func.body_n = body_node;
+        function_node->func->body_n = body_node;
     }
     else
     {
@@ -1142,7 +1024,7 @@ void parse_symbol()
     if (token_next_is_symbol('{'))
     {
         size_t variable_size = 0;
-        struct history *history = history_begin(HISTORY_FLAG_IS_GLOBAL_SCOPE);
+        struct history *history = HISTORY_BEGIN(HISTORY_FLAG_IS_GLOBAL_SCOPE);
         parse_body(&variable_size, history);
         struct node *body_node = node_pop();
 
@@ -1150,7 +1032,7 @@ void parse_symbol()
     }
     else if (token_next_is_symbol(':'))
     {
-        parse_label(history_begin(0));
+        parse_label(HISTORY_BEGIN(0));
         return;
     }
 
@@ -1179,7 +1061,7 @@ void parse_statement(struct history *history)
 void parser_append_size_for_node_struct_union(struct history *history, size_t *_variable_size, struct node *node)
 {
     *_variable_size += variable_size(node);
-    if (node->var.type.flags & DATATYPE_FLAG_IS_POINTER)
+    if (node->var.type->flags & DATATYPE_FLAG_IS_POINTER)
     {
         return;
     }
@@ -1187,7 +1069,7 @@ void parser_append_size_for_node_struct_union(struct history *history, size_t *_
     struct node *largest_var_node = variable_struct_or_union_body_node(node)->body.largest_var_node;
     if (largest_var_node)
     {
-        *_variable_size += align_value(*_variable_size, largest_var_node->var.type.size);
+        *_variable_size += align_value(*_variable_size, largest_var_node->var.type->size);
     }
 }
 
@@ -1241,7 +1123,7 @@ void parser_finalize_body(struct history *history, struct node *body_node, struc
 
     if (largest_align_eligible_var_node)
     {
-        *_variable_size = align_value(*_variable_size, largest_align_eligible_var_node->var.type.size);
+        *_variable_size = align_value(*_variable_size, largest_align_eligible_var_node->var.type->size);
     }
 
     bool padded = padding != 0;
@@ -1258,7 +1140,7 @@ void parse_body_single_statement(size_t *variable_size, struct vector *body_vec,
     body_node->binded.owner = parser_current_body;
     parser_current_body = body_node;
     struct node *stmt_node = NULL;
-    parse_statement(history_down(history, history->flags));
+    parse_statement(HISTORY_DOWN(history, history->flags));
     stmt_node = node_pop();
     vector_push(body_vec, &stmt_node);
 
@@ -1293,12 +1175,12 @@ void parse_body_multiple_statements(size_t *variable_size, struct vector *body_v
 
     while (!token_next_is_symbol('}'))
     {
-        parse_statement(history_down(history, history->flags));
+        parse_statement(HISTORY_DOWN(history, history->flags));
         stmt_node = node_pop();
         if (stmt_node->type == NODE_TYPE_VARIABLE)
         {
             if (!largest_possible_var_node ||
-                (largest_possible_var_node->var.type.size <= stmt_node->var.type.size))
+                (largest_possible_var_node->var.type->size <= stmt_node->var.type->size))
             {
                 largest_possible_var_node = stmt_node;
             }
@@ -1306,7 +1188,7 @@ void parse_body_multiple_statements(size_t *variable_size, struct vector *body_v
             if (variable_node_is_primitive(stmt_node))
             {
                 if (!largest_align_eligible_var_node ||
-                    (largest_align_eligible_var_node->var.type.size <= stmt_node->var.type.size))
+                    (largest_align_eligible_var_node->var.type->size <= stmt_node->var.type->size))
                 {
                     largest_align_eligible_var_node = stmt_node;
                 }
@@ -1346,7 +1228,7 @@ void parse_body(size_t *variable_size, struct history *history)
         variable_size = &tmp_size;
     }
 
-    struct vector *body_vec = vector_create(sizeof(struct node *));
+    struct vector *body_vec = arena_vector_create(current_process->node_arena, sizeof(struct node *));
     if (!token_next_is_symbol('{'))
     {
         parse_body_single_statement(variable_size, body_vec, history);
@@ -1364,7 +1246,7 @@ void parse_body(size_t *variable_size, struct history *history)
     {
         if (history->flags & HISTORY_FLAG_INSIDE_FUNCTION_BODY)
         {
-            parser_current_function->func.stack_size += *variable_size;
+            parser_current_function->func->stack_size += *variable_size;
         }
     }
 }
@@ -1376,7 +1258,7 @@ void parse_struct_no_new_scope(struct datatype *dtype, bool is_forward_declarati
 
     if (!is_forward_declaration)
     {
-        parse_body(&body_variable_size, history_begin(HISTORY_FLAG_INSIDE_STRUCTURE));
+        parse_body(&body_variable_size, HISTORY_BEGIN(HISTORY_FLAG_INSIDE_STRUCTURE));
         body_node = node_pop();
     }
 
@@ -1399,7 +1281,7 @@ void parse_struct_no_new_scope(struct datatype *dtype, bool is_forward_declarati
             struct_node->_struct.name = var_name->sval;
         }
 
-        make_variable_node_and_register(history_begin(0), dtype, var_name, NULL);
+        make_variable_node_and_register(HISTORY_BEGIN(0), dtype, var_name, NULL);
         struct_node->_struct.var = node_pop();
     }
 
@@ -1416,7 +1298,7 @@ void parse_union_no_scope(struct datatype *dtype, bool is_forward_declaration)
     size_t body_variable_size = 0;
     if (!is_forward_declaration)
     {
-        parse_body(&body_variable_size, history_begin(HISTORY_FLAG_INSIDE_UNION));
+        parse_body(&body_variable_size, HISTORY_BEGIN(HISTORY_FLAG_INSIDE_UNION));
         body_node = node_pop();
     }
 
@@ -1430,7 +1312,7 @@ void parse_union_no_scope(struct datatype *dtype, bool is_forward_declaration)
     {
         struct token *var_name = token_next();
         union_node->flags |= NODE_FLAG_HAS_VARIABLE_COMBINED;
-        make_variable_node_and_register(history_begin(0), dtype, var_name, NULL);
+        make_variable_node_and_register(HISTORY_BEGIN(0), dtype, var_name, NULL);
         union_node->_union.var = node_pop();
     }
 
@@ -1512,7 +1394,7 @@ void parse_variable_full(struct history *history)
 struct vector *parse_function_arguments(struct history *history)
 {
     parser_scope_new();
-    struct vector *arguments_vec = vector_create(sizeof(struct node *));
+    struct vector *arguments_vec = arena_vector_create(current_process->node_arena, sizeof(struct node *));
     while (!token_next_is_symbol(')'))
     {
         if (token_next_is_operator("."))
@@ -1522,7 +1404,7 @@ struct vector *parse_function_arguments(struct history *history)
             return arguments_vec;
         }
 
-        parse_variable_full(history_down(history, history->flags | HISTORY_FLAG_IS_UPWARD_STACK));
+        parse_variable_full(HISTORY_DOWN(history, history->flags | HISTORY_FLAG_IS_UPWARD_STACK));
         struct node *argument_node = node_pop();
         vector_push(arguments_vec, &argument_node);
 
@@ -1586,7 +1468,7 @@ void parse_variable_function_or_struct_union(struct history *history)
     parse_variable(&dtype, name_token, history);
     if (token_is_operator(token_peek_next(), ","))
     {
-        struct vector *var_list = vector_create(sizeof(struct node *));
+        struct vector *var_list = arena_vector_create(current_process->node_arena, sizeof(struct node *));
         // Pop off the original variable
         struct node *var_node = node_pop();
         vector_push(var_list, &var_node);
@@ -1629,13 +1511,13 @@ struct node *parse_else_or_else_if(struct history *history)
         if (token_next_is_keyword("if"))
         {
             // Okay this is an else if not an else
-            parse_if_stmt(history_down(history, 0));
+            parse_if_stmt(HISTORY_DOWN(history, 0));
             node = node_pop();
             return node;
         }
 
         // Its an else statement
-        node = parse_else(history_down(history, 0));
+        node = parse_else(HISTORY_DOWN(history, 0));
     }
     return node;
 }
@@ -1660,7 +1542,7 @@ void parse_keyword_parentheses_expression(const char *keyword)
 {
     expect_keyword(keyword);
     expect_op("(");
-    parse_expressionable_root(history_begin(0));
+    parse_expressionable_root(HISTORY_BEGIN(0));
     expect_sym(')');
 }
 
@@ -1817,7 +1699,7 @@ void parse_break(struct history *history)
 void parse_goto(struct history *history)
 {
     expect_keyword("goto");
-    parse_identifier(history_begin(0));
+    parse_identifier(HISTORY_BEGIN(0));
     expect_sym(';');
 
     struct node *label_node = node_pop();
@@ -1840,10 +1722,10 @@ void parse_for_tenary(struct history *history)
 {
     struct node *condition_node = node_pop();
     expect_op("?");
-    parse_expressionable_root(history_down(history, HISTORY_FLAG_PARENTHESES_IS_NOT_A_FUNCTION_CALL));
+    parse_expressionable_root(HISTORY_DOWN(history, HISTORY_FLAG_PARENTHESES_IS_NOT_A_FUNCTION_CALL));
     struct node *true_result_node = node_pop();
     expect_sym(':');
-    parse_expressionable_root(history_down(history, HISTORY_FLAG_PARENTHESES_IS_NOT_A_FUNCTION_CALL));
+    parse_expressionable_root(HISTORY_DOWN(history, HISTORY_FLAG_PARENTHESES_IS_NOT_A_FUNCTION_CALL));
     struct node *false_result_node = node_pop();
     make_tenary_node(true_result_node, false_result_node);
     struct node *tenary_node = node_pop();
@@ -1970,7 +1852,7 @@ void parse_expressionable(struct history *history)
 
 void parse_keyword_for_global()
 {
-    parse_keyword(history_begin(HISTORY_FLAG_IS_GLOBAL_SCOPE));
+    parse_keyword(HISTORY_BEGIN(HISTORY_FLAG_IS_GLOBAL_SCOPE));
     struct node *node = node_pop();
     switch (node->type)
     {
@@ -1998,7 +1880,7 @@ int parse_next()
     case TOKEN_TYPE_NUMBER:
     case TOKEN_TYPE_IDENTIFIER:
     case TOKEN_TYPE_STRING:
-        parse_expressionable(history_begin(0));
+        parse_expressionable(HISTORY_BEGIN(0));
         break;
 
     case TOKEN_TYPE_KEYWORD:
@@ -2018,6 +1900,8 @@ int parse(struct compile_process *process)
     current_process = process;
     parser_last_token = NULL;
     node_set_vector(process->node_vec, process->node_tree_vec);
+    process->node_arena = arena_create();
+    node_set_arena(process->node_arena);
     parser_blank_node = node_create(&(struct node){.type = NODE_TYPE_BLANK});
     parser_fixup_sys = fixup_sys_new();
 
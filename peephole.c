@@ -0,0 +1,291 @@
+#include "compiler.h"
+#include "helpers/vector.h"
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Peephole optimizer over the instructions of one function.
+ *
+ * The stack machine code generator pushes every intermediate value and pops it straight back,
+ * these rules clean up the patterns it produces constantly.
+ *
+ * The instructions are streamed through once and compacted in place. Rules only look at the last few
+ * instructions kept so far and are retried on them until none applies, so a rule that removes
+ * instructions exposes the ones before it to the next instruction.
+ */
+
+struct peephole
+{
+    // struct mir_instruction, the first total of them are the instructions kept so far
+    struct vector *instructions;
+    int total;
+};
+
+// Condition codes and their inverse, i.e sete jumps with je and is undone by jne
+static const char *peephole_conditions[][2] = {
+    {"e", "ne"},
+    {"ne", "e"},
+    {"l", "ge"},
+    {"ge", "l"},
+    {"g", "le"},
+    {"le", "g"},
+    {"b", "ae"},
+    {"ae", "b"},
+    {"a", "be"},
+    {"be", "a"},
+    {NULL, NULL}};
+
+static struct mir_instruction *peephole_instruction(struct peephole *peephole, int index)
+{
+    if (index < 0 || index >= peephole->total)
+    {
+        return NULL;
+    }
+
+    return vector_at(peephole->instructions, index);
+}
+
+static bool peephole_is(struct mir_instruction *instruction, int opcode)
+{
+    return instruction && instruction->opcode == opcode;
+}
+
+// Only ever called near the end of the kept instructions so the move is a few records at most
+static void peephole_remove(struct peephole *peephole, int index, int total)
+{
+    for (int i = 0; i < total; i++)
+    {
+        mir_instruction_free(vector_at(peephole->instructions, index + i));
+    }
+
+    int after = peephole->total - index - total;
+    memmove(vector_at(peephole->instructions, index), vector_at(peephole->instructions, index + total), after * sizeof(struct mir_instruction));
+    peephole->total -= total;
+}
+
+static const char *peephole_condition(const char *cc, bool inverse)
+{
+    for (int i = 0; peephole_conditions[i][0]; i++)
+    {
+        if (S_EQ(peephole_conditions[i][0], cc))
+        {
+            return peephole_conditions[i][inverse ? 1 : 0];
+        }
+    }
+
+    return NULL;
+}
+
+/**
+ * Reads "add esp, 8" as 8 and "sub esp, 8" as -8
+ */
+static bool peephole_esp_change(struct mir_instruction *instruction, long *change)
+{
+    if (!peephole_is(instruction, MIR_OPCODE_ADD) && !peephole_is(instruction, MIR_OPCODE_SUB))
+    {
+        return false;
+    }
+
+    if (!mir_operand_is_register(&instruction->operands[0], "esp") || instruction->operands[1].type != MIR_OPERAND_IMMEDIATE)
+    {
+        return false;
+    }
+
+    *change = instruction->operands[1].imm * (instruction->opcode == MIR_OPCODE_ADD ? 1 : -1);
+    return true;
+}
+
+// push eax, pop eax does nothing. push X, pop ecx is mov ecx, X
+static bool peephole_push_pop(struct peephole *peephole, int index)
+{
+    struct mir_instruction *push = peephole_instruction(peephole, index);
+    struct mir_instruction *pop = peephole_instruction(peephole, index + 1);
+    if (!peephole_is(push, MIR_OPCODE_PUSH) || !peephole_is(pop, MIR_OPCODE_POP) ||
+        pop->operands[0].type != MIR_OPERAND_REGISTER || mir_operand_uses_register(&push->operands[0], "esp"))
+    {
+        return false;
+    }
+
+    if (mir_operand_equals(&push->operands[0], &pop->operands[0]))
+    {
+        peephole_remove(peephole, index, 2);
+        return true;
+    }
+
+    // The size keyword of the push is implied by the register we move into
+    struct mir_operand value = push->operands[0];
+    value.size = NULL;
+    push->opcode = MIR_OPCODE_MOV;
+    push->operands[0] = pop->operands[0];
+    push->operands[1] = value;
+    pop->operands[0] = mir_none();
+    peephole_remove(peephole, index + 1, 1);
+    return true;
+}
+
+// mov ecx, ecx does nothing
+static bool peephole_self_move(struct peephole *peephole, int index)
+{
+    struct mir_instruction *mov = peephole_instruction(peephole, index);
+    if (!peephole_is(mov, MIR_OPCODE_MOV) || mov->operands[0].type != MIR_OPERAND_REGISTER ||
+        !mir_operand_equals(&mov->operands[0], &mov->operands[1]))
+    {
+        return false;
+    }
+
+    peephole_remove(peephole, index, 1);
+    return true;
+}
+
+// mov edi, eax, mov eax, edi moves the value back where it already is
+static bool peephole_move_back(struct peephole *peephole, int index)
+{
+    struct mir_instruction *first = peephole_instruction(peephole, index);
+    struct mir_instruction *second = peephole_instruction(peephole, index + 1);
+    if (!peephole_is(first, MIR_OPCODE_MOV) || !peephole_is(second, MIR_OPCODE_MOV) ||
+        first->operands[0].type != MIR_OPERAND_REGISTER || first->operands[1].type != MIR_OPERAND_REGISTER ||
+        !mir_operand_equals(&first->operands[0], &second->operands[1]) || !mir_operand_equals(&first->operands[1], &second->operands[0]))
+    {
+        return false;
+    }
+
+    peephole_remove(peephole, index + 1, 1);
+    return true;
+}
+
+// Consecutive stack pointer changes become one, a change of zero is removed
+static bool peephole_esp_arithmetic(struct peephole *peephole, int index)
+{
+    struct mir_instruction *first = peephole_instruction(peephole, index);
+    long change = 0;
+    if (!peephole_esp_change(first, &change))
+    {
+        return false;
+    }
+
+    long next_change = 0;
+    int total = 1;
+    if (peephole_esp_change(peephole_instruction(peephole, index + 1), &next_change))
+    {
+        change += next_change;
+        total = 2;
+    }
+    else if (change != 0)
+    {
+        return false;
+    }
+
+    if (change == 0)
+    {
+        peephole_remove(peephole, index, total);
+        return true;
+    }
+
+    first->opcode = change > 0 ? MIR_OPCODE_ADD : MIR_OPCODE_SUB;
+    first->operands[1] = mir_immediate(labs(change));
+    peephole_remove(peephole, index + 1, 1);
+    return true;
+}
+
+// setcc, movzx leaves the flags of the comparison alone so testing the result again is not needed
+static bool peephole_setcc_cmp(struct peephole *peephole, int index)
+{
+    struct mir_instruction *set = peephole_instruction(peephole, index);
+    struct mir_instruction *movzx = peephole_instruction(peephole, index + 1);
+    struct mir_instruction *cmp = peephole_instruction(peephole, index + 2);
+    struct mir_instruction *jump = peephole_instruction(peephole, index + 3);
+    if (!peephole_is(set, MIR_OPCODE_SETCC) || !peephole_is(movzx, MIR_OPCODE_MOVZX) ||
+        !peephole_is(cmp, MIR_OPCODE_CMP) || !peephole_is(jump, MIR_OPCODE_JCC))
+    {
+        return false;
+    }
+
+    if (!mir_operand_is_register(&set->operands[0], "al") || !mir_operand_is_register(&movzx->operands[0], "eax") ||
+        !mir_operand_is_register(&movzx->operands[1], "al") || !mir_operand_is_register(&cmp->operands[0], "eax") ||
+        cmp->operands[1].type != MIR_OPERAND_IMMEDIATE || cmp->operands[1].imm != 0)
+    {
+        return false;
+    }
+
+    // eax is 0 or 1, jumping when it is zero is jumping when the condition failed
+    const char *jump_cc = NULL;
+    if (S_EQ(jump->cc, "e") || S_EQ(jump->cc, "z"))
+    {
+        jump_cc = peephole_condition(set->cc, true);
+    }
+    else if (S_EQ(jump->cc, "ne") || S_EQ(jump->cc, "nz") || S_EQ(jump->cc, "g") || S_EQ(jump->cc, "a"))
+    {
+        jump_cc = peephole_condition(set->cc, false);
+    }
+
+    if (!jump_cc)
+    {
+        return false;
+    }
+
+    jump->cc = jump_cc;
+    peephole_remove(peephole, index + 2, 1);
+    return true;
+}
+
+// jmp to a label that directly follows is a fall through
+static bool peephole_jump_to_next(struct peephole *peephole, int index)
+{
+    struct mir_instruction *jmp = peephole_instruction(peephole, index);
+    if (!peephole_is(jmp, MIR_OPCODE_JMP) || jmp->operands[0].type != MIR_OPERAND_LABEL)
+    {
+        return false;
+    }
+
+    for (int i = index + 1; peephole_is(peephole_instruction(peephole, i), MIR_OPCODE_LABEL); i++)
+    {
+        if (S_EQ(peephole_instruction(peephole, i)->text, jmp->operands[0].label))
+        {
+            peephole_remove(peephole, index, 1);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Tries every rule on the last instructions kept
+static bool peephole_tail(struct peephole *peephole)
+{
+    int last = peephole->total - 1;
+
+    // A jump is followed by any number of labels before it can be a fall through
+    int jump = last;
+    while (peephole_is(peephole_instruction(peephole, jump), MIR_OPCODE_LABEL))
+    {
+        jump--;
+    }
+
+    return peephole_push_pop(peephole, last - 1) || peephole_self_move(peephole, last) || peephole_move_back(peephole, last - 1) ||
+           peephole_esp_arithmetic(peephole, last - 1) || peephole_esp_arithmetic(peephole, last) ||
+           peephole_setcc_cmp(peephole, last - 3) || peephole_jump_to_next(peephole, jump);
+}
+
+void peephole_optimize(struct vector *instructions)
+{
+    struct peephole peephole = {.instructions = instructions, .total = 0};
+    int count = vector_count(instructions);
+    for (int i = 0; i < count; i++)
+    {
+        if (i != peephole.total)
+        {
+            memcpy(vector_at(instructions, peephole.total), vector_at(instructions, i), sizeof(struct mir_instruction));
+        }
+        peephole.total++;
+
+        while (peephole_tail(&peephole))
+        {
+        }
+    }
+
+    // The records past the kept ones were moved or freed already
+    while (vector_count(instructions) > peephole.total)
+    {
+        vector_pop(instructions);
+    }
+}
@@ -1,6 +1,7 @@
 #include "compiler.h"
 #include "helpers/vector.h"
 #include "helpers/buffer.h"
+#include <unistd.h>
 
 enum
 {
@@ -527,6 +528,16 @@ bool preprocessor_token_is_ifndef(struct token* token)
     return (S_EQ(token->sval, "ifndef"));
 }
 
+bool preprocessor_token_is_include(struct token* token)
+{
+    if (!preprocessor_token_is_preprocessor_keyword(token))
+    {
+        return false;
+    }
+
+    return (S_EQ(token->sval, "include"));
+}
+
 struct buffer* preprocessor_multi_value_string(struct compile_process* compiler)
 {
     struct buffer* buffer = buffer_create();
@@ -773,6 +784,67 @@ void preprocessor_handle_error_token(struct compile_process* compiler)
     preprocessor_execute_error(compiler, buffer_ptr(str_buf));
 }
 
+/**
+ * Looks for the include file next to the file including it and then in each include directory.
+ * Returns true and writes the path to "path_out" if the file exists.
+ */
+bool preprocessor_find_include_file(struct compile_process* compiler, const char* filename, char* path_out)
+{
+    if (filename[0] == '/')
+    {
+        strncpy(path_out, filename, PATH_MAX);
+        return access(path_out, R_OK) == 0;
+    }
+
+    const char* current_path = compiler->cfile.abs_path;
+    const char* last_slash = current_path ? strrchr(current_path, '/') : NULL;
+    if (last_slash)
+    {
+        snprintf(path_out, PATH_MAX, "%.*s/%s", (int)(last_slash - current_path), current_path, filename);
+        if (access(path_out, R_OK) == 0)
+        {
+            return true;
+        }
+    }
+
+    vector_set_peek_pointer(compiler->include_dirs, 0);
+    const char* dir = vector_peek_ptr(compiler->include_dirs);
+    while(dir)
+    {
+        snprintf(path_out, PATH_MAX, "%s/%s", dir, filename);
+        if (access(path_out, R_OK) == 0)
+        {
+            return true;
+        }
+        dir = vector_peek_ptr(compiler->include_dirs);
+    }
+
+    return false;
+}
+
+void preprocessor_handle_include_token(struct compile_process* compiler)
+{
+    struct token* file_path_token = preprocessor_next_token(compiler);
+    if (!file_path_token || file_path_token->type != TOKEN_TYPE_STRING)
+    {
+        compiler_error(compiler, "Expecting a file path for the include");
+    }
+
+    char path[PATH_MAX];
+    if (!preprocessor_find_include_file(compiler, file_path_token->sval, path))
+    {
+        compiler_error(compiler, "Unable to find the include file %s", file_path_token->sval);
+    }
+
+    struct compile_process* new_compile_process = compile_include(path, compiler);
+    if (!new_compile_process)
+    {
+        compiler_error(compiler, "Failed to include file %s", path);
+    }
+
+    preprocessor_token_vec_push_src(compiler, new_compile_process->token_vec);
+}
+
 struct token* preprocessor_hashtag_and_identifier(struct compile_process* compiler, const char* str)
 {
     if (!preprocessor_next_token_no_increment(compiler))
@@ -1013,6 +1085,11 @@ int preprocessor_handle_hashtag_token(struct compile_process* compiler, struct t
         preprocessor_handle_ifndef_token(compiler);
         is_preprocessed = true;
     }
+    else if(preprocessor_token_is_include(next_token))
+    {
+        preprocessor_handle_include_token(compiler);
+        is_preprocessed = true;
+    }
 
     return is_preprocessed;
 }
@@ -1050,7 +1127,7 @@ void preprocessor_handle_token(struct compile_process* compiler, struct token* t
 }
 int preprocessor_run(struct compile_process* compiler)
 {
-    #warning "add our source file as an included file"
+    preprocessor_add_included_file(compiler->preprocessor, compiler->cfile.abs_path);
     vector_set_peek_pointer(compiler->token_vec_original, 0);
     struct token* token = preprocessor_next_token(compiler);
     while(token)
@@ -1060,4 +1137,273 @@ int preprocessor_run(struct compile_process* compiler)
     }
 
     return 0;
-}
\ No newline at end of file
+}
+
+// Output buffer size for preprocess-only mode, flushed with a single fwrite each time it fills.
+#define PREPROCESSOR_WRITER_BUFFER_SIZE 8192
+
+struct preprocessor_writer
+{
+    FILE* fp;
+    char data[PREPROCESSOR_WRITER_BUFFER_SIZE];
+    size_t len;
+
+    // The last token we wrote, NULL if we are at the start of a line.
+    struct token* last_token;
+};
+
+static void preprocessor_writer_flush(struct preprocessor_writer* writer)
+{
+    fwrite(writer->data, 1, writer->len, writer->fp);
+    writer->len = 0;
+}
+
+static void preprocessor_writer_write_char(struct preprocessor_writer* writer, char c)
+{
+    if (writer->len == PREPROCESSOR_WRITER_BUFFER_SIZE)
+    {
+        preprocessor_writer_flush(writer);
+    }
+
+    writer->data[writer->len++] = c;
+}
+
+static void preprocessor_writer_write_str(struct preprocessor_writer* writer, const char* str)
+{
+    while(*str)
+    {
+        preprocessor_writer_write_char(writer, *str);
+        str++;
+    }
+}
+
+static void preprocessor_writer_write_number(struct preprocessor_writer* writer, unsigned long long number)
+{
+    char tmp[24];
+    int i = 0;
+    do
+    {
+        tmp[i++] = '0' + (number % 10);
+        number /= 10;
+    } while(number);
+
+    while(i > 0)
+    {
+        preprocessor_writer_write_char(writer, tmp[--i]);
+    }
+}
+
+static void preprocessor_writer_newline(struct preprocessor_writer* writer)
+{
+    preprocessor_writer_write_char(writer, '\n');
+    writer->last_token = NULL;
+}
+
+static void preprocessor_writer_write_string(struct preprocessor_writer* writer, const char* str)
+{
+    preprocessor_writer_write_char(writer, '"');
+    for (const char* ptr = str; *ptr; ptr++)
+    {
+        unsigned char c = *ptr;
+        switch(c)
+        {
+            case '\n':
+                preprocessor_writer_write_str(writer, "\\n");
+                break;
+            case '\t':
+                preprocessor_writer_write_str(writer, "\\t");
+                break;
+            case '\\':
+                preprocessor_writer_write_str(writer, "\\\\");
+                break;
+            case '\'':
+                preprocessor_writer_write_str(writer, "\\'");
+                break;
+            default:
+                if (c < 0x20 || c >= 0x7f)
+                {
+                    // Numeric escapes are read back as decimal by the lexer.
+                    preprocessor_writer_write_char(writer, '\\');
+                    preprocessor_writer_write_number(writer, c);
+                    break;
+                }
+                preprocessor_writer_write_char(writer, c);
+        }
+    }
+    preprocessor_writer_write_char(writer, '"');
+}
+
+static bool preprocessor_token_is_word(struct token* token)
+{
+    return token->type == TOKEN_TYPE_IDENTIFIER ||
+           token->type == TOKEN_TYPE_KEYWORD ||
+           token->type == TOKEN_TYPE_NUMBER;
+}
+
+/**
+ * Newline tokens are dropped by the preprocessor so we cannot rely on them to separate
+ * tokens, two words or two operators must never be glued together.
+ */
+static bool preprocessor_writer_needs_space(struct preprocessor_writer* writer, struct token* token)
+{
+    struct token* last_token = writer->last_token;
+    if (!last_token)
+    {
+        return false;
+    }
+
+    if (last_token->whitespace)
+    {
+        return true;
+    }
+
+    return (preprocessor_token_is_word(last_token) && preprocessor_token_is_word(token)) ||
+           (last_token->type == TOKEN_TYPE_OPERATOR && token->type == TOKEN_TYPE_OPERATOR);
+}
+
+static void preprocessor_writer_write_token(struct preprocessor_writer* writer, struct token* token)
+{
+    if (token->type == TOKEN_TYPE_COMMENT || token->type == TOKEN_TYPE_NEWLINE)
+    {
+        return;
+    }
+
+    if (preprocessor_writer_needs_space(writer, token))
+    {
+        preprocessor_writer_write_char(writer, ' ');
+    }
+
+    switch(token->type)
+    {
+        case TOKEN_TYPE_IDENTIFIER:
+        case TOKEN_TYPE_KEYWORD:
+        case TOKEN_TYPE_OPERATOR:
+            preprocessor_writer_write_str(writer, token->sval);
+            break;
+
+        case TOKEN_TYPE_SYMBOL:
+            preprocessor_writer_write_char(writer, token->cval);
+            break;
+
+        case TOKEN_TYPE_NUMBER:
+            preprocessor_writer_write_number(writer, token->llnum);
+            if (token->num.type == NUMBER_TYPE_LONG)
+            {
+                preprocessor_writer_write_char(writer, 'L');
+            }
+            else if(token->num.type == NUMBER_TYPE_FLOAT)
+            {
+                preprocessor_writer_write_char(writer, 'f');
+            }
+            break;
+
+        case TOKEN_TYPE_STRING:
+            preprocessor_writer_write_string(writer, token->sval);
+            break;
+    }
+
+    bool ends_line = token_is_symbol(token, ';') || token_is_symbol(token, '{') || token_is_symbol(token, '}');
+    writer->last_token = token;
+    if (ends_line)
+    {
+        preprocessor_writer_newline(writer);
+    }
+}
+
+int preprocessor_output(struct compile_process* compiler, FILE* fp)
+{
+    struct preprocessor_writer* writer = calloc(1, sizeof(struct preprocessor_writer));
+    writer->fp = fp;
+
+    vector_set_peek_pointer(compiler->token_vec, 0);
+    struct token* token = vector_peek(compiler->token_vec);
+    while(token)
+    {
+        preprocessor_writer_write_token(writer, token);
+        token = vector_peek(compiler->token_vec);
+    }
+
+    if (writer->last_token)
+    {
+        preprocessor_writer_newline(writer);
+    }
+
+    preprocessor_writer_flush(writer);
+    free(writer);
+    return 0;
+}
+
+static void preprocessor_write_dependency_path(FILE* fp, const char* path)
+{
+    for (const char* ptr = path; *ptr; ptr++)
+    {
+        if (*ptr == ' ')
+        {
+            fputc('\\', fp);
+        }
+        else if(*ptr == '$')
+        {
+            fputc('$', fp);
+        }
+        fputc(*ptr, fp);
+    }
+}
+
+static bool preprocessor_included_file_seen(struct preprocessor* preprocessor, int index)
+{
+    struct preprocessor_included_file* included_file = *(struct preprocessor_included_file**)vector_at(preprocessor->includes, index);
+    for (int i = 0; i < index; i++)
+    {
+        struct preprocessor_included_file* previous = *(struct preprocessor_included_file**)vector_at(preprocessor->includes, i);
+        if (S_EQ(previous->filename, included_file->filename))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+int preprocessor_write_dependency_file(struct compile_process* compiler, const char* target, const char* filename)
+{
+    FILE* fp = fopen(filename, "w");
+    if (!fp)
+    {
+        return -1;
+    }
+
+    struct preprocessor* preprocessor = compiler->preprocessor;
+    int total = vector_count(preprocessor->includes);
+    preprocessor_write_dependency_path(fp, target);
+    fputc(':', fp);
+    for (int i = 0; i < total; i++)
+    {
+        if (preprocessor_included_file_seen(preprocessor, i))
+        {
+            continue;
+        }
+
+        struct preprocessor_included_file* included_file = *(struct preprocessor_included_file**)vector_at(preprocessor->includes, i);
+        fputs(" \\\n ", fp);
+        preprocessor_write_dependency_path(fp, included_file->filename);
+    }
+    fputc('\n', fp);
+
+    // Empty rules for every included file so make does not fail when one is deleted.
+    // The first included file is the source file its self.
+    for (int i = 1; i < total; i++)
+    {
+        if (preprocessor_included_file_seen(preprocessor, i))
+        {
+            continue;
+        }
+
+        struct preprocessor_included_file* included_file = *(struct preprocessor_included_file**)vector_at(preprocessor->includes, i);
+        fputc('\n', fp);
+        preprocessor_write_dependency_path(fp, included_file->filename);
+        fputs(":\n", fp);
+    }
+
+    fclose(fp);
+    return 0;
+}
@@ -12,33 +12,25 @@ struct resolver_default_scope_data* resolver_default_scope_private(struct resolv
     return scope->private;
 }
 
-char* resolver_default_stack_asm_address(int stack_offset, char* out)
+struct asm_address resolver_default_stack_asm_address(int stack_offset)
 {
-    if (stack_offset < 0)
-    {
-        sprintf(out, "ebp%i", stack_offset);
-        return out;
-    }
+    return (struct asm_address){.base = "ebp", .displacement = stack_offset};
+}
 
-    sprintf(out, "ebp+%i", stack_offset);
-    return out;
+struct asm_address resolver_default_register_asm_address(const char* reg)
+{
+    return (struct asm_address){.base = reg, .flags = ASM_ADDRESS_FLAG_IS_REGISTER};
 }
 
 struct resolver_default_entity_data* resolver_default_new_entity_data()
 {
-    struct resolver_default_entity_data* entity_data = calloc(sizeof(struct resolver_default_entity_data), 1);
+    struct resolver_default_entity_data* entity_data = resolver_alloc(sizeof(struct resolver_default_entity_data));
     return entity_data;
 }
 
-void resolver_default_global_asm_address(const char* name, int offset, char* address_out)
+struct asm_address resolver_default_global_asm_address(const char* name, int offset)
 {
-    if (offset == 0)
-    {
-        sprintf(address_out, "%s", name);
-        return;
-    }
-
-    sprintf(address_out, "%s+%i", name, offset);
+    return (struct asm_address){.base = name, .displacement = offset, .flags = ASM_ADDRESS_FLAG_BASE_IS_SYMBOL};
 }
 
 void resolver_default_entity_data_set_address(struct resolver_default_entity_data* entity_data, struct node* var_node, int offset, int flags)
@@ -53,15 +45,17 @@ void resolver_default_entity_data_set_address(struct resolver_default_entity_dat
     }
 
     entity_data->offset = offset;
-    if (flags & RESOLVER_DEFAULT_ENTITY_FLAG_IS_LOCAL_STACK)
+    if (variable_node(var_node)->var.reg)
+    {
+        entity_data->address = resolver_default_register_asm_address(variable_node(var_node)->var.reg);
+    }
+    else if (flags & RESOLVER_DEFAULT_ENTITY_FLAG_IS_LOCAL_STACK)
     {
-        resolver_default_stack_asm_address(offset, entity_data->address);
-        sprintf(entity_data->base_address, "ebp");
+        entity_data->address = resolver_default_stack_asm_address(offset);
     }
     else
     {
-        resolver_default_global_asm_address(variable_node(var_node)->var.name, offset, entity_data->address);
-        sprintf(entity_data->base_address, "%s", variable_node(var_node)->var.name);
+        entity_data->address = resolver_default_global_asm_address(variable_node(var_node)->var.name, offset);
     }
 }
 
@@ -92,8 +86,7 @@ void resolver_default_set_result_base(struct resolver_result* result, struct res
         return;
     }
 
-    strncpy(result->base.base_address, data->base_address, sizeof(result->base.base_address));
-    strncpy(result->base.address, data->address, sizeof(result->base.address));
+    result->base.address = data->address;
     result->base.offset = data->offset;
 }
 
@@ -120,7 +113,7 @@ struct resolver_default_entity_data* resolver_default_new_entity_data_for_functi
     struct resolver_default_entity_data* entity_data = resolver_default_new_entity_data();
     entity_data->flags = flags;
     entity_data->type = RESOLVER_DEFAULT_ENTITY_DATA_TYPE_FUNCTION;
-    resolver_default_global_asm_address(func_node->func.name, 0, entity_data->address);
+    entity_data->address = resolver_default_global_asm_address(func_node->func->name, 0);
     return entity_data;
 }
 
@@ -0,0 +1,402 @@
+#include "compiler.h"
+#include "helpers/vector.h"
+#include <stdlib.h>
+#include <assert.h>
+
+/**
+ * Linear scan register allocation for function locals.
+ *
+ * Every node in a function body is numbered in the order codegen visits it, a local lives
+ * from its declaration to its last use. Loops stretch the interval of anything declared before
+ * them to the end of the loop as the value must survive the jump back.
+ *
+ * Only esi and edi are free in our stack machine code generator, eax, ebx, ecx and edx
+ * are all used as scratch registers. Locals that do not get a register stay on the stack.
+ * Code generation assigns, increments and compares a local kept in a register in place rather
+ * than copying it through eax and the stack.
+ */
+
+static const char *regalloc_registers[] = {"esi", "edi", NULL};
+
+struct regalloc_interval
+{
+    struct node *var_node;
+    int start;
+    int end;
+
+    // False if the variable has its address taken or is accessed as an array or structure.
+    bool eligible;
+
+    // The register assigned to this interval, NULL if spilled.
+    const char *reg;
+};
+
+struct regalloc_loop
+{
+    int start;
+
+    // struct regalloc_interval* used inside the loop but declared before it
+    struct vector *intervals;
+};
+
+struct regalloc_process
+{
+    // struct regalloc_interval* in order of declaration
+    struct vector *intervals;
+
+    // struct regalloc_interval* visible at the current position, innermost last
+    struct vector *visible;
+
+    // struct regalloc_loop* we are currently inside of
+    struct vector *loops;
+
+    int position;
+
+    // Set when the function uses labels or goto, we cannot know the live ranges then
+    bool has_jumps;
+};
+
+static void regalloc_visit(struct regalloc_process *process, struct node *node, bool address_used);
+
+static struct regalloc_interval *regalloc_find(struct regalloc_process *process, const char *name)
+{
+    for (int i = vector_count(process->visible) - 1; i >= 0; i--)
+    {
+        struct regalloc_interval *interval = *(struct regalloc_interval **)vector_at(process->visible, i);
+        if (S_EQ(interval->var_node->var.name, name))
+        {
+            return interval;
+        }
+    }
+
+    return NULL;
+}
+
+static bool regalloc_variable_is_candidate(struct node *var_node)
+{
+    struct datatype *dtype = var_node->var.type;
+    if (dtype->flags & (DATATYPE_FLAG_IS_ARRAY | DATATYPE_FLAG_IS_STATIC | DATATYPE_FLAG_IS_EXTERN))
+    {
+        return false;
+    }
+
+    if (datatype_is_struct_or_union_non_pointer(dtype))
+    {
+        return false;
+    }
+
+    return datatype_element_size(dtype) == DATA_SIZE_DWORD;
+}
+
+static void regalloc_declare(struct regalloc_process *process, struct node *var_node, bool is_local)
+{
+    struct regalloc_interval *interval = calloc(1, sizeof(struct regalloc_interval));
+    interval->var_node = var_node;
+    interval->start = process->position;
+    interval->end = process->position;
+    interval->eligible = is_local && regalloc_variable_is_candidate(var_node);
+    vector_push(process->intervals, &interval);
+    vector_push(process->visible, &interval);
+}
+
+static void regalloc_use(struct regalloc_process *process, struct node *node, bool address_used)
+{
+    struct regalloc_interval *interval = regalloc_find(process, node->sval);
+    if (!interval)
+    {
+        // Global variable or function
+        return;
+    }
+
+    if (address_used)
+    {
+        interval->eligible = false;
+    }
+
+    interval->end = process->position;
+
+    // The outermost loop started after the declaration keeps the variable alive until it ends
+    for (int i = 0; i < vector_count(process->loops); i++)
+    {
+        struct regalloc_loop *loop = *(struct regalloc_loop **)vector_at(process->loops, i);
+        if (loop->start > interval->start)
+        {
+            vector_push(loop->intervals, &interval);
+            break;
+        }
+    }
+}
+
+static void regalloc_visit_loop(struct regalloc_process *process, struct node *first, struct node *second, struct node *third)
+{
+    struct regalloc_loop loop = {.start = process->position, .intervals = vector_create(sizeof(struct regalloc_interval *))};
+    struct regalloc_loop *loop_ptr = &loop;
+    vector_push(process->loops, &loop_ptr);
+
+    regalloc_visit(process, first, false);
+    regalloc_visit(process, second, false);
+    regalloc_visit(process, third, false);
+
+    vector_pop(process->loops);
+    for (int i = 0; i < vector_count(loop.intervals); i++)
+    {
+        struct regalloc_interval *interval = *(struct regalloc_interval **)vector_at(loop.intervals, i);
+        if (interval->end < process->position)
+        {
+            interval->end = process->position;
+        }
+    }
+    vector_free(loop.intervals);
+}
+
+static void regalloc_visit_body(struct regalloc_process *process, struct node *node)
+{
+    int total_visible = vector_count(process->visible);
+    for (int i = 0; i < vector_count(node->body.statements); i++)
+    {
+        regalloc_visit(process, *(struct node **)vector_at(node->body.statements, i), false);
+    }
+
+    while (vector_count(process->visible) > total_visible)
+    {
+        vector_pop(process->visible);
+    }
+}
+
+static void regalloc_visit_variable(struct regalloc_process *process, struct node *node)
+{
+    // The initializer cannot see the variable it initializes
+    regalloc_visit(process, node->var.val, false);
+    regalloc_declare(process, node, true);
+}
+
+static void regalloc_visit_expression(struct regalloc_process *process, struct node *node, bool address_used)
+{
+    if (is_access_node(node))
+    {
+        // The right operand is a member name rather than a variable
+        regalloc_visit(process, node->exp.left, true);
+        return;
+    }
+
+    if (is_array_node(node))
+    {
+        regalloc_visit(process, node->exp.left, true);
+        regalloc_visit(process, node->exp.right, false);
+        return;
+    }
+
+    regalloc_visit(process, node->exp.left, address_used);
+    regalloc_visit(process, node->exp.right, address_used);
+}
+
+static void regalloc_visit(struct regalloc_process *process, struct node *node, bool address_used)
+{
+    if (!node)
+    {
+        return;
+    }
+
+    process->position++;
+    switch (node->type)
+    {
+    case NODE_TYPE_IDENTIFIER:
+        regalloc_use(process, node, address_used);
+        break;
+
+    case NODE_TYPE_VARIABLE:
+        regalloc_visit_variable(process, node);
+        break;
+
+    case NODE_TYPE_VARIABLE_LIST:
+        for (int i = 0; i < vector_count(node->var_list.list); i++)
+        {
+            regalloc_visit_variable(process, *(struct node **)vector_at(node->var_list.list, i));
+        }
+        break;
+
+    case NODE_TYPE_BODY:
+        regalloc_visit_body(process, node);
+        break;
+
+    case NODE_TYPE_EXPRESSION:
+        regalloc_visit_expression(process, node, address_used);
+        break;
+
+    case NODE_TYPE_EXPRESSION_PARENTHESES:
+        regalloc_visit(process, node->parenthesis.exp, address_used);
+        break;
+
+    case NODE_TYPE_UNARY:
+        regalloc_visit(process, node->unary.operand, address_used || op_is_address(node->unary.op) || op_is_indirection(node->unary.op));
+        break;
+
+    case NODE_TYPE_CAST:
+        regalloc_visit(process, node->cast.operand, address_used);
+        break;
+
+    case NODE_TYPE_TENARY:
+        regalloc_visit(process, node->tenary.true_node, address_used);
+        regalloc_visit(process, node->tenary.false_node, address_used);
+        break;
+
+    case NODE_TYPE_BRACKET:
+        regalloc_visit(process, node->bracket.inner, false);
+        break;
+
+    case NODE_TYPE_STATEMENT_RETURN:
+        regalloc_visit(process, node->stmt.return_stmt.exp, false);
+        break;
+
+    case NODE_TYPE_STATEMENT_IF:
+        regalloc_visit(process, node->stmt.if_stmt.cond_node, false);
+        regalloc_visit(process, node->stmt.if_stmt.body_node, false);
+        regalloc_visit(process, node->stmt.if_stmt.next, false);
+        break;
+
+    case NODE_TYPE_STATEMENT_ELSE:
+        regalloc_visit(process, node->stmt.else_stmt.body_node, false);
+        break;
+
+    case NODE_TYPE_STATEMENT_WHILE:
+        regalloc_visit_loop(process, node->stmt.while_stmt.exp_node, node->stmt.while_stmt.body_node, NULL);
+        break;
+
+    case NODE_TYPE_STATEMENT_DO_WHILE:
+        regalloc_visit_loop(process, node->stmt.do_while_stmt.body_node, node->stmt.do_while_stmt.exp_node, NULL);
+        break;
+
+    case NODE_TYPE_STATEMENT_FOR:
+        regalloc_visit(process, node->stmt.for_stmt.init_node, false);
+        regalloc_visit_loop(process, node->stmt.for_stmt.cond_node, node->stmt.for_stmt.body_node, node->stmt.for_stmt.loop_node);
+        break;
+
+    case NODE_TYPE_STATEMENT_SWITCH:
+        regalloc_visit(process, node->stmt.switch_stmt.exp, false);
+        regalloc_visit(process, node->stmt.switch_stmt.body, false);
+        break;
+
+    case NODE_TYPE_STATEMENT_GOTO:
+    case NODE_TYPE_LABEL:
+        process->has_jumps = true;
+        break;
+    }
+}
+
+static int regalloc_interval_compare(const void *a, const void *b)
+{
+    const struct regalloc_interval *left = *(const struct regalloc_interval **)a;
+    const struct regalloc_interval *right = *(const struct regalloc_interval **)b;
+    return left->start - right->start;
+}
+
+/**
+ * Walks the intervals by start position, expiring those that have ended and handing out free registers.
+ * When no register is free the interval that ends last is left on the stack.
+ */
+static void regalloc_linear_scan(struct regalloc_process *process)
+{
+    struct vector *candidates = vector_create(sizeof(struct regalloc_interval *));
+    for (int i = 0; i < vector_count(process->intervals); i++)
+    {
+        struct regalloc_interval *interval = *(struct regalloc_interval **)vector_at(process->intervals, i);
+        if (interval->eligible)
+        {
+            vector_push(candidates, &interval);
+        }
+    }
+    qsort(vector_data_ptr(candidates), vector_count(candidates), sizeof(struct regalloc_interval *), regalloc_interval_compare);
+
+    // Indexed by register, the interval currently holding it
+    struct regalloc_interval *active[sizeof(regalloc_registers) / sizeof(regalloc_registers[0])] = {};
+    for (int i = 0; i < vector_count(candidates); i++)
+    {
+        struct regalloc_interval *interval = *(struct regalloc_interval **)vector_at(candidates, i);
+        int free_reg = -1;
+        int furthest_reg = -1;
+        for (int r = 0; regalloc_registers[r]; r++)
+        {
+            if (active[r] && active[r]->end < interval->start)
+            {
+                active[r] = NULL;
+            }
+
+            if (!active[r])
+            {
+                if (free_reg == -1)
+                {
+                    free_reg = r;
+                }
+                continue;
+            }
+
+            if (furthest_reg == -1 || active[r]->end > active[furthest_reg]->end)
+            {
+                furthest_reg = r;
+            }
+        }
+
+        if (free_reg == -1 && active[furthest_reg]->end > interval->end)
+        {
+            // Take the register from the interval that ends last, it stays on the stack instead
+            active[furthest_reg]->reg = NULL;
+            free_reg = furthest_reg;
+        }
+
+        if (free_reg != -1)
+        {
+            interval->reg = regalloc_registers[free_reg];
+            active[free_reg] = interval;
+        }
+    }
+    vector_free(candidates);
+}
+
+void regalloc_function(struct node *func_node)
+{
+    struct function *func = func_node->func;
+    func->saved_registers = vector_create(sizeof(const char *));
+
+    struct regalloc_process process = {};
+    process.intervals = vector_create(sizeof(struct regalloc_interval *));
+    process.visible = vector_create(sizeof(struct regalloc_interval *));
+    process.loops = vector_create(sizeof(struct regalloc_loop *));
+
+    // Arguments live above the frame, we only declare them so they shadow globals of the same name
+    struct vector *args = function_node_argument_vec(func_node);
+    for (int i = 0; i < vector_count(args); i++)
+    {
+        regalloc_declare(&process, *(struct node **)vector_at(args, i), false);
+    }
+
+    regalloc_visit(&process, func->body_n, false);
+    if (!process.has_jumps)
+    {
+        regalloc_linear_scan(&process);
+    }
+
+    bool used[sizeof(regalloc_registers) / sizeof(regalloc_registers[0])] = {};
+    for (int i = 0; i < vector_count(process.intervals); i++)
+    {
+        struct regalloc_interval *interval = *(struct regalloc_interval **)vector_at(process.intervals, i);
+        interval->var_node->var.reg = interval->reg;
+        for (int r = 0; interval->reg && regalloc_registers[r]; r++)
+        {
+            used[r] |= S_EQ(interval->reg, regalloc_registers[r]);
+        }
+        free(interval);
+    }
+
+    // esi and edi are callee saved, the function must restore whatever it hands out
+    for (int r = 0; regalloc_registers[r]; r++)
+    {
+        if (used[r])
+        {
+            vector_push(func->saved_registers, &regalloc_registers[r]);
+        }
+    }
+
+    vector_free(process.intervals);
+    vector_free(process.visible);
+    vector_free(process.loops);
+}
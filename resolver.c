@@ -1,5 +1,7 @@
 #include "compiler.h"
 #include "helpers/vector.h"
+#include "helpers/hashmap.h"
+#include "helpers/arena.h"
 #include <stdlib.h>
 #include <assert.h>
 void resolver_follow_part(struct resolver_process *resolver, struct node *node, struct resolver_result *result);
@@ -8,6 +10,35 @@ struct resolver_result *resolver_follow(struct resolver_process *resolver, struc
 struct resolver_entity *resolver_follow_array_bracket(struct resolver_process *resolver, struct node *node, struct resolver_result *result);
 struct resolver_entity *resolver_follow_part_return_entity(struct resolver_process *resolver, struct node *node, struct resolver_result *result);
 
+// Set while resolver_follow runs, everything built for a result is allocated from it.
+static struct arena *resolver_follow_arena = NULL;
+
+void *resolver_alloc(size_t size)
+{
+    if (resolver_follow_arena)
+    {
+        return arena_alloc(resolver_follow_arena, size);
+    }
+
+    return calloc(1, size);
+}
+
+void resolver_release_results(struct resolver_process *resolver, struct arena_mark *mark)
+{
+    arena_release(resolver->arena, mark);
+    resolver->cache.generation++;
+}
+
+static struct vector *resolver_vector_create(size_t esize)
+{
+    if (resolver_follow_arena)
+    {
+        return arena_vector_create(resolver_follow_arena, esize);
+    }
+
+    return vector_create(esize);
+}
+
 bool resolver_result_failed(struct resolver_result *result)
 {
     return result->flags & RESOLVER_RESULT_FLAG_FAILED;
@@ -40,7 +71,7 @@ struct resolver_entity *resolver_entity_clone(struct resolver_entity *entity)
         return NULL;
     }
 
-    struct resolver_entity *new_entity = calloc(1, sizeof(struct resolver_entity));
+    struct resolver_entity *new_entity = resolver_alloc(sizeof(struct resolver_entity));
     memcpy(new_entity, entity, sizeof(struct resolver_entity));
     return new_entity;
 }
@@ -57,17 +88,11 @@ struct resolver_entity *resolver_result_entity(struct resolver_result *result)
 
 struct resolver_result *resolver_new_result(struct resolver_process *process)
 {
-    struct resolver_result *result = calloc(1, sizeof(struct resolver_result));
-    result->array_data.array_entities = vector_create(sizeof(struct resolver_entity *));
+    struct resolver_result *result = resolver_alloc(sizeof(struct resolver_result));
+    result->array_data.array_entities = resolver_vector_create(sizeof(struct resolver_entity *));
     return result;
 }
 
-void resolver_result_free(struct resolver_result *result)
-{
-    vector_free(result->array_data.array_entities);
-    free(result);
-}
-
 struct resolver_scope *resolver_process_scope_current(struct resolver_process *process)
 {
     return process->scope.current;
@@ -181,6 +206,7 @@ struct resolver_scope *resolver_new_scope(struct resolver_process *resolver, voi
         return NULL;
     }
 
+    resolver->cache.generation++;
     resolver->scope.current->next = scope;
     scope->prev = resolver->scope.current;
     resolver->scope.current = scope;
@@ -189,9 +215,69 @@ struct resolver_scope *resolver_new_scope(struct resolver_process *resolver, voi
     return scope;
 }
 
+static void resolver_bind_entity(struct resolver_process *process, struct resolver_scope *scope, struct resolver_entity *entity)
+{
+    vector_push(scope->entities, &entity);
+    process->cache.generation++;
+
+    struct resolver_binding *binding = calloc(1, sizeof(struct resolver_binding));
+    binding->entity = entity;
+    binding->scope = scope;
+
+    struct resolver_binding *head = hashmap_get(process->bindings, entity->name);
+    if (scope == process->scope.current || !head || head->scope == scope)
+    {
+        binding->shadowed = head;
+        hashmap_set(process->bindings, entity->name, binding);
+        return;
+    }
+
+    // Functions are bound to the root scope while inside other scopes, they must not shadow the inner bindings
+    struct resolver_binding *inner = head;
+    while (inner->shadowed && inner->shadowed->scope != scope)
+    {
+        inner = inner->shadowed;
+    }
+    binding->shadowed = inner->shadowed;
+    inner->shadowed = binding;
+}
+
+static void resolver_unbind_entity(struct resolver_process *process, struct resolver_entity *entity)
+{
+    struct resolver_binding *binding = hashmap_get(process->bindings, entity->name);
+    if (binding && binding->entity == entity)
+    {
+        hashmap_set(process->bindings, entity->name, binding->shadowed);
+        free(binding);
+        return;
+    }
+
+    while (binding && binding->shadowed)
+    {
+        if (binding->shadowed->entity == entity)
+        {
+            struct resolver_binding *unbound = binding->shadowed;
+            binding->shadowed = unbound->shadowed;
+            free(unbound);
+            return;
+        }
+        binding = binding->shadowed;
+    }
+}
+
 void resolver_finish_scope(struct resolver_process *resolver)
 {
     struct resolver_scope *scope = resolver->scope.current;
+    resolver->cache.generation++;
+    vector_set_peek_pointer(scope->entities, 0);
+    struct resolver_entity *entity = vector_peek_ptr(scope->entities);
+    while (entity)
+    {
+        resolver_unbind_entity(resolver, entity);
+        entity = vector_peek_ptr(scope->entities);
+    }
+    vector_free(scope->entities);
+
     resolver->scope.current = scope->prev;
     resolver->callbacks.delete_scope(scope);
     free(scope);
@@ -204,12 +290,14 @@ struct resolver_process *resolver_new_process(struct compile_process *compiler,
     memcpy(&process->callbacks, callbacks, sizeof(process->callbacks));
     process->scope.root = resolver_new_scope_create();
     process->scope.current = process->scope.root;
+    process->bindings = hashmap_create();
+    process->arena = arena_create();
     return process;
 }
 
 struct resolver_entity *resolver_create_new_entity(struct resolver_result *result, int type, void *private)
 {
-    struct resolver_entity *entity = calloc(1, sizeof(struct resolver_entity));
+    struct resolver_entity *entity = resolver_alloc(sizeof(struct resolver_entity));
     if (!entity)
     {
         return NULL;
@@ -361,8 +449,8 @@ struct resolver_entity *resolver_create_new_entity_for_var_node_custom_scope(str
 
     entity->scope = scope;
     assert(entity->scope);
-    entity->dtype = var_node->var.type;
-    entity->var_data.dtype = var_node->var.type;
+    entity->dtype = *var_node->var.type;
+    entity->var_data.dtype = *var_node->var.type;
     entity->node = var_node;
     entity->name = var_node->var.name;
     entity->offset = offset;
@@ -398,7 +486,7 @@ struct resolver_entity *resolver_new_entity_for_var_node(struct resolver_process
         return NULL;
     }
 
-    vector_push(process->scope.current->entities, &entity);
+    resolver_bind_entity(process, process->scope.current, entity);
     return entity;
 }
 
@@ -446,7 +534,7 @@ struct resolver_entity *resolver_create_new_entity_for_function_call(struct reso
     }
 
     entity->dtype = left_operand_entity->dtype;
-    entity->func_call_data.arguments = vector_create(sizeof(struct node *));
+    entity->func_call_data.arguments = resolver_vector_create(sizeof(struct node *));
     return entity;
 }
 
@@ -458,69 +546,46 @@ struct resolver_entity *resolver_register_function(struct resolver_process *proc
         return NULL;
     }
 
-    entity->name = func_node->func.name;
+    entity->name = func_node->func->name;
     entity->node = func_node;
-    entity->dtype = func_node->func.rtype;
+    entity->dtype = func_node->func->rtype;
     entity->scope = resolver_process_scope_current(process);
-    vector_push(process->scope.root->entities, &entity);
+    resolver_bind_entity(process, process->scope.root, entity);
     return entity;
 }
 
-struct resolver_entity *resolver_get_entity_in_scope_with_entity_type(struct resolver_result *result, struct resolver_process *resolver, struct resolver_scope *scope, const char *entity_name, int entity_type)
+/**
+ * The member of the structure or union the result last accessed, i.e b in a.b
+ */
+struct resolver_entity *resolver_get_struct_union_member(struct resolver_result *result, struct resolver_process *resolver, const char *entity_name)
 {
-
-    /*
-     * Are we accessing a structure or union
-     */
-    if (result && result->last_struct_union_entity)
+    struct resolver_scope *scope = result->last_struct_union_entity->scope;
+    struct node *out_node = NULL;
+    struct datatype *node_var_datatype = &result->last_struct_union_entity->dtype;
+    int offset = struct_offset(resolver_compiler(resolver), node_var_datatype->type_str, entity_name, &out_node);
+    if (node_var_datatype->type == DATA_TYPE_UNION)
     {
-        struct resolver_scope *scope = result->last_struct_union_entity->scope;
-        struct node *out_node = NULL;
-        struct datatype *node_var_datatype = &result->last_struct_union_entity->dtype;
-        int offset = struct_offset(resolver_compiler(resolver), node_var_datatype->type_str, entity_name, &out_node, 0, 0);
-        if (node_var_datatype->type == DATA_TYPE_UNION)
-        {
-            offset = 0;
-        }
-        return resolver_make_entity(resolver, result, NULL, out_node, &(struct resolver_entity){.type = RESOLVER_ENTITY_TYPE_VARIABLE, .offset = offset}, scope);
+        offset = 0;
     }
-
-    // Dealing with a primtiive type
-    vector_set_peek_pointer_end(scope->entities);
-    vector_set_flag(scope->entities, VECTOR_FLAG_PEEK_DECREMENT);
-    struct resolver_entity *current = vector_peek_ptr(scope->entities);
-    while (current)
-    {
-        if (entity_type != -1 && current->type != entity_type)
-        {
-            current = vector_peek_ptr(scope->entities);
-            continue;
-        }
-
-        if (S_EQ(current->name, entity_name))
-        {
-            break;
-        }
-
-        current = vector_peek_ptr(scope->entities);
-    }
-
-    return current;
+    return resolver_make_entity(resolver, result, NULL, out_node, &(struct resolver_entity){.type = RESOLVER_ENTITY_TYPE_VARIABLE, .offset = offset}, scope);
 }
 
 struct resolver_entity *resolver_get_entity_for_type(struct resolver_result *result, struct resolver_process *resolver, const char *entity_name, int entity_type)
 {
-    struct resolver_scope *scope = resolver->scope.current;
     struct resolver_entity *entity = NULL;
-    while (scope)
+    if (result && result->last_struct_union_entity)
+    {
+        entity = resolver_get_struct_union_member(result, resolver, entity_name);
+    }
+    else
     {
-        entity = resolver_get_entity_in_scope_with_entity_type(result, resolver, scope, entity_name, entity_type);
-        if (entity)
+        struct resolver_binding *binding = hashmap_get(resolver->bindings, entity_name);
+        while (binding && entity_type != -1 && binding->entity->type != entity_type)
         {
-            break;
+            binding = binding->shadowed;
         }
 
-        scope = scope->prev;
+        entity = binding ? binding->entity : NULL;
     }
 
     if (entity)
@@ -535,27 +600,15 @@ struct resolver_entity *resolver_get_entity(struct resolver_result *result, stru
     return resolver_get_entity_for_type(result, resolver, entity_name, -1);
 }
 
-struct resolver_entity *resolver_get_entity_in_scope(struct resolver_result *result, struct resolver_process *resolver, struct resolver_scope *scope, const char *entity_name)
-{
-    return resolver_get_entity_in_scope_with_entity_type(result, resolver, scope, entity_name, -1);
-}
-
 struct resolver_entity *resolver_get_variable(struct resolver_result *result, struct resolver_process *resolver, const char *var_name)
 {
     return resolver_get_entity_for_type(result, resolver, var_name, RESOLVER_ENTITY_TYPE_VARIABLE);
 }
 
-struct resolver_entity *resolver_get_function_in_scope(struct resolver_result *result, struct resolver_process *resolver, const char *func_name, struct resolver_scope *scope)
-{
-    return resolver_get_entity_for_type(result, resolver, func_name, RESOLVER_ENTITY_TYPE_FUNCTION);
-}
-
+// Functions are bound in the root scope so the lookup is global
 struct resolver_entity *resolver_get_function(struct resolver_result *result, struct resolver_process *resolver, const char *func_name)
 {
-    struct resolver_entity *entity = NULL;
-    struct resolver_scope *scope = resolver->scope.root;
-    entity = resolver_get_function_in_scope(result, resolver, func_name, scope);
-    return entity;
+    return resolver_get_entity_for_type(result, resolver, func_name, RESOLVER_ENTITY_TYPE_FUNCTION);
 }
 
 struct resolver_entity *resolver_follow_for_name(struct resolver_process *resolver, const char *name, struct resolver_result *result)
@@ -802,7 +855,7 @@ struct resolver_entity *resolver_follow_cast(struct resolver_process *resolver,
     operand_entity = resolver_result_peek(result);
     operand_entity->flags |= RESOLVER_ENTITY_FLAG_WAS_CASTED;
 
-    struct resolver_entity *cast_entity = resolver_create_new_cast_entity(resolver, operand_entity->scope, &node->cast.dtype);
+    struct resolver_entity *cast_entity = resolver_create_new_cast_entity(resolver, operand_entity->scope, node->cast.dtype);
     resolver_result_entity_push(result, cast_entity);
     return cast_entity;
 }
@@ -946,6 +999,7 @@ void resolver_execute_rules(struct resolver_process *resolver, struct resolver_r
     }
 
     resolver_push_vector_of_entities(result, saved_entities);
+    vector_free(saved_entities);
 }
 
 struct resolver_entity *resolver_merge_compile_time_result(struct resolver_process *resolver, struct resolver_result *result, struct resolver_entity *left_entity, struct resolver_entity *right_entity)
@@ -1160,6 +1214,16 @@ struct resolver_result *resolver_follow(struct resolver_process *resolver, struc
 {
     assert(resolver);
     assert(node);
+
+    // Codegen often resolves the same node more than once, nothing it depends on can change within a generation
+    struct resolver_cache_entry *cached = &resolver->cache.entries[((uintptr_t)node / sizeof(struct node)) & (RESOLVER_CACHE_TOTAL_ENTRIES - 1)];
+    if (cached->node == node && cached->generation == resolver->cache.generation)
+    {
+        return cached->result;
+    }
+
+    struct arena *previous_arena = resolver_follow_arena;
+    resolver_follow_arena = resolver->arena;
     struct resolver_result *result = resolver_new_result(resolver);
     resolver_follow_part(resolver, node, result);
     if (!resolver_result_entity_root(result))
@@ -1169,5 +1233,7 @@ struct resolver_result *resolver_follow(struct resolver_process *resolver, struc
     resolver_execute_rules(resolver, result);
     resolver_merge_compile_times(resolver, result);
     resolver_finalize_result(resolver, result);
+    resolver_follow_arena = previous_arena;
+    *cached = (struct resolver_cache_entry){.node = node, .generation = resolver->cache.generation, .result = result};
     return result;
 }
@@ -1,13 +1,14 @@
 #include "compiler.h"
 #include "helpers/vector.h"
+#include "helpers/hashmap.h"
 static void symresolver_push_symbol(struct compile_process* process, struct symbol* sym)
 {
-    vector_push(process->symbols.table, &sym);
+    hashmap_set(process->symbols.table, sym->name, sym);
 }
 
 void symresolver_initialize(struct compile_process* process)
 {
-    process->symbols.tables = vector_create(sizeof(struct vector*));
+    process->symbols.tables = vector_create(sizeof(struct hashmap*));
 }
 
 
@@ -17,31 +18,20 @@ void symresolver_new_table(struct compile_process* process)
     vector_push(process->symbols.tables, &process->symbols.table);
 
     // Overwrite the active table
-    process->symbols.table = vector_create(sizeof(struct symbol*));
+    process->symbols.table = hashmap_create();
 }
 
 void symresolver_end_table(struct compile_process* process)
 {
-    struct vector* last_table = vector_back_ptr(process->symbols.tables);
+    struct hashmap* last_table = vector_back_ptr(process->symbols.tables);
+    hashmap_free(process->symbols.table);
     process->symbols.table = last_table;
     vector_pop(process->symbols.tables);
 }
 
 struct symbol* symresolver_get_symbol(struct compile_process* process, const char* name)
 {
-    vector_set_peek_pointer(process->symbols.table, 0);
-    struct symbol* symbol = vector_peek_ptr(process->symbols.table);
-    while(symbol)
-    {
-        if (S_EQ(symbol->name, name))
-        {
-            break;
-        }
-
-        symbol = vector_peek_ptr(process->symbols.table);
-    }
-
-    return symbol;
+    return hashmap_get(process->symbols.table, name);
 }
 
 
@@ -94,7 +84,7 @@ void symresolver_build_for_variable_node(struct compile_process* process, struct
 
 void symresolver_build_for_function_node(struct compile_process* process, struct node* node)
 {
-    symresolver_register_symbol(process, node->func.name, SYMBOL_TYPE_NODE, node);
+    symresolver_register_symbol(process, node->func->name, SYMBOL_TYPE_NODE, node);
 }
 
 void symresolver_build_for_structure_node(struct compile_process* process, struct node* node)
@@ -0,0 +1,32 @@
+// expect: 103
+int main()
+{
+    int x;
+    int y;
+    int r;
+    unsigned int u;
+    x = 0 - 37;
+    y = 0 - 8;
+    u = 1000;
+    r = 0;
+    r = r + x / 4;
+    r = r + x % 4;
+    r = r + x / 7;
+    r = r + x % 7;
+    r = r + x / 10;
+    r = r + x % 3;
+    r = r + y / 2;
+    r = r + y % 8;
+    r = r + 1000 / 3;
+    r = r + x * 9;
+    r = r + x * 12;
+    r = r - y * 15;
+    // 2^k+1 and 2^k-1 go through a scratch register, negative constants add a neg
+    r = r + x * 17;
+    r = r + x * 7;
+    r = r + x * -3;
+    r = r + u / 7;
+    r = r + u % 9;
+    r = r + u / 16;
+    return r;
+}
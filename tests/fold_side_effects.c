@@ -0,0 +1,28 @@
+// expect: 117
+int calls;
+int g = 3 * 4 - 2;
+
+int f()
+{
+    calls = calls + 1;
+    return 7;
+}
+
+int main()
+{
+    int a;
+    int b;
+    int c;
+    int d;
+    int e;
+    int h;
+    calls = 0;
+    a = f() * 0;
+    b = 0 * f();
+    c = f() - 0;
+    d = (f() & 0) + (f() | 0) * 1;
+    // Both calls happen even though the operands look the same
+    e = f() - f();
+    h = (char)300 + ~5 + (1 << 3);
+    return calls * 5 + a + b + c + d + e + h + g + 5 * 2 + 2;
+}
@@ -0,0 +1,37 @@
+// expect: 43
+int zero()
+{
+    return 0;
+}
+
+int main()
+{
+    int a;
+    int b;
+    int x;
+    int i;
+    a = 3;
+    b = 5;
+    x = a < b ? 10 : 20;
+    x = x + ((a > b) && (b > 4));
+    x = x + ((a == 3) || (b == 9));
+    if (a < b && !(b < a))
+    {
+        x = x + 4;
+    }
+    if (a > b || b == 5)
+    {
+        x = x + 8;
+    }
+    // The right operand of && must not run once the left one is false
+    if (zero() && a / zero())
+    {
+        x = x + 1000;
+    }
+    i = 0;
+    while (i < 10 && (i < 3 || a == 3))
+    {
+        i = i + 1;
+    }
+    return x + i * (a != b ? 2 : 1);
+}
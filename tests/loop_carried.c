@@ -0,0 +1,32 @@
+// expect: 163
+int main()
+{
+    int a;
+    int b;
+    int t;
+    int i;
+    int j;
+    int total;
+    a = 0;
+    b = 1;
+    i = 0;
+    while (i < 12)
+    {
+        t = a + b;
+        a = b;
+        b = t;
+        i = i + 1;
+    }
+
+    total = 0;
+    for (i = 0; i < 5; i = i + 1)
+    {
+        j = i;
+        do
+        {
+            total = total + j;
+            j = j - 1;
+        } while (j > 0);
+    }
+    return a + total - 1;
+}
@@ -0,0 +1,28 @@
+// expect: 118
+int g;
+
+void set(int *p, int value)
+{
+    *p = value;
+}
+
+int main()
+{
+    int x;
+    int y;
+    int *p;
+    int *q;
+    int t;
+    x = 5;
+    p = &x;
+    q = p;
+    *p = 7;
+    y = x;
+    *q = y + 1;
+    set(&x, x * 2);
+    g = 3;
+    p = &g;
+    t = *p;
+    *p = t + 90;
+    return x + y + g + 2;
+}
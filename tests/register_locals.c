@@ -0,0 +1,22 @@
+// expect: 142
+int add(int a, int b)
+{
+    return a + b;
+}
+
+int main()
+{
+    int total = 0;
+    int i;
+    for (i = 0; i < 6; i++)
+    {
+        // esi and edi are callee saved so the loop carried values survive the call
+        total += add(i, 1);
+        total = total - 1;
+    }
+
+    int before = i++;
+    int after = --i;
+    total -= 2;
+    return total * 10 + before + after;
+}
@@ -0,0 +1,38 @@
+#!/bin/bash
+# Compiles every program in tests at -O0, -O1 and -O2, runs it and checks its exit code
+# against the "// expect: N" line at the top of the program. Needs nasm and an i386 capable ld.
+cd "$(dirname "$0")/.."
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+nasm -f elf32 tests/start.asm -o "$work/start.o" || exit 1
+failed=0
+for program in tests/*.c; do
+    name=$(basename "$program" .c)
+    expected=$(sed -n 's|^// expect: \([0-9]*\)$|\1|p' "$program")
+    for level in O0 O1 O2; do
+        flag=""
+        if [ "$level" != "O0" ]; then
+            flag="-$level"
+        fi
+        output="$work/$name-$level"
+        ./main "$program" "$output.asm" object $flag > "$output.log" 2>&1
+        if ! grep -q "everything compiled" "$output.log" || ! ld -m elf_i386 "$work/start.o" "$output.asm.o" -o "$output" >> "$output.log" 2>&1; then
+            echo "FAIL $name -$level: did not build"
+            failed=1
+            continue
+        fi
+
+        "$output"
+        result=$?
+        if [ "$result" != "$expected" ]; then
+            echo "FAIL $name -$level: exited with $result, expected $expected"
+            failed=1
+        fi
+    done
+done
+
+if [ $failed -ne 0 ]; then
+    exit 1
+fi
+echo "All tests passed"
@@ -0,0 +1,24 @@
+// expect: 42
+int main()
+{
+    int a;
+    int b;
+    int x;
+    a = 3;
+    b = 5;
+    x = 0;
+    // The comparison's setcc is tested again by the branch, the peephole pass jumps on its flags instead
+    if ((a < b) != 0)
+    {
+        x = x + 40;
+    }
+    if ((a > b) == 0)
+    {
+        x = x + 2;
+    }
+    if ((a == b) != 0)
+    {
+        x = x + 100;
+    }
+    return x;
+}
@@ -0,0 +1,9 @@
+; Entry point for the test programs, exits with the value main returns
+global _start
+extern main
+section .text
+_start:
+call main
+mov ebx, eax
+mov eax, 1
+int 0x80
@@ -0,0 +1,86 @@
+// expect: 73
+// Switches whose value is known at compile time, the jump table must still link when its cases are unreachable
+
+int out_of_range()
+{
+    int x;
+    int r;
+    x = 9;
+    r = 0;
+    switch (x)
+    {
+    case 1:
+        r = 10;
+        break;
+    case 2:
+        r = 20;
+        break;
+    case 3:
+        r = 30;
+        break;
+    case 4:
+        r = 40;
+        break;
+    case 5:
+        r = 50;
+        break;
+    }
+    return r;
+}
+
+int folded()
+{
+    switch (2 + 7)
+    {
+    case 1:
+        return 1;
+    case 2:
+        return 2;
+    case 3:
+        return 3;
+    case 4:
+        return 4;
+    default:
+        return 2;
+    }
+}
+
+int in_range()
+{
+    int x;
+    x = 3;
+    switch (x)
+    {
+    case 1:
+    case 2:
+    case 3:
+    case 4:
+        return 30;
+    case 100:
+        return 100;
+    }
+    return 0;
+}
+
+int dense(int x)
+{
+    switch (x)
+    {
+    case 1:
+        return 10;
+    case 2:
+        return 20;
+    case 3:
+        return 30;
+    case 4:
+        return 40;
+    case 5:
+        return 50;
+    }
+    return 1;
+}
+
+int main()
+{
+    return out_of_range() + folded() + in_range() + dense(4) + dense(7);
+}